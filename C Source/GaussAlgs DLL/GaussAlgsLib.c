@@ -14,6 +14,19 @@
 #include "GaussAlgsLib.h"
 #include "GaussAlgsPrivate.h"
 
+/* sort key for building a peak index */
+typedef struct
+   {
+   double   channel;
+   int      position;
+   } PeakKey;
+
+/* prototypes for private methods */
+static int compare_peak_keys(const void *key1, const void *key2);
+static int index_lower_bound(const GLPeakIndex *index, double channel);
+static int index_upper_bound(const GLPeakIndex *index, double channel);
+static GLRtnCode sort_peak_index(GLPeakIndex *index);
+
 
 GLRtnCode GL_add_chanpeak(double channel, GLPeakList *peaks)
 {
@@ -138,6 +151,18 @@ else
 return(GL_SUCCESS);
 }
 
+GLFitCache *GL_fit_cache_alloc(void)
+{
+GLFitCache	*cache;
+
+if ((cache = (GLFitCache *) malloc(sizeof(GLFitCache))) == NULL)
+   return(NULL);
+
+cache->jcache = NULL;
+
+return(cache);
+}
+
 void GL_fitreclist_free(GLFitRecList *fitreclist)
 {
 if (fitreclist == NULL)
@@ -152,6 +177,22 @@ free(fitreclist);
 return;
 }
 
+void GL_fitreclist_solver_stats(const GLFitRecList *fitreclist,
+                                GLSolverStats *totals)
+{
+totals->iterations = 0;
+totals->evaluations = 0;
+totals->wall_seconds = 0;
+totals->cpu_seconds = 0;
+
+/* every record holds the totals of the region fit */
+
+if (NULL != fitreclist)
+   *totals = fitreclist->record->region_stats;
+
+return;
+}
+
 GLRtnCode GL_get_regnpks(const GLChanRange *region, const GLPeakList *peaks,
                          GLPeakList *pks_in_rgn)
 {
@@ -178,6 +219,35 @@ for (i = 0; i < peaks->npeaks; i++)
 return(GL_SUCCESS);
 }
 
+GLRtnCode GL_get_regnpks_indexed(const GLChanRange *region,
+                                 const GLPeakList *peaks,
+                                 const GLPeakIndex *index,
+                                 GLPeakList *pks_in_rgn)
+{
+int	i;
+int	first;
+int	last;
+
+if (pks_in_rgn->listlength <= 0)
+   return(GL_OVRLMT);
+
+pks_in_rgn->npeaks = 0;
+
+first = index_lower_bound(index, region->first);
+last = index_upper_bound(index, region->last);
+
+for (i = first; i < last; i++)
+   {
+   if (GL_add_peak(&peaks->peak[index->position[i]], pks_in_rgn) ==
+       GL_OVRLMT)
+      {
+      return(GL_OVRLMT);
+      }
+   }
+
+return(GL_SUCCESS);
+}
+
 GLRtnCode GL_get_version(const char *java_class_path, char *version,
                          int version_length, char *error_message,
                          int error_message_length)
@@ -268,6 +338,127 @@ GAP_delete_local_refs(env, localRefs, nRefs);
 return(GL_SUCCESS);
 }
 
+GLRtnCode GL_partition_peaks_by_regions(const GLRegions *regions,
+                                        const GLPeakList *peaks,
+                                        const GLPeakIndex *index,
+                                        GLPeakList **pks_in_rgns)
+{
+GLPeakIndex        *own_index;
+const GLPeakIndex  *use_index;
+const GLChanRange  *chanrange;
+GLPeakList         *pks_in_rgn;
+int                r;
+int                i;
+int                first;
+GLRtnCode          ret_code;
+
+own_index = NULL;
+use_index = index;
+if (NULL == use_index)
+   {
+   own_index = GL_peak_index_alloc(peaks);
+   if (NULL == own_index)
+      return(GL_BADMALLOC);
+   use_index = own_index;
+   }
+
+ret_code = GL_SUCCESS;
+first = 0;
+
+for (r = 0; (r < regions->nregions) && (GL_SUCCESS == ret_code); r++)
+   {
+   chanrange = &regions->chanrange[r];
+   pks_in_rgn = pks_in_rgns[r];
+
+   if (pks_in_rgn->listlength <= 0)
+      {
+      ret_code = GL_OVRLMT;
+      break;
+      }
+   pks_in_rgn->npeaks = 0;
+
+   /* in channel order the first peak only moves forward */
+
+   if ((0 < r) && (chanrange->first >= regions->chanrange[r-1].first))
+      {
+      while ((first < use_index->npeaks) &&
+             (use_index->channel[first] < chanrange->first))
+         first++;
+      }
+   else
+      {
+      first = index_lower_bound(use_index, chanrange->first);
+      }
+
+   for (i = first; (i < use_index->npeaks) &&
+                   (use_index->channel[i] <= chanrange->last); i++)
+      {
+      if (GL_add_peak(&peaks->peak[use_index->position[i]], pks_in_rgn) ==
+          GL_OVRLMT)
+         {
+         ret_code = GL_OVRLMT;
+         break;
+         }
+      }
+   }
+
+if (NULL != own_index)
+   GL_peak_index_free(own_index);
+
+return(ret_code);
+}
+
+GLPeakIndex *GL_peak_index_alloc(const GLPeakList *peaks)
+{
+GLPeakIndex  *index;
+int          listlength;
+int          i;
+int          n;
+GLboolean    sorted;
+
+if ((index = (GLPeakIndex *) malloc(sizeof(GLPeakIndex))) == NULL)
+   return(NULL);
+
+listlength = (0 < peaks->npeaks) ? peaks->npeaks : 1;
+index->position = (int *) calloc(listlength, sizeof(int));
+index->channel = (double *) calloc(listlength, sizeof(double));
+if ((NULL == index->position) || (NULL == index->channel))
+   {
+   GL_peak_index_free(index);
+   return(NULL);
+   }
+
+n = 0;
+sorted = GL_TRUE;
+for (i = 0; i < peaks->npeaks; i++)
+   {
+   if (peaks->peak[i].channel_valid == GL_TRUE)
+      {
+      index->position[n] = i;
+      index->channel[n] = peaks->peak[i].channel;
+      if ((0 < n) && (index->channel[n] < index->channel[n-1]))
+         sorted = GL_FALSE;
+      n++;
+      }
+   }
+index->npeaks = n;
+
+if ((GL_FALSE == sorted) && (GL_SUCCESS != sort_peak_index(index)))
+   {
+   GL_peak_index_free(index);
+   return(NULL);
+   }
+
+return(index);
+}
+
+void GL_peak_index_free(GLPeakIndex *index)
+{
+free(index->position);
+free(index->channel);
+free(index);
+}
+
 GLPeakSearchResults *GL_peak_results_alloc(int peak_listlength,
                                            int spectrum_nchannels)
 {
@@ -291,8 +482,8 @@ if ((results->refinements = (GLPeakRefinement *)
    return(NULL);
    }
 
-if ((results->crosscorrs = (int *)
-	calloc(spectrum_nchannels, sizeof(int))) == NULL)
+if ((results->crosscorrs = (GLlong *)
+	calloc(spectrum_nchannels, sizeof(GLlong))) == NULL)
    {
    free(results->refinements);
    GL_peaks_free(results->peaklist);
@@ -359,14 +550,21 @@ free(regions->chanrange);
 free(regions);
 }
 
+GLRgnSrchState *GL_regnsearch_state_alloc(void)
+{
+GLRgnSrchState	*state;
+
+if ((state = (GLRgnSrchState *) malloc(sizeof(GLRgnSrchState))) == NULL)
+   return(NULL);
+
+state->jstate = NULL;
+
+return(state);
+}
+
 GLRtnCode GL_spectrum_counts_alloc(GLSpectrum *spectrum, int listlength)
 {
-#if (! defined(GL_LINUX)) && (! defined(GL_MACOSX))
-/* for Visual C++ */
-spectrum->count = (__int32 *) calloc(listlength, sizeof(__int32));
-#else
-spectrum->count = (int *) calloc(listlength, sizeof(int));
-#endif
+spectrum->count = (GLlong *) calloc(listlength, sizeof(GLlong));
 
 if (NULL == spectrum->count)
    {
@@ -426,3 +624,90 @@ else
          }
    }
 }
+
+/* private utilities */
+
+static int compare_peak_keys(const void *key1, const void *key2)
+{
+const PeakKey  *peak1 = (const PeakKey *) key1;
+const PeakKey  *peak2 = (const PeakKey *) key2;
+
+if (peak1->channel < peak2->channel)
+   return(-1);
+if (peak1->channel > peak2->channel)
+   return(1);
+
+/* keep list order for equal channels */
+return(peak1->position - peak2->position);
+}
+
+static int index_lower_bound(const GLPeakIndex *index, double channel)
+{
+int	low;
+int	high;
+int	middle;
+
+/* first indexed peak with channel >= 'channel' */
+
+low = 0;
+high = index->npeaks;
+while (low < high)
+   {
+   middle = low + ((high - low) / 2);
+   if (index->channel[middle] < channel)
+      low = middle + 1;
+   else
+      high = middle;
+   }
+
+return(low);
+}
+
+static int index_upper_bound(const GLPeakIndex *index, double channel)
+{
+int	low;
+int	high;
+int	middle;
+
+/* first indexed peak with channel > 'channel' */
+
+low = 0;
+high = index->npeaks;
+while (low < high)
+   {
+   middle = low + ((high - low) / 2);
+   if (index->channel[middle] <= channel)
+      low = middle + 1;
+   else
+      high = middle;
+   }
+
+return(low);
+}
+
+static GLRtnCode sort_peak_index(GLPeakIndex *index)
+{
+PeakKey	*keys;
+int		i;
+
+if ((keys = (PeakKey *) calloc(index->npeaks, sizeof(PeakKey))) == NULL)
+   return(GL_BADMALLOC);
+
+for (i = 0; i < index->npeaks; i++)
+   {
+   keys[i].channel = index->channel[i];
+   keys[i].position = index->position[i];
+   }
+
+qsort(keys, index->npeaks, sizeof(PeakKey), compare_peak_keys);
+
+for (i = 0; i < index->npeaks; i++)
+   {
+   index->channel[i] = keys[i].channel;
+   index->position[i] = keys[i].position;
+   }
+
+free(keys);
+
+return(GL_SUCCESS);
+}
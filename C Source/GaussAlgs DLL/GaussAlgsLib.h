@@ -42,6 +42,18 @@
       } GLboolean;
 
 
+/*
+ * GLlong is a 64-bit signed integer used for channel counts and
+ * accumulated sums of counts, so that large spectra cannot overflow.
+ */
+
+#if (! defined(GL_LINUX)) && (! defined(GL_MACOSX))
+   typedef __int64	GLlong;		/* for Visual C++ */
+#else
+   typedef long long	GLlong;
+#endif
+
+
 /*
  * definition of fitting range
  */
@@ -119,11 +131,7 @@
       int		listlength;	/* array size of count & sigcount */
       int		nchannels;
       int		firstchannel;
-#if (! defined(GL_LINUX)) && (! defined(GL_MACOSX))
-      __int32	*count;		/* for Visual C++ */
-#else
-      int		*count;		/* list of counts per channel */
-#endif
+      GLlong	*count;		/* list of counts per channel */
       } GLSpectrum;
 
 
@@ -165,6 +173,20 @@
       GLPeak	*peak;		/* array of peaks */
       } GLPeakList;
 
+
+/*
+ * GLPeakIndex is a channel-sorted index into a GLPeakList, made by
+ * GL_peak_index_alloc(). Only peaks with valid channels are indexed. It
+ * refers to the list by position, so rebuild it if the list changes.
+ */
+
+   typedef struct
+      {
+      int		npeaks;		/* number of indexed peaks */
+      int		*position;	/* position of each peak in the list */
+      double	*channel;	/* channel of each peak, ascending */
+      } GLPeakIndex;
+
 /*
  * GLPeakRefinement is a structure to hold the results of a peak refinement.
  *                  If the peak search decides that the refinement is best,
@@ -192,7 +214,7 @@
 	  GLPeakList        *peaklist;         /* found peaks */
 	  GLPeakRefinement	*refinements;      /* array of peak refinements */
 	  int               listlength;        /* array size of crossproducts */
-	  int               *crosscorrs;       /* cross-correlations */
+	  GLlong            *crosscorrs;       /* cross-correlations */
       } GLPeakSearchResults;
 
 
@@ -222,6 +244,29 @@
       } GLRgnSrchMode;
 
 
+/*
+ * GLRgnSrchState keeps the background of a region search between calls
+ * to GL_regnsearch_incremental(). Treat it as opaque.
+ */
+
+   typedef struct
+      {
+      void		*jstate;	/* global ref to Java RegionSearchState */
+      } GLRgnSrchState;
+
+
+/*
+ * GLFitCache keeps the best fits of regions between calls to
+ * GL_fitregn_cached(), keyed by detector ID and region. Treat it as
+ * opaque.
+ */
+
+   typedef struct
+      {
+      void		*jcache;	/* global ref to Java FitWarmStartCache */
+      } GLFitCache;
+
+
 /*
  * enumerations of legal fit parameter values
  */
@@ -303,6 +348,29 @@
  * max_resid	- fitregn() recycles until the fit residual at
  *				  each channel in the region is less than the
  *				  value of max_resid. (if not stopped sooner)
+ * speculate	- GL_TRUE starts a fit cycle on another thread as soon
+ *				  as it is sure to follow the running one, which is
+ *				  when a peak will be deleted. The fits are the same
+ *				  as with GL_FALSE.
+ * bounded		- GL_TRUE keeps peak heights at 10 or more, 511 keV
+ *				  extra widths at 0 or more and centroids 2 channels
+ *				  inside the region while the solver runs, instead of
+ *				  moving them there between fit cycles. Peaks cannot
+ *				  go negative, so negpeak_alarm is not raised.
+ * variable_projection	- GL_TRUE solves the background and peak
+ *				  heights by linear least squares at each step, so
+ *				  the solver only varies the widths and centroids.
+ *				  With bounded the heights are only bounded between
+ *				  fit cycles.
+ * adaptive_tolerances	- GL_TRUE solves each fit cycle with tolerances
+ *				  100 times looser than cc_type gives, then
+ *				  refines it from its answer with the cc_type
+ *				  tolerances before peaks are added or deleted.
+ * lmder_solver	- GL_TRUE solves the fit cycles with LmderSolver, the
+ *				  array based solver, instead of the Commons Math
+ *				  optimizer. It is not yet the default, as it has
+ *				  not been checked against the optimizer on a JVM.
+ *				  bounded and variable_projection always use it.
  */
 
    typedef struct
@@ -313,6 +381,11 @@
       GLPkwdMode  pkwd_mode;
       GLCCType	  cc_type;
       float		  max_resid;  /* suggested values 2 or 20 */
+      GLboolean	  speculate;  /* suggested value GL_FALSE */
+      GLboolean	  bounded;	  /* suggested value GL_FALSE */
+      GLboolean	  variable_projection;  /* suggested value GL_FALSE */
+      GLboolean	  adaptive_tolerances;  /* suggested value GL_FALSE */
+      GLboolean	  lmder_solver;  /* suggested value GL_FALSE */
       } GLFitParms;
 
 
@@ -399,6 +472,22 @@
       } GLCurve;
 
 
+/*
+ * GLSolverStats contains the work done by the least squares solver in one
+ *               fit cycle, or in all the cycles of a region fit.
+ */
+
+   typedef struct
+      {
+      int        iterations;    /* Levenberg-Marquardt iterations */
+      int        evaluations;   /* of the residuals and the Jacobian, */
+                                /*   which are computed together */
+      double     wall_seconds;  /* elapsed time */
+      double     cpu_seconds;   /* of the fitting thread, 0 if the JVM */
+                                /*   does not measure it */
+      } GLSolverStats;
+
+
 /*
  * GLFitRecord contains fit information corresponding to one fit cycle.
  *
@@ -406,6 +495,10 @@
  * fitregn() for the fit.
  *
  * The rest of the information in this structure is passed out by fitregn().
+ *
+ * used_spectrum only holds the counts of used_chanrange, with firstchannel
+ * set to used_chanrange.first, and input_peaks only holds the input peaks
+ * whose channels round into used_chanrange, the ones the fit used.
  */
 
    typedef struct
@@ -415,11 +508,15 @@
       GLFitParms        used_parms;
       GLEnergyEqn       used_ex;
       GLWidthEqn        used_wx;
-      GLSpectrum        used_spectrum;
-      GLPeakList        input_peaks;
+      GLSpectrum        used_spectrum;     /* region counts only */
+      GLPeakList        input_peaks;       /* peaks in the region */
       double            chi_sq;            /* reduced chi squared of the fit */
       GLCycleReturn     cycle_return;
       char              *cycle_exception;  /* NULL when no exception */
+      GLSolverStats     solver_stats;      /* this cycle */
+      GLSolverStats     region_stats;      /* every cycle of the region */
+                                           /*   fit, the same in each */
+                                           /*   record of the list */
       GLFitBackLin      back_linear;
       GLSummary         *summary;
       GLCurve           *curve;
@@ -600,6 +697,63 @@ extern "C" {
                                         int error_message_length);
 
 
+/*
+ * GL_fit_cache_alloc
+ *
+ *   allocates an empty GLFitCache for GL_fitregn_cached().
+ *
+ *   Returns NULL on failure.
+ */
+
+   DLLEXPORT GLFitCache *GL_fit_cache_alloc(void);
+
+
+/*
+ * GL_fit_cache_free
+ *
+ *   releases the saved fits and frees GLFitCache memory that was
+ *   allocated with GL_fit_cache_alloc().
+ *
+ *   Possible return codes: GL_NOJVM, GL_SUCCESS
+ */
+
+   DLLEXPORT GLRtnCode GL_fit_cache_free(const char *java_class_path,
+                                         GLFitCache *cache,
+                                         char *error_message,
+                                         int error_message_length);
+
+
+/*
+ * GL_fit_spectrum
+ *
+ *   fits every region in 'regions' with one call into Java and stores the
+ *   answer for regions->chanrange[i] in fitlists[i], so the calling routine
+ *   must provide space for regions->nregions fitlist pointers. Each region
+ *   is fitted as by GL_fitregn() with the peaks in the region, and the
+ *   regions are spread over 'nthreads' threads, largest regions first.
+ *   The fits do not depend on the number of threads. Free each fitlist
+ *   with GL_fitreclist_free(); on failure none are returned.
+ *
+ *   java_class_path is the path to each jar needed, including
+ *                   GaussAlgorithms.jar
+ *
+ *   Possible return codes: GL_FAILURE, GL_NOJVM, GL_JNIERROR, GL_JEXCEPTION,
+ *                          GL_BADMALLOC, GL_OVRLMT, GL_SUCCESS
+ */
+
+   DLLEXPORT GLRtnCode GL_fit_spectrum(const char *java_class_path,
+                                       const GLRegions *regions,
+                                       const GLSpectrum *spectrum,
+                                       const GLPeakList *peaks,
+                                       const GLFitParms *fitparms,
+                                       const GLEnergyEqn *ex,
+                                       const GLWidthEqn *wx,
+                                       int nplots_per_chan, int nthreads,
+                                       GLFitRecList **fitlists,
+                                       char *error_message,
+                                       int error_message_length);
+
+
 /*
  * GL_fitreclist_free
  *
@@ -610,6 +764,20 @@ extern "C" {
    DLLEXPORT void GL_fitreclist_free(GLFitRecList *fitreclist);
 
 
+/*
+ * GL_fitreclist_solver_stats
+ *
+ *   copies the solver statistics of the whole region fit that returned
+ *   'fitreclist' into 'totals': every cycle, including the failed ones,
+ *   the ones not among the GLFitParms.nout fits in the list and the
+ *   speculative ones that were cancelled. 'totals' is zero for a NULL
+ *   list.
+ */
+
+   DLLEXPORT void GL_fitreclist_solver_stats(const GLFitRecList *fitreclist,
+                                             GLSolverStats *totals);
+
+
 /*
  * GL_fitregn
  *
@@ -644,6 +812,68 @@ extern "C" {
                                   int error_message_length);
 
 
+/*
+ * GL_fitregn_background
+ *
+ *   does the same fit as GL_fitregn(), but starts the background line
+ *   from 'background' instead of from the counts at the end of the region.
+ *   'background' has one value per spectrum channel, as returned by
+ *   GL_regnsearch_background(). The starting intercept and slope are the
+ *   least squares line through its values in the region; if they are all
+ *   zero, the usual starting guess is used.
+ *
+ *   Possible return codes: GL_FAILURE, GL_NOJVM, GL_JNIERROR, GL_JEXCEPTION,
+ *                          GL_BADMALLOC, GL_SUCCESS
+ */
+
+   DLLEXPORT GLRtnCode GL_fitregn_background(const char *java_class_path,
+                                             const GLChanRange *region,
+                                             const GLSpectrum *spectrum,
+                                             const GLPeakList *peaks,
+                                             const GLFitParms *fitparms,
+                                             const GLEnergyEqn *ex,
+                                             const GLWidthEqn *wx,
+                                             const GLlong *background,
+                                             int nplots_per_chan,
+                                             GLFitRecList **fitlist,
+                                             char *error_message,
+                                             int error_message_length);
+
+
+/*
+ * GL_fitregn_cached
+ *
+ *   does the same fit as GL_fitregn(), but starts from the best fit that
+ *   'cache' holds for 'detector_id' and this region, if there is one.
+ *   That fit already has the peaks that the add and delete cycles found,
+ *   so a spectrum much like the last one from the detector is fitted in
+ *   fewer cycles. 'peaks' is only used when the region is fitted from the
+ *   usual starting guess: when the cache holds no fit, when the warm fit
+ *   fails, or when its chi squared is more than 1.5 times that of the
+ *   last such fit of the region. The best fit is then saved in 'cache'.
+ *
+ *   A warm fit may find different peaks than a fit from 'peaks' would.
+ *   Call GL_fit_cache_free() to clear the cache.
+ *
+ *   Possible return codes: GL_FAILURE, GL_NOJVM, GL_JNIERROR, GL_JEXCEPTION,
+ *                          GL_BADMALLOC, GL_SUCCESS
+ */
+
+   DLLEXPORT GLRtnCode GL_fitregn_cached(const char *java_class_path,
+                                         const char *detector_id,
+                                         const GLChanRange *region,
+                                         const GLSpectrum *spectrum,
+                                         const GLPeakList *peaks,
+                                         const GLFitParms *fitparms,
+                                         const GLEnergyEqn *ex,
+                                         const GLWidthEqn *wx,
+                                         int nplots_per_chan,
+                                         GLFitCache *cache,
+                                         GLFitRecList **fitlist,
+                                         char *error_message,
+                                         int error_message_length);
+
+
 /*
  * GL_get_regnpks
  *
@@ -659,6 +889,23 @@ extern "C" {
                                       GLPeakList *pks_in_rgn);
 
 
+/*
+ * GL_get_regnpks_indexed
+ *
+ *   returns the same peaks as GL_get_regnpks(), but finds them with a
+ *   binary search of 'index', which must have been made from 'peaks' by
+ *   GL_peak_index_alloc(). The peaks are returned in channel order, which
+ *   is the list order for lists from GL_peaksearch().
+ *
+ *   Possible return codes: GL_OVRLMT, GL_SUCCESS
+ */
+
+   DLLEXPORT GLRtnCode GL_get_regnpks_indexed(const GLChanRange *region,
+                                              const GLPeakList *peaks,
+                                              const GLPeakIndex *index,
+                                              GLPeakList *pks_in_rgn);
+
+
 /*
  * GL_get_version
  *
@@ -678,6 +925,47 @@ extern "C" {
                                       int error_message_length);
 
 
+/*
+ * GL_partition_peaks_by_regions
+ *
+ *   does GL_get_regnpks_indexed() for every region at once. The peaks in
+ *   regions->chanrange[i] are returned in pks_in_rgns[i], so the calling
+ *   routine must provide regions->nregions peak lists. When the regions
+ *   are in channel order, as from GL_regnsearch(), one sweep of the index
+ *   serves all of them. 'index' may be NULL, in which case one is made
+ *   from 'peaks' and freed before returning.
+ *
+ *   Possible return codes: GL_BADMALLOC, GL_OVRLMT, GL_SUCCESS
+ */
+
+   DLLEXPORT GLRtnCode GL_partition_peaks_by_regions(
+                                              const GLRegions *regions,
+                                              const GLPeakList *peaks,
+                                              const GLPeakIndex *index,
+                                              GLPeakList **pks_in_rgns);
+
+
+/*
+ * GL_peak_index_alloc
+ *
+ *   makes a channel-sorted index of the peaks with valid channels. A list
+ *   that is already in channel order is indexed without sorting.
+ *
+ *   Returns NULL on failure.
+ */
+
+   DLLEXPORT GLPeakIndex *GL_peak_index_alloc(const GLPeakList *peaks);
+
+
+/*
+ * GL_peak_index_free
+ *
+ *   frees a GLPeakIndex that was allocated with GL_peak_index_alloc().
+ */
+
+   DLLEXPORT void GL_peak_index_free(GLPeakIndex *index);
+
+
 /*
  * GL_peak_results_alloc 
  *
@@ -753,6 +1041,41 @@ extern "C" {
                                      int error_message_length);
 
 
+/*
+ * GL_peaksearch_multires
+ *
+ *   searches for peaks in the spectrum like GL_peaksearch(), but screens
+ *   the spectrum first on a pyramid of 'levels' coarser rebinnings of it.
+ *   The full resolution search and refinement are only done inside the
+ *   windows that survive the coarse levels, which saves most of the work
+ *   on long spectra that are mostly smooth continuum.
+ *
+ *   The screening is not exact, so a weak peak found by GL_peaksearch()
+ *   may be missed. Compare the two searches on a reference spectrum to
+ *   measure the recall before relying on this mode. Cross-correlations
+ *   outside the searched windows are returned as zero.
+ *
+ *   levels must be between 1 and 10.
+ *
+ *   java_class_path is the path to each jar needed, including
+ *                   GaussAlgorithms.jar
+ *
+ *   The calling routine must provide space for the answer in 'results'.
+ *
+ *   Possible return codes: GL_FAILURE, GL_NOJVM, GL_JNIERROR,
+ *                          GL_JEXCEPTION, GL_SUCCESS
+ */
+
+   DLLEXPORT GLRtnCode GL_peaksearch_multires(const char *java_class_path,
+                                              const GLChanRange *chanrange,
+                                              const GLWidthEqn *wx,
+                                              int threshold, int levels,
+                                              const GLSpectrum *spectrum,
+                                              GLPeakSearchResults *results,
+                                              char *error_message,
+                                              int error_message_length);
+
+
 /*
  * GL_prune_rqdpks
  *
@@ -840,6 +1163,115 @@ extern "C" {
                                      int error_message_length);
 
 
+/*
+ * GL_regnsearch_background
+ *
+ *   does the same search as GL_regnsearch(), and also copies the smoothed
+ *   background of the search into 'background', which must have room for
+ *   spectrum->nchannels values. The background is only computed in
+ *   GL_RGNSRCH_ALL mode; in GL_RGNSRCH_FORPKS mode it is all zero. Pass it
+ *   to GL_fitregn_background() to start the fits from it.
+ *
+ *   Possible return codes: GL_FAILURE, GL_NOJVM, GL_JNIERROR, GL_JEXCEPTION,
+ *                          GL_SUCCESS
+ */
+
+   DLLEXPORT GLRtnCode GL_regnsearch_background(const char *java_class_path,
+                                                const GLChanRange *chanrange,
+                                                const GLWidthEqn *wx,
+                                                double threshold, int irw,
+                                                int irch,
+                                                const GLSpectrum *spectrum,
+                                                const GLPeakList *peaks,
+                                                GLRgnSrchMode mode,
+                                                int maxrgnwid,
+                                                GLRegions *regions,
+                                                GLlong *background,
+                                                char *error_message,
+                                                int error_message_length);
+
+
+/*
+ * GL_regnsearch_incremental
+ *
+ *   does the same search as GL_regnsearch(), but keeps the smoothed
+ *   background in 'state'. When called again with the same spectrum,
+ *   search range and width equation, only the steps that depend on the
+ *   peak list are redone, so re-searching after adding or removing peaks
+ *   is quicker. If any of those inputs change, the background is
+ *   recomputed and saved. 'state' comes from GL_regnsearch_state_alloc().
+ *
+ *   Possible return codes: GL_FAILURE, GL_NOJVM, GL_JNIERROR,
+ *                          GL_JEXCEPTION, GL_SUCCESS
+ */
+
+   DLLEXPORT GLRtnCode GL_regnsearch_incremental(const char *java_class_path,
+                                                 const GLChanRange *chanrange,
+                                                 const GLWidthEqn *wx,
+                                                 double threshold,
+                                                 int irw, int irch,
+                                                 const GLSpectrum *spectrum,
+                                                 const GLPeakList *peaks,
+                                                 GLRgnSrchMode mode,
+                                                 int maxrgnwid,
+                                                 GLRgnSrchState *state,
+                                                 GLRegions *regions,
+                                                 char *error_message,
+                                                 int error_message_length);
+
+
+/*
+ * GL_regnsearch_parallel
+ *
+ *   does the same search as GL_regnsearch(), but spreads the work over
+ *   'nthreads' Java threads. The search range is split where enough
+ *   channels are not flagged as region that no step can see across the
+ *   split, so the regions found are identical to GL_regnsearch().
+ *
+ *   Possible return codes: GL_FAILURE, GL_NOJVM, GL_JNIERROR,
+ *                          GL_JEXCEPTION, GL_SUCCESS
+ */
+
+   DLLEXPORT GLRtnCode GL_regnsearch_parallel(const char *java_class_path,
+                                              const GLChanRange *chanrange,
+                                              const GLWidthEqn *wx,
+                                              double threshold,
+                                              int irw, int irch,
+                                              const GLSpectrum *spectrum,
+                                              const GLPeakList *peaks,
+                                              GLRgnSrchMode mode,
+                                              int maxrgnwid, int nthreads,
+                                              GLRegions *regions,
+                                              char *error_message,
+                                              int error_message_length);
+
+
+/*
+ * GL_regnsearch_state_alloc
+ *
+ *   allocates an empty GLRgnSrchState for GL_regnsearch_incremental().
+ *
+ *   Returns NULL on failure.
+ */
+
+   DLLEXPORT GLRgnSrchState *GL_regnsearch_state_alloc(void);
+
+
+/*
+ * GL_regnsearch_state_free
+ *
+ *   releases the saved background and frees GLRgnSrchState memory that
+ *   was allocated with GL_regnsearch_state_alloc().
+ *
+ *   Possible return codes: GL_NOJVM, GL_SUCCESS
+ */
+
+   DLLEXPORT GLRtnCode GL_regnsearch_state_free(const char *java_class_path,
+                                                GLRgnSrchState *state,
+                                                char *error_message,
+                                                int error_message_length);
+
+
 /*
  * GL_spectrum_counts_alloc
  *
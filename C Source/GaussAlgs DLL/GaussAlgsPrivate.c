@@ -632,10 +632,8 @@ jobject    specObject;
 jint       firstChan;
 int        i;
 int        nchannels;
-jintArray  specCountsArray;
-#if (! defined(GL_LINUX)) && (! defined(GL_MACOSX))
-jint       *specJintCounts;
-#endif
+jlongArray specCountsArray;
+jlong      *specJlongCounts;
 
 nRefs = 0;
 
@@ -651,7 +649,7 @@ if (NULL == spec_class)
    return(NULL);
    }
 
-mid = (*env)->GetMethodID(env, spec_class, "<init>", "(I[I)V");
+mid = (*env)->GetMethodID(env, spec_class, "<init>", "(I[J)V");
 if (NULL == mid)
    {
    sprintf_s(error_message, error_message_length,
@@ -662,10 +660,10 @@ if (NULL == mid)
 
 nchannels = spectrum->nchannels;
 firstChan = spectrum->firstchannel;
-specCountsArray = (*env)->NewIntArray(env, nchannels);
+specCountsArray = (*env)->NewLongArray(env, nchannels);
 localRefs[nRefs++] = specCountsArray;
 
-if ((specJintCounts = (jint *) calloc(nchannels, sizeof(jint))) == NULL)
+if ((specJlongCounts = (jlong *) calloc(nchannels, sizeof(jlong))) == NULL)
    {
    strcpy_s(error_message, error_message_length,
             "unable to allocate space for spectrum counts\n");
@@ -675,10 +673,11 @@ if ((specJintCounts = (jint *) calloc(nchannels, sizeof(jint))) == NULL)
 
 for (i = 0; i < nchannels; i++)
    {
-   specJintCounts[i] = (int) spectrum->count[i];
+   specJlongCounts[i] = (jlong) spectrum->count[i];
    }
 
-(*env)->SetIntArrayRegion(env, specCountsArray, 0, nchannels, specJintCounts);
+(*env)->SetLongArrayRegion(env, specCountsArray, 0, nchannels,
+                           specJlongCounts);
 
 specObject = (*env)->NewObject(env, spec_class, mid, firstChan,
                                specCountsArray);
@@ -688,9 +687,7 @@ if (NULL == specObject)
              "unable to construct object %s\n", class_buf);
    }
 
-#if (! defined(GL_LINUX)) && (! defined(GL_MACOSX))
-   free(specJintCounts);
-#endif
+free(specJlongCounts);
 
 GAP_delete_local_refs(env, localRefs, nRefs);
 
@@ -20,6 +20,10 @@
 #define GAP_max(a,b) 	(a<b ? b : a)
 #define GAP_min(a,b) 	(a>b ? b : a)
 
+/* largest number of levels in a multi-resolution peak search, as in
+   PeakSearching.java */
+#define GAP_MAX_LEVELS 10
+
 
 /* define strings for all of the java classes */
 #define GAP_CLASS_BUFSIZE 1024
@@ -30,6 +34,7 @@
 #define GAP_CLASS_ECAL "EnergyCalibrating"
 #define GAP_CLASS_EX "EnergyEquation"
 #define GAP_CLASS_FIT "Fit"
+#define GAP_CLASS_FIT_CACHE "FitWarmStartCache"
 #define GAP_CLASS_FIT_IN "FitInputs"
 #define GAP_CLASS_FIT_PARM "FitParameters"
 #define GAP_CLASS_PK "Peak"
@@ -39,6 +44,8 @@
 #define GAP_CLASS_RGN_FIT "RegionFitting"
 #define GAP_CLASS_RGN_SRCH "RegionSearching"
 #define GAP_CLASS_RGN_SRCHPARM "RegionSearchParameters"
+#define GAP_CLASS_RGN_SRCHSTATE "RegionSearchState"
+#define GAP_CLASS_SOLV_STATS "SolverStatistics"
 #define GAP_CLASS_SRCH_PK "SearchPeak"
 #define GAP_CLASS_SPEC "Spectrum"
 #define GAP_CLASS_SUMM "Summary"
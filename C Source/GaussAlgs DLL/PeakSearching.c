@@ -14,9 +14,15 @@
 /* prototypes for private methods */
 static GLRtnCode get_type_c(JNIEnv *env, jobject typej, GLPeakType *typec,
                             char *error_message, int error_message_length);
+static GLRtnCode peak_search(const char *java_class_path,
+                             const GLChanRange *chanrange,
+                             const GLWidthEqn *wx, int threshold, int levels,
+                             const GLSpectrum *spectrum,
+                             GLPeakSearchResults *results, char *error_message,
+                             int error_message_length);
 static GLRtnCode set_cross_correlations(JNIEnv *env, jclass resultsClass,
                                         jobject peakResultsObject,
-                                        int *cross_products, int listlength,
+                                        GLlong *cross_products, int listlength,
                                         char *error_message,
                                         int error_message_length);
 static GLRtnCode set_peak_list(JNIEnv *env, const jobject peakTreeSet,
@@ -42,142 +48,26 @@ GLRtnCode GL_peaksearch(const char *java_class_path,
                         GLPeakSearchResults *results, char *error_message,
                         int error_message_length)
 {
-JNIEnv      *env = NULL;
-jobject     localRefs[10];
-int         nRefs;
-jobject     jspectrum;
-jobject     jchanrange;
-jobject     jwx;
-jint        jthreshold;
-char        class_buf[GAP_CLASS_BUFSIZE];
-jclass      psClass;
-char        spec_buf[GAP_CLASS_BUFSIZE];
-char        range_buf[GAP_CLASS_BUFSIZE];
-char        wx_buf[GAP_CLASS_BUFSIZE];
-char        rslts_buf[GAP_CLASS_BUFSIZE];
-char        sig_buf[GAP_CLASS_BUFSIZE];
-jmethodID   mid;
-jobject     peakResultsObject;
-jthrowable  exception;
-char        ex_msg_buf[GAP_CLASS_BUFSIZE];
-GLRtnCode   ret_code;
-
-/* construct java format inputs */
-
-env = GAP_get_jvm(java_class_path, error_message, error_message_length);
-if (NULL == env)
-   {
-   return(GL_NOJVM);
-   }
-
-nRefs = 0;
-
-jspectrum = GAP_get_jspectrum(env, spectrum, error_message,
-                              error_message_length);
-localRefs[nRefs++] = jspectrum;
-
-if (NULL == jspectrum)
-   {
-   return(GL_JNIERROR);
-   }
-
-jchanrange = GAP_get_jchannelrange(env, *chanrange, error_message,
-                                   error_message_length);
-localRefs[nRefs++] = jchanrange;
-
-if (NULL == jchanrange)
-   {
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
-   }
-
-jwx = GAP_get_jwidthequation(env, wx, error_message, error_message_length);
-localRefs[nRefs++] = jwx;
-
-if (NULL == jwx)
-   {
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
-   }
-
-jthreshold = threshold;
-
-/* find search method */
-
-sprintf_s(class_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
-          GAP_CLASS_PK_SRCH);
-psClass = (*env)->FindClass(env, class_buf);
-localRefs[nRefs++] = psClass;
-
-if (NULL == psClass)
-   {
-   sprintf_s(error_message, error_message_length,
-             "unable to find class %s\n", class_buf);
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
-   }
-
-sprintf_s(spec_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
-          GAP_CLASS_SPEC);
-sprintf_s(range_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
-          GAP_CLASS_CHNRNG);
-sprintf_s(wx_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
-          GAP_CLASS_WX);
-sprintf_s(rslts_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
-          GAP_CLASS_PK_SRCH_RSLTS);
-sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "(L%s;L%s;L%s;I)L%s;", spec_buf,
-          range_buf, wx_buf, rslts_buf);
-
-mid = (*env)->GetStaticMethodID(env, psClass, "search", sig_buf);
-if (NULL == mid)
-   {
-   sprintf_s(error_message, error_message_length,
-             "unable to find search method in class %s\n", class_buf);
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
-   }
-
-/* search for peaks */
-
-peakResultsObject = (*env)->CallStaticObjectMethod(env, psClass, mid,
-		jspectrum, jchanrange, jwx, jthreshold);
-localRefs[nRefs++] = peakResultsObject;
-
-exception = (*env)->ExceptionOccurred(env);
-localRefs[nRefs++] = exception;
-
-if (NULL != exception)
-   {
-   ret_code = GAP_get_exception_message(env, exception, ex_msg_buf,
-                                        GAP_CLASS_BUFSIZE, error_message,
-                                        error_message_length);
-   if (GL_SUCCESS == ret_code)
-      {
-      sprintf_s(error_message, error_message_length,
-                "PeakSearching.search Exception: %s\n", ex_msg_buf);
-      }
-
-   (*env)->ExceptionClear(env);
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JEXCEPTION);
-   }
+return(peak_search(java_class_path, chanrange, wx, threshold, 0, spectrum,
+                   results, error_message, error_message_length));
+}
 
-if (NULL == peakResultsObject)
+GLRtnCode GL_peaksearch_multires(const char *java_class_path,
+                                 const GLChanRange *chanrange,
+                                 const GLWidthEqn *wx, int threshold,
+                                 int levels, const GLSpectrum *spectrum,
+                                 GLPeakSearchResults *results,
+                                 char *error_message, int error_message_length)
+{
+if ((0 >= levels) || (GAP_MAX_LEVELS < levels))
    {
    sprintf_s(error_message, error_message_length,
-             "search method in class %s returned NULL\n", class_buf);
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
+             "number of levels must be between 1 and %d\n", GAP_MAX_LEVELS);
+   return(GL_FAILURE);
    }
 
-/* copy java results into C */
-
-ret_code = set_peak_results(env, peakResultsObject, results, error_message,
-                            error_message_length);
-
-GAP_delete_local_refs(env, localRefs, nRefs);
-
-return(ret_code);
+return(peak_search(java_class_path, chanrange, wx, threshold, levels,
+                   spectrum, results, error_message, error_message_length));
 }
 
 GLRtnCode GL_prune_rqdpks(const char *java_class_path, const GLWidthEqn *wx,
@@ -350,9 +240,178 @@ GAP_delete_local_refs(env, localRefs, nRefs);
 return(GL_SUCCESS);
 }
 
+static GLRtnCode peak_search(const char *java_class_path,
+                             const GLChanRange *chanrange,
+                             const GLWidthEqn *wx, int threshold, int levels,
+                             const GLSpectrum *spectrum,
+                             GLPeakSearchResults *results, char *error_message,
+                             int error_message_length)
+{
+JNIEnv      *env = NULL;
+jobject     localRefs[10];
+int         nRefs;
+jobject     jspectrum;
+jobject     jchanrange;
+jobject     jwx;
+jint        jthreshold;
+jint        jlevels;
+char        class_buf[GAP_CLASS_BUFSIZE];
+jclass      psClass;
+char        spec_buf[GAP_CLASS_BUFSIZE];
+char        range_buf[GAP_CLASS_BUFSIZE];
+char        wx_buf[GAP_CLASS_BUFSIZE];
+char        rslts_buf[GAP_CLASS_BUFSIZE];
+char        sig_buf[GAP_CLASS_BUFSIZE];
+char        method_name[30];
+jmethodID   mid;
+jobject     peakResultsObject;
+jthrowable  exception;
+char        ex_msg_buf[GAP_CLASS_BUFSIZE];
+GLRtnCode   ret_code;
+
+/* construct java format inputs */
+
+env = GAP_get_jvm(java_class_path, error_message, error_message_length);
+if (NULL == env)
+   {
+   return(GL_NOJVM);
+   }
+
+nRefs = 0;
+
+jspectrum = GAP_get_jspectrum(env, spectrum, error_message,
+                              error_message_length);
+localRefs[nRefs++] = jspectrum;
+
+if (NULL == jspectrum)
+   {
+   return(GL_JNIERROR);
+   }
+
+jchanrange = GAP_get_jchannelrange(env, *chanrange, error_message,
+                                   error_message_length);
+localRefs[nRefs++] = jchanrange;
+
+if (NULL == jchanrange)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+jwx = GAP_get_jwidthequation(env, wx, error_message, error_message_length);
+localRefs[nRefs++] = jwx;
+
+if (NULL == jwx)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+jthreshold = threshold;
+jlevels = levels;
+
+/* find search method */
+
+sprintf_s(class_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
+          GAP_CLASS_PK_SRCH);
+psClass = (*env)->FindClass(env, class_buf);
+localRefs[nRefs++] = psClass;
+
+if (NULL == psClass)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find class %s\n", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+sprintf_s(spec_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
+          GAP_CLASS_SPEC);
+sprintf_s(range_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
+          GAP_CLASS_CHNRNG);
+sprintf_s(wx_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
+          GAP_CLASS_WX);
+sprintf_s(rslts_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
+          GAP_CLASS_PK_SRCH_RSLTS);
+if (0 == levels)
+   {
+   strcpy_s(method_name, 30, "search");
+   sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "(L%s;L%s;L%s;I)L%s;", spec_buf,
+             range_buf, wx_buf, rslts_buf);
+   }
+else
+   {
+   strcpy_s(method_name, 30, "searchMultiResolution");
+   sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "(L%s;L%s;L%s;II)L%s;", spec_buf,
+             range_buf, wx_buf, rslts_buf);
+   }
+
+mid = (*env)->GetStaticMethodID(env, psClass, method_name, sig_buf);
+if (NULL == mid)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find %s method in class %s\n", method_name,
+             class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+/* search for peaks */
+
+if (0 == levels)
+   {
+   peakResultsObject = (*env)->CallStaticObjectMethod(env, psClass, mid,
+         jspectrum, jchanrange, jwx, jthreshold);
+   }
+else
+   {
+   peakResultsObject = (*env)->CallStaticObjectMethod(env, psClass, mid,
+         jspectrum, jchanrange, jwx, jthreshold, jlevels);
+   }
+localRefs[nRefs++] = peakResultsObject;
+
+exception = (*env)->ExceptionOccurred(env);
+localRefs[nRefs++] = exception;
+
+if (NULL != exception)
+   {
+   ret_code = GAP_get_exception_message(env, exception, ex_msg_buf,
+                                        GAP_CLASS_BUFSIZE, error_message,
+                                        error_message_length);
+   if (GL_SUCCESS == ret_code)
+      {
+      sprintf_s(error_message, error_message_length,
+                "PeakSearching.%s Exception: %s\n", method_name,
+                ex_msg_buf);
+      }
+
+   (*env)->ExceptionClear(env);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JEXCEPTION);
+   }
+
+if (NULL == peakResultsObject)
+   {
+   sprintf_s(error_message, error_message_length,
+             "%s method in class %s returned NULL\n", method_name,
+             class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+/* copy java results into C */
+
+ret_code = set_peak_results(env, peakResultsObject, results, error_message,
+                            error_message_length);
+
+GAP_delete_local_refs(env, localRefs, nRefs);
+
+return(ret_code);
+}
+
 static GLRtnCode set_cross_correlations(JNIEnv *env, jclass resultsClass,
                                         jobject peakResultsObject,
-                                        int *cross_products, int listlength,
+                                        GLlong *cross_products, int listlength,
                                         char *error_message,
                                         int error_message_length)
 {
@@ -360,7 +419,7 @@ jobject    localRefs[5];
 int        nRefs;
 char       sig_buf[GAP_CLASS_BUFSIZE];
 jmethodID  midGetPrds;
-jintArray  prdsArray;
+jlongArray prdsArray;
 int        top;
 jsize      prds_count;
 
@@ -368,7 +427,7 @@ nRefs = 0;
 
 /* get Java cross products */
 
-sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "()[I");
+sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "()[J");
 midGetPrds = (*env)->GetMethodID(env, resultsClass, "getCrossProducts",
                                  sig_buf);
 if (NULL == midGetPrds)
@@ -394,7 +453,8 @@ if (NULL == prdsArray)
 prds_count = (*env)->GetArrayLength(env, prdsArray);
 top = GAP_min(listlength, prds_count);
 
-(*env)->GetIntArrayRegion(env, prdsArray, 0, top, cross_products);
+(*env)->GetLongArrayRegion(env, prdsArray, 0, top,
+                           (jlong *) cross_products);
 
 GAP_delete_local_refs(env, localRefs, nRefs);
 
@@ -17,6 +17,15 @@
 static GLFitRecList *alloc_fitreclist_item();
 static void clean_pkfitarray_refs(JNIEnv *env, jobject **objects, int npeaks,
                                   int npoints);
+static GLRtnCode fit_region(const char *java_class_path,
+                            const GLChanRange *region,
+                            const GLSpectrum *spectrum,
+                            const GLPeakList *peaks,
+                            const GLFitParms *fitparms, const GLEnergyEqn *ex,
+                            const GLWidthEqn *wx, const GLlong *background,
+                            const char *detector_id, GLFitCache *cache,
+                            int nplots_per_chan, GLFitRecList **fitlist,
+                            char *error_message, int error_message_length);
 static GLFitRecord *fitrec_alloc();
 static jobject *get_array_from_jvector(JNIEnv *env,
                                        const jobject vector_object,
@@ -28,16 +37,21 @@ static jobject get_jcc_type(JNIEnv *env, GLCCType type, char *error_message,
 static jobject get_jenergyequation(JNIEnv *env, const GLEnergyEqn *ex,
                                    char *error_message,
                                    int error_message_length);
+static jobject get_jfit_cache(JNIEnv *env, GLFitCache *cache,
+                              char *error_message, int error_message_length);
 static jobject get_jfit_inputs(JNIEnv *env, const jobject jspectrum,
                                const jobject jex, const jobject jwx,
                                const jobject jregion, const jobject jpeaks,
-                               const jobject jfitparms, char *error_message,
+                               const jobject jfitparms,
+                               const jobject jbackground, char *error_message,
                                int error_message_length);
 static jobject get_jfitparms(JNIEnv *env, const GLFitParms *fitparms,
                              char *error_message, int error_message_length);
 static jobject get_jpeakwidth_mode(JNIEnv *env, GLPkwdMode mode,
                                    char *error_message,
                                    int error_message_length);
+static GLboolean is_peak_in_region(const GLPeak *peak,
+                                   const GLChanRange *region);
 static GLRtnCode set_background(JNIEnv *env, const jobject jbackground,
                                 GLFitBackLin *back, char *error_message,
                                 int error_message_length);
@@ -66,15 +80,392 @@ static GLRtnCode set_fit_record(JNIEnv *env, const GLChanRange *chanrange,
                                 jmethodID cyc_mid, jmethodID chi_mid,
                                 jmethodID rc_mid, jmethodID except_mid,
                                 jmethodID back_mid, jmethodID sum_mid,
-                                jmethodID curv_mid, const char *peakclass_name,
-                                jmethodID chan_mid, GLFitRecord *fitRecord,
-                                char *error_message, int error_message_length);
+                                jmethodID curv_mid, jmethodID stat_mid,
+                                jmethodID rstat_mid,
+                                const char *peakclass_name, jmethodID chan_mid,
+                                GLFitRecord *fitRecord, char *error_message,
+                                int error_message_length);
+static GLRtnCode set_solver_stats(JNIEnv *env, const jobject jstats,
+                                  GLSolverStats *stats, char *error_message,
+                                  int error_message_length);
 static GLRtnCode set_summary(JNIEnv *env, const jobject jsummary,
                              GLSummary **summary, char *error_message,
                              int error_message_length);
 
 /* public methods */
 
+GLRtnCode GL_fit_cache_free(const char *java_class_path, GLFitCache *cache,
+                            char *error_message, int error_message_length)
+{
+JNIEnv      *env = NULL;
+
+if (NULL == cache)
+   {
+   return(GL_SUCCESS);
+   }
+
+if (NULL != cache->jcache)
+   {
+   env = GAP_get_jvm(java_class_path, error_message, error_message_length);
+   if (NULL == env)
+      {
+      return(GL_NOJVM);
+      }
+
+   (*env)->DeleteGlobalRef(env, (jobject) cache->jcache);
+   cache->jcache = NULL;
+   }
+
+free(cache);
+
+return(GL_SUCCESS);
+}
+
+GLRtnCode GL_fit_spectrum(const char *java_class_path,
+                          const GLRegions *regions,
+                          const GLSpectrum *spectrum,
+                          const GLPeakList *peaks,
+                          const GLFitParms *fitparms, const GLEnergyEqn *ex,
+                          const GLWidthEqn *wx, int nplots_per_chan,
+                          int nthreads, GLFitRecList **fitlists,
+                          char *error_message, int error_message_length)
+{
+JNIEnv       *env;
+jobject      localRefs[20];
+int          nRefs;
+jobject      regionRefs[5];
+int          nRegionRefs;
+jobject      jspectrum;
+jobject      jex;
+jobject      jwx;
+jobject      jfitParms;
+jclass       vector_class;
+jmethodID    add_mid;
+jobject      jinputsVector;
+jobject      jregion;
+jobject      jpeakTreeSet;
+jobject      jfitInputs;
+jboolean     addResult;
+char         class_buf[GAP_CLASS_BUFSIZE];
+jclass       fittingClass;
+jmethodID    mid;
+jobject      fitSpectrumObject;
+jthrowable   exception;
+char         ex_msg_buf[GAP_CLASS_BUFSIZE];
+jobject      *jfitVectors;
+int          array_length;
+GLPeakIndex  *index;
+GLPeakList   *pks_in_rgn;
+int          r;
+GLRtnCode    ret_code;
+
+for (r = 0; r < regions->nregions; r++)
+   {
+   fitlists[r] = NULL;
+   }
+
+if (1 > nthreads)
+   {
+   strcpy_s(error_message, error_message_length,
+            "number of threads must be at least 1\n");
+   return(GL_FAILURE);
+   }
+
+if (0 >= regions->nregions)
+   {
+   return(GL_SUCCESS);
+   }
+
+/* one scratch list serves every region, since a region can hold no more
+   than all of the peaks */
+
+index = GL_peak_index_alloc(peaks);
+if (NULL == index)
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate peak index\n");
+   return(GL_BADMALLOC);
+   }
+
+pks_in_rgn = GL_peaks_alloc((0 < peaks->npeaks) ? peaks->npeaks : 1);
+if (NULL == pks_in_rgn)
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate region peak list\n");
+   GL_peak_index_free(index);
+   return(GL_BADMALLOC);
+   }
+
+/* construct java format inputs; the spectrum, equations and parameters
+   are shared by every region */
+
+env = GAP_get_jvm(java_class_path, error_message, error_message_length);
+if (NULL == env)
+   {
+   GL_peaks_free(pks_in_rgn);
+   GL_peak_index_free(index);
+   return(GL_NOJVM);
+   }
+
+nRefs = 0;
+ret_code = GL_SUCCESS;
+
+jspectrum = GAP_get_jspectrum(env, spectrum, error_message,
+                              error_message_length);
+localRefs[nRefs++] = jspectrum;
+
+jex = NULL;
+if (NULL != jspectrum)
+   {
+   jex = get_jenergyequation(env, ex, error_message, error_message_length);
+   localRefs[nRefs++] = jex;
+   }
+
+jwx = NULL;
+if (NULL != jex)
+   {
+   jwx = GAP_get_jwidthequation(env, wx, error_message, error_message_length);
+   localRefs[nRefs++] = jwx;
+   }
+
+jfitParms = NULL;
+if (NULL != jwx)
+   {
+   jfitParms = get_jfitparms(env, fitparms, error_message,
+                             error_message_length);
+   localRefs[nRefs++] = jfitParms;
+   }
+
+if (NULL == jfitParms)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   GL_peaks_free(pks_in_rgn);
+   GL_peak_index_free(index);
+   return(GL_JNIERROR);
+   }
+
+/* build the Vector<FitInputs>, one entry per region */
+
+vector_class = (*env)->FindClass(env, "java/util/Vector");
+localRefs[nRefs++] = vector_class;
+if (NULL == vector_class)
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to find class java/util/Vector\n");
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   GL_peaks_free(pks_in_rgn);
+   GL_peak_index_free(index);
+   return(GL_JNIERROR);
+   }
+
+jinputsVector = NULL;
+mid = (*env)->GetMethodID(env, vector_class, "<init>", "(I)V");
+add_mid = (*env)->GetMethodID(env, vector_class, "add",
+                              "(Ljava/lang/Object;)Z");
+if ((NULL != mid) && (NULL != add_mid))
+   {
+   jinputsVector = (*env)->NewObject(env, vector_class, mid,
+                                     (jint) regions->nregions);
+   localRefs[nRefs++] = jinputsVector;
+   }
+
+if (NULL == jinputsVector)
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to construct java/util/Vector\n");
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   GL_peaks_free(pks_in_rgn);
+   GL_peak_index_free(index);
+   return(GL_JNIERROR);
+   }
+
+for (r = 0; (r < regions->nregions) && (GL_SUCCESS == ret_code); r++)
+   {
+   ret_code = GL_get_regnpks_indexed(&regions->chanrange[r], peaks, index,
+                                     pks_in_rgn);
+   if (GL_SUCCESS != ret_code)
+      {
+      sprintf_s(error_message, error_message_length,
+                "unable to get the peaks in region %d\n", r);
+      break;
+      }
+
+   nRegionRefs = 0;
+   ret_code = GL_JNIERROR;
+
+   jregion = GAP_get_jchannelrange(env, regions->chanrange[r],
+                                   error_message, error_message_length);
+   regionRefs[nRegionRefs++] = jregion;
+
+   jpeakTreeSet = NULL;
+   if (NULL != jregion)
+      {
+      jpeakTreeSet = GAP_get_jpeaktreeset(env, pks_in_rgn, error_message,
+                                          error_message_length);
+      regionRefs[nRegionRefs++] = jpeakTreeSet;
+      }
+
+   jfitInputs = NULL;
+   if (NULL != jpeakTreeSet)
+      {
+      jfitInputs = get_jfit_inputs(env, jspectrum, jex, jwx, jregion,
+                                   jpeakTreeSet, jfitParms, NULL,
+                                   error_message, error_message_length);
+      regionRefs[nRegionRefs++] = jfitInputs;
+      }
+
+   if (NULL != jfitInputs)
+      {
+      addResult = (*env)->CallBooleanMethod(env, jinputsVector, add_mid,
+                                            jfitInputs);
+      if (JNI_FALSE == addResult)
+         {
+         strcpy_s(error_message, error_message_length,
+                  "unable to add FitInputs to Vector\n");
+         }
+      else
+         {
+         ret_code = GL_SUCCESS;
+         }
+      }
+
+   GAP_delete_local_refs(env, regionRefs, nRegionRefs);
+   }
+
+if (GL_SUCCESS != ret_code)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   GL_peaks_free(pks_in_rgn);
+   GL_peak_index_free(index);
+   return(ret_code);
+   }
+
+/* get the java method */
+
+sprintf_s(class_buf, GAP_CLASS_BUFSIZE, "%s/%s",
+          GAP_CLASS_GA_PKG, GAP_CLASS_RGN_FIT);
+fittingClass = (*env)->FindClass(env, class_buf);
+localRefs[nRefs++] = fittingClass;
+if (NULL == fittingClass)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find class %s", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   GL_peaks_free(pks_in_rgn);
+   GL_peak_index_free(index);
+   return(GL_JNIERROR);
+   }
+
+mid = (*env)->GetStaticMethodID(env, fittingClass, "fitSpectrum",
+                                "(Ljava/util/Vector;I)Ljava/util/Vector;");
+if (NULL == mid)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find fitSpectrum method in class %s\n", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   GL_peaks_free(pks_in_rgn);
+   GL_peak_index_free(index);
+   return(GL_JNIERROR);
+   }
+
+/* fit the regions */
+
+fitSpectrumObject = (*env)->CallStaticObjectMethod(env, fittingClass, mid,
+                                                   jinputsVector,
+                                                   (jint) nthreads);
+localRefs[nRefs++] = fitSpectrumObject;
+
+exception = (*env)->ExceptionOccurred(env);
+localRefs[nRefs++] = exception;
+
+if (NULL != exception)
+   {
+   ret_code = GAP_get_exception_message(env, exception, ex_msg_buf,
+                                        GAP_CLASS_BUFSIZE, error_message,
+                                        error_message_length);
+   if (GL_SUCCESS == ret_code)
+      {
+      sprintf_s(error_message, error_message_length,
+                "fitSpectrum Exception: %s\n", ex_msg_buf);
+      }
+
+   (*env)->ExceptionClear(env);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   GL_peaks_free(pks_in_rgn);
+   GL_peak_index_free(index);
+   return(GL_JEXCEPTION);
+   }
+
+jfitVectors = NULL;
+if (NULL != fitSpectrumObject)
+   {
+   jfitVectors = get_array_from_jvector(env, fitSpectrumObject,
+                                        "java/util/Vector", &array_length,
+                                        error_message, error_message_length);
+   }
+else
+   {
+   sprintf_s(error_message, error_message_length,
+             "fitSpectrum method in class %s returned NULL\n", class_buf);
+   }
+
+if ((NULL != jfitVectors) && (array_length != regions->nregions))
+   {
+   sprintf_s(error_message, error_message_length,
+             "fitSpectrum returned %d fit lists for %d regions\n",
+             array_length, regions->nregions);
+   GAP_free_object_array(env, jfitVectors, array_length);
+   jfitVectors = NULL;
+   }
+
+if (NULL == jfitVectors)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   GL_peaks_free(pks_in_rgn);
+   GL_peak_index_free(index);
+   return(GL_JNIERROR);
+   }
+
+/* decode each region's fit vector into its C fitlist */
+
+for (r = 0; r < regions->nregions; r++)
+   {
+   ret_code = GL_get_regnpks_indexed(&regions->chanrange[r], peaks, index,
+                                     pks_in_rgn);
+   if (GL_SUCCESS == ret_code)
+      {
+      ret_code = set_fit_list(env, &regions->chanrange[r], spectrum,
+                              pks_in_rgn, fitparms, ex, wx, nplots_per_chan,
+                              jfitVectors[r], &fitlists[r], error_message,
+                              error_message_length);
+      }
+
+   if (GL_SUCCESS != ret_code)
+      {
+      break;
+      }
+   }
+
+if (GL_SUCCESS != ret_code)
+   {
+   for (r = 0; r < regions->nregions; r++)
+      {
+      if (NULL != fitlists[r])
+         {
+         GL_fitreclist_free(fitlists[r]);
+         fitlists[r] = NULL;
+         }
+      }
+   }
+
+GAP_free_object_array(env, jfitVectors, array_length);
+GAP_delete_local_refs(env, localRefs, nRefs);
+GL_peaks_free(pks_in_rgn);
+GL_peak_index_free(index);
+
+return(ret_code);
+}
+
 GLRtnCode GL_fitregn(const char *java_class_path, const GLChanRange *region,
                      const GLSpectrum *spectrum, const GLPeakList *peaks,
                      const GLFitParms *fitparms, const GLEnergyEqn *ex,
@@ -82,6 +473,129 @@ GLRtnCode GL_fitregn(const char *java_class_path, const GLChanRange *region,
                      GLFitRecList **fitlist, char *error_message,
                      int error_message_length)
 {
+return(fit_region(java_class_path, region, spectrum, peaks, fitparms, ex, wx,
+                  NULL, NULL, NULL, nplots_per_chan, fitlist, error_message,
+                  error_message_length));
+}
+
+GLRtnCode GL_fitregn_background(const char *java_class_path,
+                                const GLChanRange *region,
+                                const GLSpectrum *spectrum,
+                                const GLPeakList *peaks,
+                                const GLFitParms *fitparms,
+                                const GLEnergyEqn *ex, const GLWidthEqn *wx,
+                                const GLlong *background, int nplots_per_chan,
+                                GLFitRecList **fitlist, char *error_message,
+                                int error_message_length)
+{
+if (NULL == background)
+   {
+   strcpy_s(error_message, error_message_length,
+            "background array is missing\n");
+   return(GL_FAILURE);
+   }
+
+return(fit_region(java_class_path, region, spectrum, peaks, fitparms, ex, wx,
+                  background, NULL, NULL, nplots_per_chan, fitlist,
+                  error_message, error_message_length));
+}
+
+GLRtnCode GL_fitregn_cached(const char *java_class_path,
+                            const char *detector_id,
+                            const GLChanRange *region,
+                            const GLSpectrum *spectrum,
+                            const GLPeakList *peaks,
+                            const GLFitParms *fitparms,
+                            const GLEnergyEqn *ex, const GLWidthEqn *wx,
+                            int nplots_per_chan, GLFitCache *cache,
+                            GLFitRecList **fitlist, char *error_message,
+                            int error_message_length)
+{
+if ((NULL == cache) || (NULL == detector_id))
+   {
+   strcpy_s(error_message, error_message_length,
+            "fit cache or detector ID is missing\n");
+   return(GL_FAILURE);
+   }
+
+return(fit_region(java_class_path, region, spectrum, peaks, fitparms, ex, wx,
+                  NULL, detector_id, cache, nplots_per_chan, fitlist,
+                  error_message, error_message_length));
+}
+
+/* private utilities */
+
+static GLFitRecList *alloc_fitreclist_item()
+{
+GLFitRecList	*fitreclist;
+
+if ((fitreclist = (GLFitRecList *) malloc(sizeof(GLFitRecList))) == NULL)
+   return(NULL);
+
+fitreclist->next = NULL;
+
+if ((fitreclist->record = fitrec_alloc()) == NULL)
+   {
+   free(fitreclist);
+   return(NULL);
+   }
+
+return(fitreclist);
+}
+
+static void clean_pkfitarray_refs(JNIEnv *env, jobject **objects, int npeaks,
+                                  int npoints)
+{
+int  i;
+
+for (i = 0; i < npeaks; i++)
+   {
+   GAP_free_object_array(env, objects[i], npoints);
+   }
+
+free(objects);
+}
+
+GLFitRecord *fitrec_alloc()
+{
+GLFitRecord	*fitrec;
+
+if ((fitrec = (GLFitRecord *) malloc(sizeof(GLFitRecord))) == NULL)
+   return(NULL);
+
+fitrec->used_spectrum.count = NULL;
+fitrec->used_spectrum.listlength = 0;
+fitrec->used_spectrum.nchannels = 0;
+
+fitrec->input_peaks.peak = NULL;
+fitrec->input_peaks.listlength = 0;
+fitrec->input_peaks.npeaks = 0;
+
+fitrec->cycle_exception = NULL;
+fitrec->solver_stats.iterations = 0;
+fitrec->solver_stats.evaluations = 0;
+fitrec->solver_stats.wall_seconds = 0;
+fitrec->solver_stats.cpu_seconds = 0;
+fitrec->region_stats.iterations = 0;
+fitrec->region_stats.evaluations = 0;
+fitrec->region_stats.wall_seconds = 0;
+fitrec->region_stats.cpu_seconds = 0;
+fitrec->summary = NULL;
+fitrec->curve = NULL;
+
+return(fitrec);
+}
+
+static GLRtnCode fit_region(const char *java_class_path,
+                            const GLChanRange *region,
+                            const GLSpectrum *spectrum,
+                            const GLPeakList *peaks,
+                            const GLFitParms *fitparms, const GLEnergyEqn *ex,
+                            const GLWidthEqn *wx, const GLlong *background,
+                            const char *detector_id, GLFitCache *cache,
+                            int nplots_per_chan, GLFitRecList **fitlist,
+                            char *error_message, int error_message_length)
+{
 JNIEnv      *env;
 jobject     localRefs[20];
 int         nRefs;
@@ -91,7 +605,10 @@ jobject     jwx;
 jobject     jregion;
 jobject     jpeakTreeSet;
 jobject     jfitParms;
+jlongArray  jseedBackground;
 jobject     jfitInputs;
+jobject     jcache;
+jstring     jdetectorId;
 char        class_buf[GAP_CLASS_BUFSIZE];
 jclass      fittingClass;
 char        inputs_class_buf[GAP_CLASS_BUFSIZE];
@@ -165,8 +682,25 @@ if (NULL == jfitParms)
    return(GL_JNIERROR);
    }
 
+jseedBackground = NULL;
+if (NULL != background)
+   {
+   jseedBackground = (*env)->NewLongArray(env, spectrum->nchannels);
+   localRefs[nRefs++] = jseedBackground;
+   if (NULL == jseedBackground)
+      {
+      strcpy_s(error_message, error_message_length,
+               "unable to allocate Java background array\n");
+      GAP_delete_local_refs(env, localRefs, nRefs);
+      return(GL_JNIERROR);
+      }
+   (*env)->SetLongArrayRegion(env, jseedBackground, 0, spectrum->nchannels,
+                              (const jlong *) background);
+   }
+
 jfitInputs = get_jfit_inputs(env, jspectrum, jex, jwx, jregion, jpeakTreeSet,
-                             jfitParms, error_message, error_message_length);
+                             jfitParms, jseedBackground, error_message,
+                             error_message_length);
 localRefs[nRefs++] = jfitInputs;
 if (NULL == jfitInputs)
    {
@@ -174,6 +708,28 @@ if (NULL == jfitInputs)
    return(GL_JNIERROR);
    }
 
+jcache = NULL;
+jdetectorId = NULL;
+if (NULL != cache)
+   {
+   jcache = get_jfit_cache(env, cache, error_message, error_message_length);
+   if (NULL == jcache)
+      {
+      GAP_delete_local_refs(env, localRefs, nRefs);
+      return(GL_JNIERROR);
+      }
+
+   jdetectorId = (*env)->NewStringUTF(env, detector_id);
+   localRefs[nRefs++] = jdetectorId;
+   if (NULL == jdetectorId)
+      {
+      strcpy_s(error_message, error_message_length,
+               "unable to construct Java detector ID string\n");
+      GAP_delete_local_refs(env, localRefs, nRefs);
+      return(GL_JNIERROR);
+      }
+   }
+
 /* get the java method */
 
 sprintf_s(class_buf, GAP_CLASS_BUFSIZE, "%s/%s",
@@ -190,8 +746,17 @@ if (NULL == fittingClass)
 
 sprintf_s(inputs_class_buf, GAP_CLASS_BUFSIZE, "%s/%s",
           GAP_CLASS_GA_PKG, GAP_CLASS_FIT_IN);
-sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "(L%s;)Ljava/util/Vector;",
-          inputs_class_buf);
+if (NULL != jcache)
+   {
+   sprintf_s(sig_buf, GAP_CLASS_BUFSIZE,
+             "(L%s;L%s/%s;Ljava/lang/String;)Ljava/util/Vector;",
+             inputs_class_buf, GAP_CLASS_GA_PKG, GAP_CLASS_FIT_CACHE);
+   }
+else
+   {
+   sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "(L%s;)Ljava/util/Vector;",
+             inputs_class_buf);
+   }
 mid = (*env)->GetStaticMethodID(env, fittingClass, "fitRegion", sig_buf);
 if (NULL == mid)
    {
@@ -203,8 +768,17 @@ if (NULL == mid)
 
 /* fit the region */
 
-fitVectorObject = (*env)->CallStaticObjectMethod(env, fittingClass, mid,
-		                                         jfitInputs);
+if (NULL != jcache)
+   {
+   fitVectorObject = (*env)->CallStaticObjectMethod(env, fittingClass, mid,
+                                                    jfitInputs, jcache,
+                                                    jdetectorId);
+   }
+else
+   {
+   fitVectorObject = (*env)->CallStaticObjectMethod(env, fittingClass, mid,
+                                                    jfitInputs);
+   }
 localRefs[nRefs++] = fitVectorObject;
 
 exception = (*env)->ExceptionOccurred(env);
@@ -245,61 +819,6 @@ GAP_delete_local_refs(env, localRefs, nRefs);
 return(ret_code);
 }
 
-/* private utilities */
-
-static GLFitRecList *alloc_fitreclist_item()
-{
-GLFitRecList	*fitreclist;
-
-if ((fitreclist = (GLFitRecList *) malloc(sizeof(GLFitRecList))) == NULL)
-   return(NULL);
-
-fitreclist->next = NULL;
-
-if ((fitreclist->record = fitrec_alloc()) == NULL)
-   {
-   free(fitreclist);
-   return(NULL);
-   }
-
-return(fitreclist);
-}
-
-static void clean_pkfitarray_refs(JNIEnv *env, jobject **objects, int npeaks,
-                                  int npoints)
-{
-int  i;
-
-for (i = 0; i < npeaks; i++)
-   {
-   GAP_free_object_array(env, objects[i], npoints);
-   }
-
-free(objects);
-}
-
-GLFitRecord *fitrec_alloc()
-{
-GLFitRecord	*fitrec;
-
-if ((fitrec = (GLFitRecord *) malloc(sizeof(GLFitRecord))) == NULL)
-   return(NULL);
-
-fitrec->used_spectrum.count = NULL;
-fitrec->used_spectrum.listlength = 0;
-fitrec->used_spectrum.nchannels = 0;
-
-fitrec->input_peaks.peak = NULL;
-fitrec->input_peaks.listlength = 0;
-fitrec->input_peaks.npeaks = 0;
-
-fitrec->cycle_exception = NULL;
-fitrec->summary = NULL;
-fitrec->curve = NULL;
-
-return(fitrec);
-}
-
 static jobject *get_array_from_jvector(JNIEnv *env,
                                        const jobject vector_object,
                                        const char *class_name,
@@ -576,10 +1095,75 @@ if (NULL == exObject)
 return(exObject);
 }
 
+static jobject get_jfit_cache(JNIEnv *env, GLFitCache *cache,
+                              char *error_message, int error_message_length)
+{
+jobject     localRefs[5];
+int         nRefs;
+char        class_buf[GAP_CLASS_BUFSIZE];
+jclass      cacheClass;
+jmethodID   mid;
+jobject     cacheObject;
+
+/* the Java cache lives as long as the C cache, so hold a global ref */
+
+if (NULL != cache->jcache)
+   {
+   return((jobject) cache->jcache);
+   }
+
+nRefs = 0;
+
+sprintf_s(class_buf, GAP_CLASS_BUFSIZE, "%s/%s",
+          GAP_CLASS_GA_PKG, GAP_CLASS_FIT_CACHE);
+cacheClass = (*env)->FindClass(env, class_buf);
+localRefs[nRefs++] = cacheClass;
+
+if (NULL == cacheClass)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find class %s\n", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(NULL);
+   }
+
+mid = (*env)->GetMethodID(env, cacheClass, "<init>", "()V");
+if (NULL == mid)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find constructor for class %s\n", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(NULL);
+   }
+
+cacheObject = (*env)->NewObject(env, cacheClass, mid);
+localRefs[nRefs++] = cacheObject;
+
+if (NULL == cacheObject)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to construct object %s\n", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(NULL);
+   }
+
+cache->jcache = (*env)->NewGlobalRef(env, cacheObject);
+GAP_delete_local_refs(env, localRefs, nRefs);
+
+if (NULL == cache->jcache)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to keep object %s\n", class_buf);
+   }
+
+return((jobject) cache->jcache);
+}
+
 static jobject get_jfit_inputs(JNIEnv *env, const jobject jspectrum,
                                const jobject jex, const jobject jwx,
                                const jobject jregion, const jobject jpeaks,
-                               const jobject jfitparms, char *error_message,
+                               const jobject jfitparms,
+                               const jobject jbackground, char *error_message,
                                int error_message_length)
 {
 jobject    localRefs[5];
@@ -609,14 +1193,16 @@ if (NULL == inputClass)
 sprintf_s(pk_class_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
           GAP_CLASS_PK);
 sprintf_s(tree_class_buf, GAP_CLASS_BUFSIZE, "java/util/TreeSet");
+/* the background, when given, only seeds the fit's background line */
 sprintf_s(sig_buf, GAP_CLASS_BUFSIZE,
-          "(L%s/%s;L%s/%s;L%s/%s;L%s/%s;L%s;L%s/%s;)V",
+          "(L%s/%s;L%s/%s;L%s/%s;L%s/%s;L%s;L%s/%s;%s)V",
           GAP_CLASS_GA_PKG, GAP_CLASS_SPEC,
           GAP_CLASS_GA_PKG, GAP_CLASS_EX,
           GAP_CLASS_GA_PKG, GAP_CLASS_WX,
           GAP_CLASS_GA_PKG, GAP_CLASS_CHNRNG,
           tree_class_buf,
-          GAP_CLASS_GA_PKG, GAP_CLASS_FIT_PARM);
+          GAP_CLASS_GA_PKG, GAP_CLASS_FIT_PARM,
+          (NULL == jbackground) ? "" : "[J");
 
 mid = (*env)->GetMethodID(env, inputClass, "<init>", sig_buf);
 if (NULL == mid)
@@ -627,8 +1213,16 @@ if (NULL == mid)
    return(NULL);
    }
 
-answer = (*env)->NewObject(env, inputClass, mid, jspectrum, jex, jwx, jregion,
-                           jpeaks, jfitparms);
+if (NULL == jbackground)
+   {
+   answer = (*env)->NewObject(env, inputClass, mid, jspectrum, jex, jwx,
+                              jregion, jpeaks, jfitparms);
+   }
+else
+   {
+   answer = (*env)->NewObject(env, inputClass, mid, jspectrum, jex, jwx,
+                              jregion, jpeaks, jfitparms, jbackground);
+   }
 if (NULL == answer)
    {
    sprintf_s(error_message, error_message_length,
@@ -705,7 +1299,77 @@ if (NULL == parmObject)
    {
    sprintf_s(error_message, error_message_length,
              "unable to construct object %s\n", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(NULL);
+   }
+
+mid = (*env)->GetMethodID(env, parm_class, "setSpeculative", "(Z)V");
+if (NULL == mid)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find setSpeculative method in class %s\n",
+             class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   (*env)->DeleteLocalRef(env, parmObject);
+   return(NULL);
+   }
+(*env)->CallVoidMethod(env, parmObject, mid,
+                       (GL_TRUE == fitparms->speculate) ? JNI_TRUE : JNI_FALSE);
+
+mid = (*env)->GetMethodID(env, parm_class, "setBounded", "(Z)V");
+if (NULL == mid)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find setBounded method in class %s\n",
+             class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   (*env)->DeleteLocalRef(env, parmObject);
+   return(NULL);
+   }
+(*env)->CallVoidMethod(env, parmObject, mid,
+                       (GL_TRUE == fitparms->bounded) ? JNI_TRUE : JNI_FALSE);
+
+mid = (*env)->GetMethodID(env, parm_class, "setVariableProjection", "(Z)V");
+if (NULL == mid)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find setVariableProjection method in class %s\n",
+             class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   (*env)->DeleteLocalRef(env, parmObject);
+   return(NULL);
+   }
+(*env)->CallVoidMethod(env, parmObject, mid,
+                       (GL_TRUE == fitparms->variable_projection) ?
+                       JNI_TRUE : JNI_FALSE);
+
+mid = (*env)->GetMethodID(env, parm_class, "setAdaptiveTolerances", "(Z)V");
+if (NULL == mid)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find setAdaptiveTolerances method in class %s\n",
+             class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   (*env)->DeleteLocalRef(env, parmObject);
+   return(NULL);
+   }
+(*env)->CallVoidMethod(env, parmObject, mid,
+                       (GL_TRUE == fitparms->adaptive_tolerances) ?
+                       JNI_TRUE : JNI_FALSE);
+
+mid = (*env)->GetMethodID(env, parm_class, "setLmderSolver", "(Z)V");
+if (NULL == mid)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find setLmderSolver method in class %s\n",
+             class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   (*env)->DeleteLocalRef(env, parmObject);
+   return(NULL);
    }
+(*env)->CallVoidMethod(env, parmObject, mid,
+                       (GL_TRUE == fitparms->lmder_solver) ?
+                       JNI_TRUE : JNI_FALSE);
 
 GAP_delete_local_refs(env, localRefs, nRefs);
 
@@ -774,6 +1438,22 @@ if (NULL == modeObject)
 return(modeObject);
 }
 
+/* rounds the channel to the nearest channel, as FitInfo does */
+static GLboolean is_peak_in_region(const GLPeak *peak,
+                                   const GLChanRange *region)
+{
+int  rounded_channel;
+
+if (GL_TRUE != peak->channel_valid)
+   return(GL_FALSE);
+
+rounded_channel = (int) floor(peak->channel + 0.5);
+if ((rounded_channel < region->first) || (rounded_channel > region->last))
+   return(GL_FALSE);
+
+return(GL_TRUE);
+}
+
 static GLRtnCode set_background(JNIEnv *env, const jobject jbackground,
                                 GLFitBackLin *back, char *error_message,
                                 int error_message_length)
@@ -1345,6 +2025,8 @@ jmethodID     except_mid;
 jmethodID     back_mid;
 jmethodID     sum_mid;
 jmethodID     curv_mid;
+jmethodID     stat_mid;
+jmethodID     rstat_mid;
 char          peakclass_name[GAP_CLASS_BUFSIZE];
 jclass        peak_class;
 jmethodID     chan_mid;
@@ -1412,9 +2094,16 @@ sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "(I)L%s/%s;", GAP_CLASS_GA_PKG,
           GAP_CLASS_CURVE);
 curv_mid = (*env)->GetMethodID(env, fit_class, "getCurve", sig_buf);
 
+sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "()L%s/%s;", GAP_CLASS_GA_PKG,
+          GAP_CLASS_SOLV_STATS);
+stat_mid = (*env)->GetMethodID(env, fit_class, "getSolverStatistics",
+                               sig_buf);
+rstat_mid = (*env)->GetMethodID(env, fit_class, "getRegionSolverStatistics",
+                                sig_buf);
+
 if ((NULL == cyc_mid) || (NULL == chi_mid) || (NULL == rc_mid) ||
     (NULL == except_mid) || (NULL == back_mid) || (NULL == sum_mid) ||
-    (NULL == curv_mid))
+    (NULL == curv_mid) || (NULL == stat_mid) || (NULL == rstat_mid))
    {
    strcpy_s(error_message, error_message_length,
             "unable to get method of Fit\n");
@@ -1467,8 +2156,9 @@ for (i = 0; i < array_length; i++)
    ret_code = set_fit_record(env, chanrange, spectrum, peaks, fitparms, ex, wx,
                              nplots_per_chan, jfits[i], cyc_mid, chi_mid,
                              rc_mid, except_mid, back_mid, sum_mid, curv_mid,
-                             peakclass_name, chan_mid, curr_record,
-                             error_message, error_message_length);
+                             stat_mid, rstat_mid, peakclass_name, chan_mid,
+                             curr_record, error_message,
+                             error_message_length);
    if (GL_SUCCESS != ret_code)
       {
       GAP_free_object_array(env, jfits, array_length);
@@ -1512,17 +2202,24 @@ static GLRtnCode set_fit_record(JNIEnv *env, const GLChanRange *chanrange,
                                 jmethodID cyc_mid, jmethodID chi_mid,
                                 jmethodID rc_mid, jmethodID except_mid,
                                 jmethodID back_mid, jmethodID sum_mid,
-                                jmethodID curv_mid, const char *peakclass_name,
-                                jmethodID chan_mid, GLFitRecord *fitRecord,
-                                char *error_message, int error_message_length)
+                                jmethodID curv_mid, jmethodID stat_mid,
+                                jmethodID rstat_mid,
+                                const char *peakclass_name, jmethodID chan_mid,
+                                GLFitRecord *fitRecord, char *error_message,
+                                int error_message_length)
 {
 jobject     localRefs[10];
 int         nRefs;
+int         first;
+int         last;
 int         copy_size;
+int         npeaks;
 int         i;
 GLRtnCode   ret_code;
 jobject     jcycleReturnCode;
 jthrowable  jcycleException;
+jobject     jstats;
+jobject     jregionStats;
 jobject     jbackground;
 jobject     jsummary;
 jobject     jcurve;
@@ -1540,6 +2237,11 @@ fitRecord->used_parms.max_resid = fitparms->max_resid;
 fitRecord->used_parms.ncycle = fitparms->ncycle;
 fitRecord->used_parms.nout = fitparms->nout;
 fitRecord->used_parms.pkwd_mode = fitparms->pkwd_mode;
+fitRecord->used_parms.speculate = fitparms->speculate;
+fitRecord->used_parms.bounded = fitparms->bounded;
+fitRecord->used_parms.variable_projection = fitparms->variable_projection;
+fitRecord->used_parms.adaptive_tolerances = fitparms->adaptive_tolerances;
+fitRecord->used_parms.lmder_solver = fitparms->lmder_solver;
 
 fitRecord->used_ex.a = ex->a;
 fitRecord->used_ex.b = ex->b;
@@ -1552,37 +2254,58 @@ fitRecord->used_wx.beta = wx->beta;
 fitRecord->used_wx.chi_sq = wx->chi_sq;
 fitRecord->used_wx.mode = wx->mode;
 
-ret_code = GL_spectrum_counts_alloc(&(fitRecord->used_spectrum),
-                                    spectrum->nchannels);
-if (GL_SUCCESS != ret_code)
+/* keep only the counts in the region; a record of every cycle of every
+   region holding the whole spectrum adds up to megabytes */
+
+first = chanrange->first;
+if (first < spectrum->firstchannel)
+   first = spectrum->firstchannel;
+last = chanrange->last;
+if (last > (spectrum->firstchannel + spectrum->nchannels - 1))
+   last = spectrum->firstchannel + spectrum->nchannels - 1;
+if (first <= last)
    {
-   strcpy_s(error_message, error_message_length,
-            "unable to allocate space for used spectrum in fit record\n");
-   return(ret_code);
+   ret_code = GL_spectrum_counts_alloc(&(fitRecord->used_spectrum),
+                                       last - first + 1);
+   if (GL_SUCCESS != ret_code)
+      {
+      strcpy_s(error_message, error_message_length,
+               "unable to allocate space for used spectrum in fit record\n");
+      return(ret_code);
+      }
+
+   fitRecord->used_spectrum.firstchannel = first;
+   fitRecord->used_spectrum.nchannels = last - first + 1;
+   copy_size = fitRecord->used_spectrum.nchannels * sizeof(GLlong);
+   memcpy_s(fitRecord->used_spectrum.count, copy_size,
+            &(spectrum->count[first - spectrum->firstchannel]), copy_size);
    }
 
-fitRecord->used_spectrum.firstchannel = spectrum->firstchannel;
-fitRecord->used_spectrum.nchannels = spectrum->nchannels;
-#if (! defined(GL_LINUX)) && (! defined(GL_MACOSX))
-copy_size = spectrum->nchannels * sizeof(__int32);
-#else
-copy_size = spectrum->nchannels * sizeof(int);
-#endif
-memcpy_s(fitRecord->used_spectrum.count, copy_size,
-         spectrum->count, copy_size);
+/* keep only the peaks the fit could use, as FitInfo selects them */
 
-fitRecord->input_peaks.peak = (GLPeak *) calloc(peaks->npeaks, sizeof(GLPeak));
-if (NULL == fitRecord->input_peaks.peak)
+npeaks = 0;
+for (i = 0; i < peaks->npeaks; i++)
    {
-   strcpy_s(error_message, error_message_length,
-            "unable to allocate space for input peaks in fit record\n");
-   return(GL_BADMALLOC);
+   if (is_peak_in_region(&(peaks->peak[i]), chanrange))
+      npeaks++;
    }
-fitRecord->input_peaks.listlength = peaks->npeaks;
-fitRecord->input_peaks.npeaks = 0;
-for (i = 0; i < peaks->npeaks; i++)
+
+if (0 < npeaks)
    {
-   GL_add_peak(&(peaks->peak[i]), &(fitRecord->input_peaks));
+   fitRecord->input_peaks.peak = (GLPeak *) calloc(npeaks, sizeof(GLPeak));
+   if (NULL == fitRecord->input_peaks.peak)
+      {
+      strcpy_s(error_message, error_message_length,
+               "unable to allocate space for input peaks in fit record\n");
+      return(GL_BADMALLOC);
+      }
+   fitRecord->input_peaks.listlength = npeaks;
+   fitRecord->input_peaks.npeaks = 0;
+   for (i = 0; i < peaks->npeaks; i++)
+      {
+      if (is_peak_in_region(&(peaks->peak[i]), chanrange))
+         GL_add_peak(&(peaks->peak[i]), &(fitRecord->input_peaks));
+      }
    }
 
 /* set results */
@@ -1638,6 +2361,46 @@ else
       }
    }
 
+/* set the solver statistics */
+
+jstats = (*env)->CallObjectMethod(env, fitObject, stat_mid);
+localRefs[nRefs++] = jstats;
+
+if (NULL == jstats)
+   {
+   strcpy_s(error_message, error_message_length,
+            "Fit.getSolverStatistics returned NULL\n");
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+ret_code = set_solver_stats(env, jstats, &(fitRecord->solver_stats),
+                            error_message, error_message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(ret_code);
+   }
+
+jregionStats = (*env)->CallObjectMethod(env, fitObject, rstat_mid);
+localRefs[nRefs++] = jregionStats;
+
+if (NULL == jregionStats)
+   {
+   strcpy_s(error_message, error_message_length,
+            "Fit.getRegionSolverStatistics returned NULL\n");
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+ret_code = set_solver_stats(env, jregionStats, &(fitRecord->region_stats),
+                            error_message, error_message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(ret_code);
+   }
+
 /* set the background */
 
 jbackground = (*env)->CallObjectMethod(env, fitObject, back_mid);
@@ -1701,6 +2464,57 @@ GAP_delete_local_refs(env, localRefs, nRefs);
 return(ret_code);
 }
 
+static GLRtnCode set_solver_stats(JNIEnv *env, const jobject jstats,
+                                  GLSolverStats *stats, char *error_message,
+                                  int error_message_length)
+{
+jobject    localRefs[5];
+int        nRefs;
+jclass     stats_class;
+jmethodID  iter_mid;
+jmethodID  eval_mid;
+jmethodID  wall_mid;
+jmethodID  cpu_mid;
+
+nRefs = 0;
+
+/* get the solver statistics class */
+
+stats_class = (*env)->GetObjectClass(env, jstats);
+localRefs[nRefs++] = stats_class;
+
+if (NULL == stats_class)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to determine class of SolverStatistics object\n");
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+iter_mid = (*env)->GetMethodID(env, stats_class, "getIterations", "()I");
+eval_mid = (*env)->GetMethodID(env, stats_class, "getEvaluations", "()I");
+wall_mid = (*env)->GetMethodID(env, stats_class, "getWallSeconds", "()D");
+cpu_mid = (*env)->GetMethodID(env, stats_class, "getCpuSeconds", "()D");
+
+if ((NULL == iter_mid) || (NULL == eval_mid) || (NULL == wall_mid) ||
+    (NULL == cpu_mid))
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to get method of SolverStatistics\n");
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+stats->iterations = (*env)->CallIntMethod(env, jstats, iter_mid);
+stats->evaluations = (*env)->CallIntMethod(env, jstats, eval_mid);
+stats->wall_seconds = (*env)->CallDoubleMethod(env, jstats, wall_mid);
+stats->cpu_seconds = (*env)->CallDoubleMethod(env, jstats, cpu_mid);
+
+GAP_delete_local_refs(env, localRefs, nRefs);
+
+return(GL_SUCCESS);
+}
+
 static GLRtnCode set_summary(JNIEnv *env, const jobject jsummary,
                              GLSummary **summary, char *error_message,
                              int error_message_length)
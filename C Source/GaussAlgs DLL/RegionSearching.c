@@ -7,6 +7,7 @@
  */
 
 #include <jni.h>
+#include <stdlib.h>            /* free() */
 #include <string.h>            /* strcpy_s(), strcat_s() */
 #include "GaussAlgsLib.h"
 #include "GaussAlgsPrivate.h"
@@ -20,8 +21,20 @@ static jobject get_jrgn_srch_parms(JNIEnv *env, GLRgnSrchMode mode,
 static jobject get_jrgn_srch_parms_mode(JNIEnv *env, GLRgnSrchMode mode,
                                         char *error_message,
                                         int error_message_length);
+static jobject get_jrgn_srch_state(JNIEnv *env, GLRgnSrchState *state,
+                                   char *error_message,
+                                   int error_message_length);
 static jobject get_jrgn_treeset(JNIEnv *env, const GLRegions *regions,
                                 char *error_message, int error_message_length);
+static GLRtnCode region_search(const char *java_class_path,
+                               const GLChanRange *chanrange,
+                               const GLWidthEqn *wx, double threshold,
+                               int irw, int irch, const GLSpectrum *spectrum,
+                               const GLPeakList *peaks, GLRgnSrchMode mode,
+                               int maxrgnwid, int nthreads,
+                               GLRgnSrchState *state, GLRegions *regions,
+                               GLlong *background, char *error_message,
+                               int error_message_length);
 static GLRtnCode set_regions(JNIEnv *env, jobject regionsTreeObject,
                              GLRegions *regions, char *error_message,
                              int error_message_length);
@@ -110,159 +123,104 @@ GLRtnCode GL_regnsearch(const char *java_class_path,
                         GLRgnSrchMode mode, int maxrgnwid, GLRegions *regions,
                         char *error_message, int error_message_length)
 {
-JNIEnv      *env = NULL;
-jobject     localRefs[10];
-int         nRefs;
-jobject     jspectrum;
-jobject     jchanrange;
-jobject     jwx;
-jobject     jpeaks;
-jobject     jparms;
-char        class_buf[GAP_CLASS_BUFSIZE];
-jclass      rsClass;
-char        spec_buf[GAP_CLASS_BUFSIZE];
-char        range_buf[GAP_CLASS_BUFSIZE];
-char        wx_buf[GAP_CLASS_BUFSIZE];
-char        tree_buf[GAP_CLASS_BUFSIZE];
-char        parm_buf[GAP_CLASS_BUFSIZE];
-char        sig_buf[GAP_CLASS_BUFSIZE];
-jmethodID   mid;
-jobject     jregions;
-jthrowable  exception;
-char        ex_msg_buf[GAP_CLASS_BUFSIZE];
-GLRtnCode   ret_code;
-
-/* construct java format inputs */
-
-env = GAP_get_jvm(java_class_path, error_message, error_message_length);
-if (NULL == env)
-   {
-   return(GL_NOJVM);
-   }
-
-nRefs = 0;
+return(region_search(java_class_path, chanrange, wx, threshold, irw, irch,
+                     spectrum, peaks, mode, maxrgnwid, 0, NULL, regions,
+                     NULL, error_message, error_message_length));
+}
 
-jspectrum = GAP_get_jspectrum(env, spectrum, error_message,
-                              error_message_length);
-localRefs[nRefs++] = jspectrum;
-if (NULL == jspectrum)
+GLRtnCode GL_regnsearch_background(const char *java_class_path,
+                                   const GLChanRange *chanrange,
+                                   const GLWidthEqn *wx, double threshold,
+                                   int irw, int irch,
+                                   const GLSpectrum *spectrum,
+                                   const GLPeakList *peaks,
+                                   GLRgnSrchMode mode, int maxrgnwid,
+                                   GLRegions *regions, GLlong *background,
+                                   char *error_message,
+                                   int error_message_length)
+{
+if (NULL == background)
    {
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
+   strcpy_s(error_message, error_message_length,
+            "background array is missing\n");
+   return(GL_FAILURE);
    }
 
-jchanrange = GAP_get_jchannelrange(env, *chanrange, error_message,
-                                   error_message_length);
-localRefs[nRefs++] = jchanrange;
-if (NULL == jchanrange)
-   {
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
-   }
+return(region_search(java_class_path, chanrange, wx, threshold, irw, irch,
+                     spectrum, peaks, mode, maxrgnwid, 0, NULL, regions,
+                     background, error_message, error_message_length));
+}
 
-jwx = GAP_get_jwidthequation(env, wx, error_message, error_message_length);
-localRefs[nRefs++] = jwx;
-if (NULL == jwx)
+GLRtnCode GL_regnsearch_incremental(const char *java_class_path,
+                                    const GLChanRange *chanrange,
+                                    const GLWidthEqn *wx, double threshold,
+                                    int irw, int irch,
+                                    const GLSpectrum *spectrum,
+                                    const GLPeakList *peaks,
+                                    GLRgnSrchMode mode, int maxrgnwid,
+                                    GLRgnSrchState *state, GLRegions *regions,
+                                    char *error_message,
+                                    int error_message_length)
+{
+if (NULL == state)
    {
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
+   strcpy_s(error_message, error_message_length,
+            "region search state is missing\n");
+   return(GL_FAILURE);
    }
 
-jpeaks = GAP_get_jpeaktreeset(env, peaks, error_message, error_message_length);
-localRefs[nRefs++] = jpeaks;
-if (NULL == jpeaks)
-   {
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
-   }
+return(region_search(java_class_path, chanrange, wx, threshold, irw, irch,
+                     spectrum, peaks, mode, maxrgnwid, 0, state, regions,
+                     NULL, error_message, error_message_length));
+}
 
-jparms = get_jrgn_srch_parms(env, mode, threshold, irw, irch, maxrgnwid,
-                             regions->listlength, error_message,
-                             error_message_length);
-localRefs[nRefs++] = jparms;
-if (NULL == jparms)
+GLRtnCode GL_regnsearch_parallel(const char *java_class_path,
+                                 const GLChanRange *chanrange,
+                                 const GLWidthEqn *wx, double threshold,
+                                 int irw, int irch, const GLSpectrum *spectrum,
+                                 const GLPeakList *peaks, GLRgnSrchMode mode,
+                                 int maxrgnwid, int nthreads,
+                                 GLRegions *regions, char *error_message,
+                                 int error_message_length)
+{
+if (0 >= nthreads)
    {
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
+   strcpy_s(error_message, error_message_length,
+            "number of threads must be positive\n");
+   return(GL_FAILURE);
    }
 
-/* find search method */
-
-sprintf_s(class_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
-          GAP_CLASS_RGN_SRCH);
-rsClass = (*env)->FindClass(env, class_buf);
-localRefs[nRefs++] = rsClass;
-
-if (NULL == rsClass)
-   {
-   sprintf_s(error_message, error_message_length,
-             "unable to find class %s", class_buf);
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
-   }
+return(region_search(java_class_path, chanrange, wx, threshold, irw, irch,
+                     spectrum, peaks, mode, maxrgnwid, nthreads, NULL,
+                     regions, NULL, error_message, error_message_length));
+}
 
-sprintf_s(spec_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
-          GAP_CLASS_SPEC);
-sprintf_s(range_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
-          GAP_CLASS_CHNRNG);
-sprintf_s(wx_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
-          GAP_CLASS_WX);
-sprintf_s(tree_buf, GAP_CLASS_BUFSIZE, "java/util/TreeSet");
-sprintf_s(parm_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
-          GAP_CLASS_RGN_SRCHPARM);
-sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "(L%s;L%s;L%s;L%s;L%s;)L%s;", spec_buf,
-          range_buf, wx_buf, tree_buf, parm_buf, tree_buf);
+GLRtnCode GL_regnsearch_state_free(const char *java_class_path,
+                                   GLRgnSrchState *state, char *error_message,
+                                   int error_message_length)
+{
+JNIEnv      *env = NULL;
 
-mid = (*env)->GetStaticMethodID(env, rsClass, "search", sig_buf);
-if (NULL == mid)
+if (NULL == state)
    {
-   sprintf_s(error_message, error_message_length,
-             "unable to find search method in class %s\n", class_buf);
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
+   return(GL_SUCCESS);
    }
 
-/* search for regions */
-
-jregions = (*env)->CallStaticObjectMethod(env, rsClass, mid,
-		jspectrum, jchanrange, jwx, jpeaks, jparms);
-localRefs[nRefs++] = jregions;
-
-exception = (*env)->ExceptionOccurred(env);
-localRefs[nRefs++] = exception;
-
-if (NULL != exception)
+if (NULL != state->jstate)
    {
-   ret_code = GAP_get_exception_message(env, exception, ex_msg_buf,
-                                        GAP_CLASS_BUFSIZE, error_message,
-                                        error_message_length);
-   if (GL_SUCCESS == ret_code)
+   env = GAP_get_jvm(java_class_path, error_message, error_message_length);
+   if (NULL == env)
       {
-      sprintf_s(error_message, error_message_length,
-                "region search Exception: %s\n", ex_msg_buf);
+      return(GL_NOJVM);
       }
 
-   (*env)->ExceptionClear(env);
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JEXCEPTION);
+   (*env)->DeleteGlobalRef(env, (jobject) state->jstate);
+   state->jstate = NULL;
    }
 
-if (NULL == jregions)
-   {
-   sprintf_s(error_message, error_message_length,
-             "search method in class %s returned NULL\n", class_buf);
-   GAP_delete_local_refs(env, localRefs, nRefs);
-   return(GL_JNIERROR);
-   }
-
-/* decode java region treeset into a region list */
-
-ret_code = set_regions(env, jregions, regions, error_message,
-                       error_message_length);
-
-GAP_delete_local_refs(env, localRefs, nRefs);
+free(state);
 
-return(ret_code);
+return(GL_SUCCESS);
 }
 
 static jobject get_jrgn_srch_parms(JNIEnv *env, GLRgnSrchMode mode,
@@ -390,6 +348,71 @@ if (NULL == modeObject)
 return(modeObject);
 }
 
+static jobject get_jrgn_srch_state(JNIEnv *env, GLRgnSrchState *state,
+                                   char *error_message,
+                                   int error_message_length)
+{
+jobject     localRefs[5];
+int         nRefs;
+char        class_buf[GAP_CLASS_BUFSIZE];
+jclass      stateClass;
+jmethodID   mid;
+jobject     stateObject;
+
+/* the Java state lives as long as the C state, so hold a global ref */
+
+if (NULL != state->jstate)
+   {
+   return((jobject) state->jstate);
+   }
+
+nRefs = 0;
+
+sprintf_s(class_buf, GAP_CLASS_BUFSIZE, "%s/%s",
+          GAP_CLASS_GA_PKG, GAP_CLASS_RGN_SRCHSTATE);
+stateClass = (*env)->FindClass(env, class_buf);
+localRefs[nRefs++] = stateClass;
+
+if (NULL == stateClass)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find class %s\n", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(NULL);
+   }
+
+mid = (*env)->GetMethodID(env, stateClass, "<init>", "()V");
+if (NULL == mid)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find constructor for class %s\n", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(NULL);
+   }
+
+stateObject = (*env)->NewObject(env, stateClass, mid);
+localRefs[nRefs++] = stateObject;
+
+if (NULL == stateObject)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to construct object %s\n", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(NULL);
+   }
+
+state->jstate = (*env)->NewGlobalRef(env, stateObject);
+GAP_delete_local_refs(env, localRefs, nRefs);
+
+if (NULL == state->jstate)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to keep object %s\n", class_buf);
+   }
+
+return((jobject) state->jstate);
+}
+
 static jobject get_jrgn_treeset(JNIEnv *env, const GLRegions *regions,
                                 char *error_message, int error_message_length)
 {
@@ -478,6 +501,250 @@ GAP_delete_local_refs(env, localRefs, nRefs);
 return(treeObject);
 }
 
+static GLRtnCode region_search(const char *java_class_path,
+                               const GLChanRange *chanrange,
+                               const GLWidthEqn *wx, double threshold,
+                               int irw, int irch, const GLSpectrum *spectrum,
+                               const GLPeakList *peaks, GLRgnSrchMode mode,
+                               int maxrgnwid, int nthreads,
+                               GLRgnSrchState *state, GLRegions *regions,
+                               GLlong *background, char *error_message,
+                               int error_message_length)
+{
+JNIEnv      *env = NULL;
+jobject     localRefs[10];
+int         nRefs;
+jobject     jspectrum;
+jobject     jchanrange;
+jobject     jwx;
+jobject     jpeaks;
+jobject     jparms;
+char        class_buf[GAP_CLASS_BUFSIZE];
+jclass      rsClass;
+char        spec_buf[GAP_CLASS_BUFSIZE];
+char        range_buf[GAP_CLASS_BUFSIZE];
+char        wx_buf[GAP_CLASS_BUFSIZE];
+char        tree_buf[GAP_CLASS_BUFSIZE];
+char        parm_buf[GAP_CLASS_BUFSIZE];
+char        state_buf[GAP_CLASS_BUFSIZE];
+char        sig_buf[GAP_CLASS_BUFSIZE];
+jmethodID   mid;
+jint        jnthreads;
+jobject     jstate;
+jlongArray  jbackground;
+jobject     jregions;
+jthrowable  exception;
+char        ex_msg_buf[GAP_CLASS_BUFSIZE];
+GLRtnCode   ret_code;
+
+/* construct java format inputs */
+
+env = GAP_get_jvm(java_class_path, error_message, error_message_length);
+if (NULL == env)
+   {
+   return(GL_NOJVM);
+   }
+
+nRefs = 0;
+
+jspectrum = GAP_get_jspectrum(env, spectrum, error_message,
+                              error_message_length);
+localRefs[nRefs++] = jspectrum;
+if (NULL == jspectrum)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+jchanrange = GAP_get_jchannelrange(env, *chanrange, error_message,
+                                   error_message_length);
+localRefs[nRefs++] = jchanrange;
+if (NULL == jchanrange)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+jwx = GAP_get_jwidthequation(env, wx, error_message, error_message_length);
+localRefs[nRefs++] = jwx;
+if (NULL == jwx)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+jpeaks = GAP_get_jpeaktreeset(env, peaks, error_message, error_message_length);
+localRefs[nRefs++] = jpeaks;
+if (NULL == jpeaks)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+jparms = get_jrgn_srch_parms(env, mode, threshold, irw, irch, maxrgnwid,
+                             regions->listlength, error_message,
+                             error_message_length);
+localRefs[nRefs++] = jparms;
+if (NULL == jparms)
+   {
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+jstate = NULL;
+if (NULL != state)
+   {
+   jstate = get_jrgn_srch_state(env, state, error_message,
+                                error_message_length);
+   if (NULL == jstate)
+      {
+      GAP_delete_local_refs(env, localRefs, nRefs);
+      return(GL_JNIERROR);
+      }
+   }
+
+jbackground = NULL;
+if (NULL != background)
+   {
+   jbackground = (*env)->NewLongArray(env, spectrum->nchannels);
+   localRefs[nRefs++] = jbackground;
+   if (NULL == jbackground)
+      {
+      strcpy_s(error_message, error_message_length,
+               "unable to allocate Java background array\n");
+      GAP_delete_local_refs(env, localRefs, nRefs);
+      return(GL_JNIERROR);
+      }
+   }
+
+/* find search method */
+
+sprintf_s(class_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
+          GAP_CLASS_RGN_SRCH);
+rsClass = (*env)->FindClass(env, class_buf);
+localRefs[nRefs++] = rsClass;
+
+if (NULL == rsClass)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find class %s", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+sprintf_s(spec_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
+          GAP_CLASS_SPEC);
+sprintf_s(range_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
+          GAP_CLASS_CHNRNG);
+sprintf_s(wx_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
+          GAP_CLASS_WX);
+sprintf_s(tree_buf, GAP_CLASS_BUFSIZE, "java/util/TreeSet");
+sprintf_s(parm_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
+          GAP_CLASS_RGN_SRCHPARM);
+sprintf_s(state_buf, GAP_CLASS_BUFSIZE, "%s/%s", GAP_CLASS_GA_PKG,
+          GAP_CLASS_RGN_SRCHSTATE);
+if (NULL != jstate)
+   {
+   sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "(L%s;L%s;L%s;L%s;L%s;L%s;)L%s;",
+             spec_buf, range_buf, wx_buf, tree_buf, parm_buf, state_buf,
+             tree_buf);
+   mid = (*env)->GetStaticMethodID(env, rsClass, "search", sig_buf);
+   }
+else if (NULL != jbackground)
+   {
+   sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "(L%s;L%s;L%s;L%s;L%s;[J)L%s;",
+             spec_buf, range_buf, wx_buf, tree_buf, parm_buf, tree_buf);
+   mid = (*env)->GetStaticMethodID(env, rsClass, "searchWithBackground",
+                                   sig_buf);
+   }
+else if (0 == nthreads)
+   {
+   sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "(L%s;L%s;L%s;L%s;L%s;)L%s;",
+             spec_buf, range_buf, wx_buf, tree_buf, parm_buf, tree_buf);
+   mid = (*env)->GetStaticMethodID(env, rsClass, "search", sig_buf);
+   }
+else
+   {
+   sprintf_s(sig_buf, GAP_CLASS_BUFSIZE, "(L%s;L%s;L%s;L%s;L%s;I)L%s;",
+             spec_buf, range_buf, wx_buf, tree_buf, parm_buf, tree_buf);
+   mid = (*env)->GetStaticMethodID(env, rsClass, "searchParallel", sig_buf);
+   }
+if (NULL == mid)
+   {
+   sprintf_s(error_message, error_message_length,
+             "unable to find search method in class %s\n", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+/* search for regions */
+
+jnthreads = nthreads;
+if (NULL != jstate)
+   {
+   jregions = (*env)->CallStaticObjectMethod(env, rsClass, mid,
+		   jspectrum, jchanrange, jwx, jpeaks, jparms, jstate);
+   }
+else if (NULL != jbackground)
+   {
+   jregions = (*env)->CallStaticObjectMethod(env, rsClass, mid,
+		   jspectrum, jchanrange, jwx, jpeaks, jparms, jbackground);
+   }
+else if (0 == nthreads)
+   {
+   jregions = (*env)->CallStaticObjectMethod(env, rsClass, mid,
+		   jspectrum, jchanrange, jwx, jpeaks, jparms);
+   }
+else
+   {
+   jregions = (*env)->CallStaticObjectMethod(env, rsClass, mid,
+		   jspectrum, jchanrange, jwx, jpeaks, jparms, jnthreads);
+   }
+localRefs[nRefs++] = jregions;
+
+exception = (*env)->ExceptionOccurred(env);
+localRefs[nRefs++] = exception;
+
+if (NULL != exception)
+   {
+   ret_code = GAP_get_exception_message(env, exception, ex_msg_buf,
+                                        GAP_CLASS_BUFSIZE, error_message,
+                                        error_message_length);
+   if (GL_SUCCESS == ret_code)
+      {
+      sprintf_s(error_message, error_message_length,
+                "region search Exception: %s\n", ex_msg_buf);
+      }
+
+   (*env)->ExceptionClear(env);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JEXCEPTION);
+   }
+
+if (NULL == jregions)
+   {
+   sprintf_s(error_message, error_message_length,
+             "search method in class %s returned NULL\n", class_buf);
+   GAP_delete_local_refs(env, localRefs, nRefs);
+   return(GL_JNIERROR);
+   }
+
+/* decode java region treeset into a region list */
+
+ret_code = set_regions(env, jregions, regions, error_message,
+                       error_message_length);
+
+if ((GL_SUCCESS == ret_code) && (NULL != jbackground))
+   {
+   (*env)->GetLongArrayRegion(env, jbackground, 0, spectrum->nchannels,
+                              (jlong *) background);
+   }
+
+GAP_delete_local_refs(env, localRefs, nRefs);
+
+return(ret_code);
+}
+
 static GLRtnCode set_regions(JNIEnv *env, jobject regionsTreeObject,
                              GLRegions *regions, char *error_message,
                              int error_message_length)
@@ -58,7 +58,10 @@
  *	8	char		start date (DDMMMYY'\0')
  *	4	char		start time (HHMM)
  *	2	short int	channel offset of counts
- *	2	short int	# of channels
+ *	2	unsigned short	# of channels
+ *
+ * The CHN format cannot describe more than 65535 channels; larger
+ * spectra have to be read by other means into a GLSpectrum.
  *
  * layout of counts
  *
@@ -94,7 +97,7 @@ typedef struct
    char		date[SF_CHN_DATE_LEN];	/* null byte to end string is missing */
    char		time[SF_CHN_TIME_LEN];	/* null byte to end string is missing */
    short int	min_chan;
-   short int	nchannels;
+   unsigned short	nchannels;
    } SFChnHeader;
 
 typedef struct
@@ -7,10 +7,16 @@
  *               of the all-Java implementation of Gauss Algorithms
  */
 
+#include <math.h>	/* fabs */
 #include <stdio.h>	/* fprintf */
 #include <stdlib.h>	/* exit */
 #include <string.h> /* strcpy_s */
 #include <GaussAlgsLib.h>
+#if (! defined(GL_LINUX)) && (! defined(GL_MACOSX))
+#include <windows.h>	/* GetTickCount */
+#else
+#include <sys/time.h>	/* gettimeofday */
+#endif
 #include "SpecFileLib.h"
 #include "SFChnFile.h"
 
@@ -29,10 +35,26 @@
 #define UNDEFINED "UNDEFINED"
 
 /* prototypes */
+static GLRtnCode compare_fit_modes(const char *java_class_path,
+                                   const GLRegions *regions,
+                                   const GLSpectrum *spectrum,
+                                   const GLPeakList *peaklist,
+                                   const GLFitParms *parms_a,
+                                   const char *label_a,
+                                   const GLFitParms *parms_b,
+                                   const char *label_b,
+                                   const GLEnergyEqn *ex, const GLWidthEqn *wx,
+                                   double relative_tolerance,
+                                   double channel_tolerance,
+                                   GLboolean must_agree, char *error_message,
+                                   int error_message_length);
 static char *get_boolean_string(GLboolean value);
 static char *get_cc_type_string(GLCCType type);
 static char *get_cycle_return_string(GLCycleReturn cycle_return);
+static GLRegions *get_fit_regions(const GLRegions *regions,
+                                  const GLPeakList *peaklist, int max_npeaks);
 static char *get_pkwd_mode_string(GLPkwdMode mode);
+static double get_wall_seconds(void);
 static SFReturnCode read_spectrum(const char* spec_path, GLSpectrum *spectrum,
                                   GLEnergyEqn *ex, GLWidthEqn *wx,
                                   char *error_message,
@@ -55,6 +77,78 @@ static GLRtnCode test_fit(const char *java_class_path,
                           const GLPeakList *peaklist, const GLFitParms *parms,
                           const GLEnergyEqn *ex, const GLWidthEqn *wx,
                           char *error_message, int error_message_length);
+static GLRtnCode test_fit_adaptive_tolerances(const char *java_class_path,
+                                              const GLRegions *regions,
+                                              const GLSpectrum *spectrum,
+                                              const GLPeakList *peaklist,
+                                              const GLFitParms *parms,
+                                              const GLEnergyEqn *ex,
+                                              const GLWidthEqn *wx,
+                                              char *error_message,
+                                              int error_message_length);
+static GLRtnCode test_fit_background(const char *java_class_path,
+                                     const GLChanRange *fit_region,
+                                     const GLSpectrum *spectrum,
+                                     const GLPeakList *peaklist,
+                                     const GLPeakList *search_peaks,
+                                     const GLFitParms *parms,
+                                     const GLEnergyEqn *ex,
+                                     const GLWidthEqn *wx,
+                                     char *error_message,
+                                     int error_message_length);
+static GLRtnCode test_fit_bounded(const char *java_class_path,
+                                  const GLRegions *regions,
+                                  const GLSpectrum *spectrum,
+                                  const GLPeakList *peaklist,
+                                  const GLFitParms *parms,
+                                  const GLEnergyEqn *ex,
+                                  const GLWidthEqn *wx,
+                                  char *error_message,
+                                  int error_message_length);
+static GLRtnCode test_fit_cached(const char *java_class_path,
+                                 const GLChanRange *fit_region,
+                                 const GLSpectrum *spectrum,
+                                 const GLPeakList *peaklist,
+                                 const GLFitParms *parms,
+                                 const GLEnergyEqn *ex, const GLWidthEqn *wx,
+                                 char *error_message,
+                                 int error_message_length);
+static GLRtnCode test_fit_lmder_solver(const char *java_class_path,
+                                       const GLRegions *regions,
+                                       const GLSpectrum *spectrum,
+                                       const GLPeakList *peaklist,
+                                       const GLFitParms *parms,
+                                       const GLEnergyEqn *ex,
+                                       const GLWidthEqn *wx,
+                                       char *error_message,
+                                       int error_message_length);
+static GLRtnCode test_fit_speculative(const char *java_class_path,
+                                      const GLChanRange *fit_region,
+                                      const GLSpectrum *spectrum,
+                                      const GLPeakList *peaklist,
+                                      const GLFitParms *parms,
+                                      const GLEnergyEqn *ex,
+                                      const GLWidthEqn *wx,
+                                      char *error_message,
+                                      int error_message_length);
+static GLRtnCode test_fit_spectrum(const char *java_class_path,
+                                   const GLRegions *regions,
+                                   const GLSpectrum *spectrum,
+                                   const GLPeakList *peaklist,
+                                   const GLFitParms *parms,
+                                   const GLEnergyEqn *ex,
+                                   const GLWidthEqn *wx, int nthreads,
+                                   char *error_message,
+                                   int error_message_length);
+static GLRtnCode test_fit_variable_projection(const char *java_class_path,
+                                              const GLRegions *regions,
+                                              const GLSpectrum *spectrum,
+                                              const GLPeakList *peaklist,
+                                              const GLFitParms *parms,
+                                              const GLEnergyEqn *ex,
+                                              const GLWidthEqn *wx,
+                                              char *error_message,
+                                              int error_message_length);
 static GLRtnCode test_get_regn_pks(const GLChanRange *region,
                                    const GLPeakList *peaks,
                                    GLPeakList *pks_in_rgn,
@@ -78,11 +172,22 @@ static GLRtnCode test_outside_alarm(const char *java_class_path,
                                     const GLWidthEqn *wx,
                                     char *error_message,
                                     int error_message_length);
+static GLRtnCode test_partition_pks(const GLRegions *regions,
+                                    const GLPeakList *peaks,
+                                    char *error_message,
+                                    int error_message_length);
 static GLRtnCode test_pksrch(const char *java_class_path, const GLWidthEqn *wx,
                              int srch_threshold, const GLSpectrum *spectrum,
                              GLPeakSearchResults *results,
                              const GLEnergyEqn *ex,
                              char *error_message, int error_message_length);
+static GLRtnCode test_pksrch_multires(const char *java_class_path,
+                                      const GLWidthEqn *wx,
+                                      int srch_threshold, int levels,
+                                      const GLSpectrum *spectrum,
+                                      const GLPeakSearchResults *full_results,
+                                      char *error_message,
+                                      int error_message_length);
 static GLRtnCode test_prune_pks(const char *java_class_path,
                                 const GLWidthEqn *wx,
                                 const GLPeakList *searchpks,
@@ -95,6 +200,22 @@ static GLRtnCode test_rgnsrch(const char *java_class_path,
                               const GLPeakList *peaklist, GLRgnSrchMode mode,
                               int maxrgnwid, GLRegions *regions,
                               char *error_message, int error_message_length);
+static GLRtnCode test_rgnsrch_incremental(const char *java_class_path,
+                                          const GLWidthEqn *wx,
+                                          double srch_threshold, int irw,
+                                          int irch,
+                                          const GLSpectrum *spectrum,
+                                          const GLPeakList *peaklist,
+                                          int maxrgnwid, char *error_message,
+                                          int error_message_length);
+static GLRtnCode test_rgnsrch_parallel(const char *java_class_path,
+                                       const GLWidthEqn *wx,
+                                       double srch_threshold, int irw,
+                                       int irch, int nthreads,
+                                       const GLSpectrum *spectrum,
+                                       const GLPeakList *peaklist,
+                                       int maxrgnwid, char *error_message,
+                                       int error_message_length);
 static GLRtnCode test_wcalib(const char *java_class_path, GLWidEqnMode mode,
                              GLboolean weighted, GLWidthEqn *wx,
                              char *error_message, int error_message_length);
@@ -231,6 +352,21 @@ else
    fprintf_s(stdout, "test_pksrch returned success\n\n");
    }
 
+/* test multi-resolution peak searching against the full search */
+
+ret_code = test_pksrch_multires(java_class_path, &wx, pksrch_threshold, 3,
+                                &spectrum, results, message, message_length);
+
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_pksrch_multires error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_pksrch_multires returned success\n\n");
+   }
+
 /* test making sublist of peaks residing in indicated region */
 
 region.first = 1579;
@@ -287,6 +423,36 @@ else
    fprintf_s(stdout, "test_rgnsrch returned success\n\n");
    }
 
+/* test parallel region searching against the serial search */
+
+ret_code = test_rgnsrch_parallel(java_class_path, &wx, rgnsrch_threshold,
+                                 irw, irch, 4, &spectrum, results->peaklist,
+                                 maxrgnwid, message, message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_rgnsrch_parallel error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_rgnsrch_parallel returned success\n\n");
+   }
+
+/* test incremental region searching against the full search */
+
+ret_code = test_rgnsrch_incremental(java_class_path, &wx, rgnsrch_threshold,
+                                    irw, irch, &spectrum, results->peaklist,
+                                    maxrgnwid, message, message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_rgnsrch_incremental error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_rgnsrch_incremental returned success\n\n");
+   }
+
 /* test GL_exceeds_width */
 
 ret_code = test_exceeds_width(java_class_path, regions, maxrgnwid, message,
@@ -313,6 +479,20 @@ else
    fprintf_s(stdout, "test_exceeds_width returned success\n\n");
    }
 
+/* test assigning the search peaks to the found regions */
+
+ret_code = test_partition_pks(regions, results->peaklist, message,
+                              message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_partition_pks error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_partition_pks returned success\n\n");
+   }
+
 /* test Java region fitting */
 
 fit_region.first = 1579;
@@ -327,6 +507,11 @@ fitparms.max_resid = 20;
 fitparms.ncycle = 10;
 fitparms.nout = 1;
 fitparms.pkwd_mode = GL_PKWD_VARIES;
+fitparms.speculate = GL_FALSE;
+fitparms.bounded = GL_FALSE;
+fitparms.variable_projection = GL_FALSE;
+fitparms.adaptive_tolerances = GL_FALSE;
+fitparms.lmder_solver = GL_FALSE;
 
 ret_code = test_fit(java_class_path, &fit_region, &spectrum, fit_peaks,
                     &fitparms, &ex, &wx, message, message_length);
@@ -340,6 +525,111 @@ else
    fprintf_s(stdout, "test_fit returned success\n\n");
    }
 
+/* test seeding the fit background from the region search background */
+
+ret_code = test_fit_background(java_class_path, &fit_region, &spectrum,
+                               fit_peaks, results->peaklist, &fitparms, &ex,
+                               &wx, message, message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_fit_background error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_fit_background returned success\n\n");
+   }
+
+/* test starting a fit from the last fit of the same region */
+
+ret_code = test_fit_cached(java_class_path, &fit_region, &spectrum,
+                           fit_peaks, &fitparms, &ex, &wx, message,
+                           message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_fit_cached error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_fit_cached returned success\n\n");
+   }
+
+/* test fitting every found region, one at a time and on threads */
+
+ret_code = test_fit_spectrum(java_class_path, regions, &spectrum,
+                             results->peaklist, &fitparms, &ex, &wx, 4,
+                             message, message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_fit_spectrum error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_fit_spectrum returned success\n\n");
+   }
+
+/* compare the cycles and evaluations of bounded and unbounded fits */
+
+ret_code = test_fit_bounded(java_class_path, regions, &spectrum,
+                            results->peaklist, &fitparms, &ex, &wx, message,
+                            message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_fit_bounded error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_fit_bounded returned success\n\n");
+   }
+
+/* compare the solver work of variable projection and the full fit */
+
+ret_code = test_fit_variable_projection(java_class_path, regions, &spectrum,
+                                        results->peaklist, &fitparms, &ex,
+                                        &wx, message, message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_fit_variable_projection error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_fit_variable_projection returned success\n\n");
+   }
+
+/* compare the usual and the adaptive tolerance schedules */
+
+ret_code = test_fit_adaptive_tolerances(java_class_path, regions, &spectrum,
+                                        results->peaklist, &fitparms, &ex,
+                                        &wx, message, message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_fit_adaptive_tolerances error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_fit_adaptive_tolerances returned success\n\n");
+   }
+
+/* compare the fits of LmderSolver and of the Commons Math optimizer */
+
+ret_code = test_fit_lmder_solver(java_class_path, regions, &spectrum,
+                                 results->peaklist, &fitparms, &ex, &wx,
+                                 message, message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_fit_lmder_solver error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_fit_lmder_solver returned success\n\n");
+   }
+
 /* test outsidepeak alarm */
 
 fit_region.first = 740;
@@ -388,6 +678,21 @@ else
    fprintf_s(stdout, "test_neg_alarms returned success\n\n");
    }
 
+/* test starting the next fit cycle early, on the same close peaks */
+
+ret_code = test_fit_speculative(java_class_path, &fit_region, &spectrum,
+                                fit_peaks, &fitparms, &ex, &wx, message,
+                                message_length);
+if (GL_SUCCESS != ret_code)
+   {
+   fprintf_s(stdout, "test_fit_speculative error: %s\n", message);
+   exit(-ret_code);
+   }
+else
+   {
+   fprintf_s(stdout, "test_fit_speculative returned success\n\n");
+   }
+
 /* cleanup */
 
 fprintf_s(stdout, "all tests complete\n");
@@ -401,6 +706,218 @@ GL_peaks_free(fit_peaks);
 exit(0);
 }
 
+static GLRtnCode compare_fit_modes(const char *java_class_path,
+                                   const GLRegions *regions,
+                                   const GLSpectrum *spectrum,
+                                   const GLPeakList *peaklist,
+                                   const GLFitParms *parms_a,
+                                   const char *label_a,
+                                   const GLFitParms *parms_b,
+                                   const char *label_b,
+                                   const GLEnergyEqn *ex, const GLWidthEqn *wx,
+                                   double relative_tolerance,
+                                   double channel_tolerance,
+                                   GLboolean must_agree, char *error_message,
+                                   int error_message_length)
+{
+GLRegions        *fit_regions;
+const GLFitParms *mode_parms[2];
+const char       *labels[2];
+GLFitRecList     **lists[2];
+GLSummary        *summary_a;
+GLSummary        *summary_b;
+GLSolverStats    stats;
+double           start;
+double           seconds[2];
+double           sum_chi_sq[2];
+double           difference;
+double           max_area_difference;
+double           max_chi_sq_difference;
+double           max_channel_difference;
+int              iterations[2];
+int              evaluations[2];
+int              nfitted[2];
+int              npeaks;
+int              nwithin;
+int              nchanged;
+int              pass;
+int              mode;
+int              i;
+int              j;
+GLRtnCode        ret_code;
+
+/*
+ * fits the regions with peaks on one thread with 'parms_a' and then with
+ * 'parms_b', and compares the solver work and the best fits. The solver
+ * statistics are those of every cycle of each region fit. The first pass
+ * runs both modes untimed, so that neither is timed on a cold JVM. An
+ * area or chi squared differs if it is off by more than
+ * 'relative_tolerance' of the 'parms_a' value, a centroid if it moves more
+ * than 'channel_tolerance' channels; when 'must_agree' is GL_TRUE, a
+ * difference, or a region that found other peaks, is a failure.
+ */
+
+mode_parms[0] = parms_a;
+mode_parms[1] = parms_b;
+labels[0] = label_a;
+labels[1] = label_b;
+
+/* only fit the regions that the fit parameters allow */
+
+fit_regions = get_fit_regions(regions, peaklist, parms_a->max_npeaks);
+if (NULL == fit_regions)
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate regions or peaks\n");
+   return(GL_BADMALLOC);
+   }
+
+lists[0] = (GLFitRecList **) calloc(fit_regions->nregions + 1,
+                                    sizeof(GLFitRecList *));
+lists[1] = (GLFitRecList **) calloc(fit_regions->nregions + 1,
+                                    sizeof(GLFitRecList *));
+if ((NULL == lists[0]) || (NULL == lists[1]))
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate fit lists\n");
+   free(lists[0]);
+   free(lists[1]);
+   GL_regions_free(fit_regions);
+   return(GL_BADMALLOC);
+   }
+
+ret_code = GL_SUCCESS;
+for (pass = 0; (pass < 2) && (GL_SUCCESS == ret_code); pass++)
+   {
+   for (mode = 0; (mode < 2) && (GL_SUCCESS == ret_code); mode++)
+      {
+      for (i = 0; i < fit_regions->nregions; i++)
+         {
+         if (NULL != lists[mode][i])
+            GL_fitreclist_free(lists[mode][i]);
+         lists[mode][i] = NULL;
+         }
+
+      start = get_wall_seconds();
+      ret_code = GL_fit_spectrum(java_class_path, fit_regions, spectrum,
+                                 peaklist, mode_parms[mode], ex, wx, 1, 1,
+                                 lists[mode], error_message,
+                                 error_message_length);
+      seconds[mode] = get_wall_seconds() - start;
+      }
+   }
+
+if (GL_SUCCESS == ret_code)
+   {
+   for (mode = 0; mode < 2; mode++)
+      {
+      iterations[mode] = 0;
+      evaluations[mode] = 0;
+      sum_chi_sq[mode] = 0;
+      nfitted[mode] = 0;
+      for (i = 0; i < fit_regions->nregions; i++)
+         {
+         if (NULL == lists[mode][i])
+            continue;
+         GL_fitreclist_solver_stats(lists[mode][i], &stats);
+         iterations[mode] += stats.iterations;
+         evaluations[mode] += stats.evaluations;
+         if (NULL == lists[mode][i]->record->cycle_exception)
+            {
+            sum_chi_sq[mode] += lists[mode][i]->record->chi_sq;
+            nfitted[mode]++;
+            }
+         }
+      }
+
+   /* compare the summaries of the best fits that found the same peaks */
+
+   npeaks = 0;
+   nwithin = 0;
+   nchanged = 0;
+   max_area_difference = 0;
+   max_chi_sq_difference = 0;
+   max_channel_difference = 0;
+   for (i = 0; i < fit_regions->nregions; i++)
+      {
+      if ((NULL == lists[0][i]) || (NULL == lists[1][i]))
+         continue;
+      if ((NULL == lists[0][i]->record->cycle_exception) &&
+          (NULL == lists[1][i]->record->cycle_exception) &&
+          (0 != lists[0][i]->record->chi_sq))
+         {
+         difference = fabs((lists[1][i]->record->chi_sq -
+                            lists[0][i]->record->chi_sq) /
+                           lists[0][i]->record->chi_sq);
+         if (difference > max_chi_sq_difference)
+            max_chi_sq_difference = difference;
+         }
+      summary_a = lists[0][i]->record->summary;
+      summary_b = lists[1][i]->record->summary;
+      if ((NULL == summary_a) || (NULL == summary_b))
+         continue;
+      if (summary_a->npeaks != summary_b->npeaks)
+         {
+         nchanged++;
+         continue;
+         }
+      for (j = 0; j < summary_a->npeaks; j++)
+         {
+         difference = fabs(summary_b->channel[j] - summary_a->channel[j]);
+         if (difference > max_channel_difference)
+            max_channel_difference = difference;
+         if (0 == summary_a->area[j])
+            continue;
+         difference = fabs((summary_b->area[j] - summary_a->area[j]) /
+                           summary_a->area[j]);
+         if (difference > max_area_difference)
+            max_area_difference = difference;
+         if (difference <= relative_tolerance)
+            nwithin++;
+         npeaks++;
+         }
+      }
+
+   fprintf_s(stdout, "fitted %d regions\n", fit_regions->nregions);
+   for (mode = 0; mode < 2; mode++)
+      {
+      fprintf_s(stdout, "%s: %.3f s, %d iterations, %d evaluations, "
+                "%d fits, sum of chi_sq %.3f\n", labels[mode],
+                seconds[mode], iterations[mode], evaluations[mode],
+                nfitted[mode], sum_chi_sq[mode]);
+      }
+   fprintf_s(stdout, "%d of %d peak areas within %.2g, largest "
+             "difference %.2e; largest centroid difference %.2e "
+             "channels; largest chi_sq difference %.2e; %d regions found "
+             "other peaks\n", nwithin, npeaks, relative_tolerance,
+             max_area_difference, max_channel_difference,
+             max_chi_sq_difference, nchanged);
+
+   if ((GL_TRUE == must_agree) &&
+       ((nwithin != npeaks) || (0 != nchanged) ||
+        (max_channel_difference > channel_tolerance) ||
+        (max_chi_sq_difference > relative_tolerance)))
+      {
+      sprintf_s(error_message, error_message_length,
+                "%s fits differ from %s fits\n", label_b, label_a);
+      ret_code = GL_FAILURE;
+      }
+   }
+
+for (mode = 0; mode < 2; mode++)
+   {
+   for (i = 0; i < fit_regions->nregions; i++)
+      {
+      if (NULL != lists[mode][i])
+         GL_fitreclist_free(lists[mode][i]);
+      }
+   free(lists[mode]);
+   }
+GL_regions_free(fit_regions);
+
+return(ret_code);
+}
+
 static char *get_boolean_string(GLboolean value)
 {
 char *answer;
@@ -466,6 +983,41 @@ switch(cycle_return)
 return(answer);
 }
 
+static GLRegions *get_fit_regions(const GLRegions *regions,
+                                  const GLPeakList *peaklist, int max_npeaks)
+{
+GLRegions   *fit_regions;
+GLPeakList  *pks_in_rgn;
+int         i;
+
+/* the regions with peaks that fits with "max_npeaks" allow; NULL if out
+   of memory */
+
+fit_regions = GL_regions_alloc(regions->nregions + 1);
+pks_in_rgn = GL_peaks_alloc(peaklist->npeaks + 1);
+if ((NULL == fit_regions) || (NULL == pks_in_rgn))
+   {
+   if (NULL != fit_regions)
+      GL_regions_free(fit_regions);
+   if (NULL != pks_in_rgn)
+      GL_peaks_free(pks_in_rgn);
+   return(NULL);
+   }
+
+fit_regions->nregions = 0;
+for (i = 0; i < regions->nregions; i++)
+   {
+   GL_get_regnpks(&regions->chanrange[i], peaklist, pks_in_rgn);
+   if ((0 < pks_in_rgn->npeaks) && (max_npeaks >= pks_in_rgn->npeaks))
+      {
+      fit_regions->chanrange[fit_regions->nregions++] = regions->chanrange[i];
+      }
+   }
+GL_peaks_free(pks_in_rgn);
+
+return(fit_regions);
+}
+
 static char *get_pkwd_mode_string(GLPkwdMode mode)
 {
 char *answer;
@@ -486,6 +1038,19 @@ switch(mode)
 return(answer);
 }
 
+static double get_wall_seconds(void)
+{
+#if (! defined(GL_LINUX)) && (! defined(GL_MACOSX))
+return(GetTickCount() / 1000.0);
+#else
+struct timeval  now;
+
+gettimeofday(&now, NULL);
+
+return(now.tv_sec + now.tv_usec / 1.0e6);
+#endif
+}
+
 static SFReturnCode read_spectrum(const char* spec_path, GLSpectrum *spectrum,
                                   GLEnergyEqn *ex, GLWidthEqn *wx,
                                   char *error_message,
@@ -495,6 +1060,8 @@ SFboolean      is_chn;
 SFChnHeader    header;
 SFChnTrailer   trailer;
 SFReturnCode   ret_code;
+int            *chn_counts;
+int            i;
 
 ret_code = SF_chn_file(spec_path, &is_chn, error_message,
                        error_message_length);
@@ -503,19 +1070,44 @@ if (SF_SUCCESS != ret_code)
    return(ret_code);
    }
 
-ret_code = SF_chn_get_counts(spec_path, spectrum->listlength, spectrum->count,
-                             error_message, error_message_length);
+ret_code = SF_chn_get_header(spec_path, &header, error_message,
+                             error_message_length);
 if (SF_SUCCESS != ret_code)
    {
    return(ret_code);
    }
 
-ret_code = SF_chn_get_header(spec_path, &header, error_message,
-                             error_message_length);
+/* CHN files store 32-bit counts; widen them into the 64-bit spectrum */
+
+if (header.nchannels > spectrum->listlength)
+   {
+   sprintf_s(error_message, error_message_length,
+             "%d channels in %s do not fit in a spectrum of %d\n",
+             header.nchannels, spec_path, spectrum->listlength);
+   return(SF_SPACE_ERR);
+   }
+
+if ((chn_counts = (int *) calloc(spectrum->listlength, sizeof(int))) == NULL)
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate space for CHN counts\n");
+   return(SF_MALLOC_ERR);
+   }
+
+ret_code = SF_chn_get_counts(spec_path, spectrum->listlength, chn_counts,
+                             error_message, error_message_length);
 if (SF_SUCCESS != ret_code)
    {
+   free(chn_counts);
    return(ret_code);
    }
+
+for (i = 0; i < header.nchannels; i++)
+   {
+   spectrum->count[i] = (GLlong) chn_counts[i];
+   }
+free(chn_counts);
+
 spectrum->nchannels = header.nchannels;
 spectrum->firstchannel = header.min_chan;
 
@@ -660,6 +1252,7 @@ int           nchannels;
 int           npoints;
 int           i;
 GLFitRecord   *fit_record;
+GLSolverStats totals;
 GLRtnCode     ret_code;
 
 plots_per_chan = 10;
@@ -677,8 +1270,21 @@ if (GL_SUCCESS == ret_code)
              fit_record->cycle_number);
    fprintf_s(stdout, "fit cycle_return code is %s\n",
              get_cycle_return_string(fit_record->cycle_return));
-   fprintf_s(stdout, "fit cycle_exception message is %s\n\n",
+   fprintf_s(stdout, "fit cycle_exception message is %s\n",
              fit_record->cycle_exception);
+   fprintf_s(stdout,
+             "fit solver used %d iterations, %d evaluations, "
+             "%.3f s elapsed, %.3f s cpu\n",
+             fit_record->solver_stats.iterations,
+             fit_record->solver_stats.evaluations,
+             fit_record->solver_stats.wall_seconds,
+             fit_record->solver_stats.cpu_seconds);
+   GL_fitreclist_solver_stats(fitlist, &totals);
+   fprintf_s(stdout,
+             "all cycles of the region used %d iterations, %d evaluations, "
+             "%.3f s elapsed, %.3f s cpu\n\n",
+             totals.iterations, totals.evaluations, totals.wall_seconds,
+             totals.cpu_seconds);
 
    fprintf_s(stdout, "here is the data from the curve\n");
    fprintf_s(stdout, "channel\tcurve\tpeak_1\tpeak2\tbackground\t\n");
@@ -730,17 +1336,27 @@ if (GL_SUCCESS == ret_code)
              fit_record->used_parms.ncycle, fit_record->used_parms.nout,
              fit_record->used_parms.max_npeaks,
              fit_record->used_parms.max_resid);
-   fprintf_s(stdout, "used fitparms: pkwd_mode=%s cc_type=%s\n",
+   fprintf_s(stdout, "used fitparms: pkwd_mode=%s cc_type=%s speculate=%s "
+             "bounded=%s variable_projection=%s "
+             "adaptive_tolerances=%s lmder_solver=%s\n",
              get_pkwd_mode_string(fit_record->used_parms.pkwd_mode),
-             get_cc_type_string(fit_record->used_parms.cc_type));
+             get_cc_type_string(fit_record->used_parms.cc_type),
+             get_boolean_string(fit_record->used_parms.speculate),
+             get_boolean_string(fit_record->used_parms.bounded),
+             get_boolean_string(
+                fit_record->used_parms.variable_projection),
+             get_boolean_string(
+                fit_record->used_parms.adaptive_tolerances),
+             get_boolean_string(fit_record->used_parms.lmder_solver));
    set_ex_string(ex, error_message, error_message_length);
    fprintf_s(stdout, "used ex: %s\n", error_message);
    set_wx_string(wx, error_message, error_message_length);
    fprintf_s(stdout, "used wx: %s\n", error_message);
+   channel = 1600 - fit_record->used_spectrum.firstchannel;
    fprintf_s(stdout,
-             "used spectrum has %d channels, and has %d counts at 1600\n",
+             "used spectrum has %d channels, and has %lld counts at 1600\n",
              fit_record->used_spectrum.nchannels,
-             fit_record->used_spectrum.count[1600]);
+             fit_record->used_spectrum.count[channel]);
    fprintf_s(stdout,
              "there are %d input peaks with first one at channel %.3f\n",
              fit_record->input_peaks.npeaks,
@@ -753,40 +1369,556 @@ if (GL_SUCCESS == ret_code)
 return(ret_code);
 }
 
-static GLRtnCode test_get_regn_pks(const GLChanRange *region,
-                                   const GLPeakList *peaks,
-                                   GLPeakList *pks_in_rgn,
-                                   char *error_message,
-                                   int error_message_length)
+static GLRtnCode test_fit_adaptive_tolerances(const char *java_class_path,
+                                              const GLRegions *regions,
+                                              const GLSpectrum *spectrum,
+                                              const GLPeakList *peaklist,
+                                              const GLFitParms *parms,
+                                              const GLEnergyEqn *ex,
+                                              const GLWidthEqn *wx,
+                                              char *error_message,
+                                              int error_message_length)
 {
-int          npeaks;
-int          i;
-GLRtnCode    ret_code;
+GLFitParms  parms_a;
+GLFitParms  parms_b;
 
-ret_code = GL_get_regnpks(region, peaks, pks_in_rgn);
+/* every cycle is refined with the usual tolerances before peaks are added
+   or deleted, so the regions must find the same peaks */
 
-if (GL_SUCCESS == ret_code)
+parms_a = *parms;
+parms_a.adaptive_tolerances = GL_FALSE;
+parms_b = *parms;
+parms_b.adaptive_tolerances = GL_TRUE;
+
+return(compare_fit_modes(java_class_path, regions, spectrum, peaklist,
+                         &parms_a, "usual tolerances", &parms_b,
+                         "adaptive tolerances", ex, wx, 0.001, 0.01, GL_TRUE,
+                         error_message, error_message_length));
+}
+
+static GLRtnCode test_fit_background(const char *java_class_path,
+                                     const GLChanRange *fit_region,
+                                     const GLSpectrum *spectrum,
+                                     const GLPeakList *peaklist,
+                                     const GLPeakList *search_peaks,
+                                     const GLFitParms *parms,
+                                     const GLEnergyEqn *ex,
+                                     const GLWidthEqn *wx,
+                                     char *error_message,
+                                     int error_message_length)
+{
+GLChanRange   search_range;
+GLRegions     *regions;
+GLlong        *background;
+GLFitRecList  *plain_fitlist;
+GLFitRecList  *seeded_fitlist;
+GLFitRecord   *fit_record;
+GLSolverStats plain_stats;
+GLSolverStats seeded_stats;
+GLRtnCode     ret_code;
+
+search_range.first = spectrum->firstchannel + 20;
+search_range.last = spectrum->firstchannel + spectrum->nchannels - 20;
+
+regions = GL_regions_alloc(spectrum->nchannels);
+background = (GLlong *) calloc(spectrum->nchannels, sizeof(GLlong));
+if ((NULL == regions) || (NULL == background))
    {
-   fprintf_s(stdout, "found these peaks in region %d-->%d:\n",
-             region->first, region->last);
-   npeaks = pks_in_rgn->npeaks;
-   for (i = 0; i < npeaks; i++)
-      {
-      fprintf_s(stdout, "    %.2f\n", pks_in_rgn->peak[i].channel);
-      }
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate regions and background\n");
+   if (NULL != regions)
+      GL_regions_free(regions);
+   if (NULL != background)
+      free(background);
+   return(GL_BADMALLOC);
    }
-else if (GL_OVRLMT == ret_code)
+regions->nregions = 0;
+
+plain_fitlist = NULL;
+seeded_fitlist = NULL;
+
+ret_code = GL_regnsearch_background(java_class_path, &search_range, wx, 2, 3,
+                                    2, spectrum, search_peaks, GL_RGNSRCH_ALL,
+                                    150, regions, background, error_message,
+                                    error_message_length);
+if (GL_SUCCESS == ret_code)
    {
-   sprintf_s(error_message, error_message_length,
-             "not enough space to hold answer");
+   fprintf_s(stdout, "search background at %d-->%d is %lld-->%lld\n",
+             fit_region->first, fit_region->last,
+             background[fit_region->first - spectrum->firstchannel],
+             background[fit_region->last - spectrum->firstchannel]);
+   ret_code = GL_fitregn(java_class_path, fit_region, spectrum, peaklist,
+                         parms, ex, wx, 1, &plain_fitlist, error_message,
+                         error_message_length);
    }
-else
+if (GL_SUCCESS == ret_code)
    {
-   sprintf_s(error_message, error_message_length,
-             "unknown error");
+   ret_code = GL_fitregn_background(java_class_path, fit_region, spectrum,
+                                    peaklist, parms, ex, wx, background, 1,
+                                    &seeded_fitlist, error_message,
+                                    error_message_length);
    }
 
-return(ret_code);
+if (GL_SUCCESS == ret_code)
+   {
+   GL_fitreclist_solver_stats(plain_fitlist, &plain_stats);
+   GL_fitreclist_solver_stats(seeded_fitlist, &seeded_stats);
+
+   fit_record = plain_fitlist->record;
+   fprintf_s(stdout, "default start: cycle %d chisq=%.3f "
+             "b(x) = %.3f + %.3fx, %d evaluations\n",
+             fit_record->cycle_number, fit_record->chi_sq,
+             fit_record->back_linear.intercept,
+             fit_record->back_linear.slope, plain_stats.evaluations);
+   fit_record = seeded_fitlist->record;
+   fprintf_s(stdout, "seeded start:  cycle %d chisq=%.3f "
+             "b(x) = %.3f + %.3fx, %d evaluations\n",
+             fit_record->cycle_number, fit_record->chi_sq,
+             fit_record->back_linear.intercept,
+             fit_record->back_linear.slope, seeded_stats.evaluations);
+   fprintf_s(stdout, "the seeded start saved %d of %d evaluations\n",
+             plain_stats.evaluations - seeded_stats.evaluations,
+             plain_stats.evaluations);
+   }
+
+if (NULL != plain_fitlist)
+   GL_fitreclist_free(plain_fitlist);
+if (NULL != seeded_fitlist)
+   GL_fitreclist_free(seeded_fitlist);
+GL_regions_free(regions);
+free(background);
+
+return(ret_code);
+}
+
+static GLRtnCode test_fit_bounded(const char *java_class_path,
+                                  const GLRegions *regions,
+                                  const GLSpectrum *spectrum,
+                                  const GLPeakList *peaklist,
+                                  const GLFitParms *parms,
+                                  const GLEnergyEqn *ex,
+                                  const GLWidthEqn *wx,
+                                  char *error_message,
+                                  int error_message_length)
+{
+GLFitParms  parms_a;
+GLFitParms  parms_b;
+
+/* the bounds change the path of the solver, so the fits may differ */
+
+parms_a = *parms;
+parms_a.bounded = GL_FALSE;
+parms_b = *parms;
+parms_b.bounded = GL_TRUE;
+
+return(compare_fit_modes(java_class_path, regions, spectrum, peaklist,
+                         &parms_a, "unbounded", &parms_b,
+                         "bounded", ex, wx, 0.001, 0.01, GL_FALSE,
+                         error_message, error_message_length));
+}
+
+static GLRtnCode test_fit_cached(const char *java_class_path,
+                                 const GLChanRange *fit_region,
+                                 const GLSpectrum *spectrum,
+                                 const GLPeakList *peaklist,
+                                 const GLFitParms *parms,
+                                 const GLEnergyEqn *ex, const GLWidthEqn *wx,
+                                 char *error_message,
+                                 int error_message_length)
+{
+GLFitCache    *cache;
+GLFitRecList  *cold_fitlist;
+GLFitRecList  *warm_fitlist;
+GLFitRecord   *fit_record;
+GLRtnCode     ret_code;
+
+cache = GL_fit_cache_alloc();
+if (NULL == cache)
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate fit cache\n");
+   return(GL_BADMALLOC);
+   }
+
+cold_fitlist = NULL;
+warm_fitlist = NULL;
+
+/* the first fit fills the cache, the second starts from it */
+
+ret_code = GL_fitregn_cached(java_class_path, "test detector", fit_region,
+                             spectrum, peaklist, parms, ex, wx, 1, cache,
+                             &cold_fitlist, error_message,
+                             error_message_length);
+if (GL_SUCCESS == ret_code)
+   {
+   ret_code = GL_fitregn_cached(java_class_path, "test detector",
+                                fit_region, spectrum, peaklist, parms, ex,
+                                wx, 1, cache, &warm_fitlist, error_message,
+                                error_message_length);
+   }
+
+if (GL_SUCCESS == ret_code)
+   {
+   fit_record = cold_fitlist->record;
+   fprintf_s(stdout, "cold start: cycle %d chisq=%.3f npeaks=%d\n",
+             fit_record->cycle_number, fit_record->chi_sq,
+             fit_record->summary->npeaks);
+   fit_record = warm_fitlist->record;
+   fprintf_s(stdout, "warm start: cycle %d chisq=%.3f npeaks=%d\n",
+             fit_record->cycle_number, fit_record->chi_sq,
+             fit_record->summary->npeaks);
+   if (fit_record->chi_sq > 1.5 * cold_fitlist->record->chi_sq)
+      {
+      sprintf_s(error_message, error_message_length,
+                "warm start fit is worse than the cold start fit\n");
+      ret_code = GL_FAILURE;
+      }
+   }
+
+if (NULL != cold_fitlist)
+   GL_fitreclist_free(cold_fitlist);
+if (NULL != warm_fitlist)
+   GL_fitreclist_free(warm_fitlist);
+if (GL_SUCCESS == ret_code)
+   {
+   ret_code = GL_fit_cache_free(java_class_path, cache, error_message,
+                                error_message_length);
+   }
+else
+   {
+   GL_fit_cache_free(java_class_path, cache, error_message,
+                     error_message_length);
+   }
+
+return(ret_code);
+}
+
+static GLRtnCode test_fit_lmder_solver(const char *java_class_path,
+                                       const GLRegions *regions,
+                                       const GLSpectrum *spectrum,
+                                       const GLPeakList *peaklist,
+                                       const GLFitParms *parms,
+                                       const GLEnergyEqn *ex,
+                                       const GLWidthEqn *wx,
+                                       char *error_message,
+                                       int error_message_length)
+{
+GLFitParms  parms_a;
+GLFitParms  parms_b;
+
+/* LmderSolver is a port of the Commons Math optimizer, so the fits must
+   agree to well within their uncertainties before it can be the default */
+
+parms_a = *parms;
+parms_a.lmder_solver = GL_FALSE;
+parms_b = *parms;
+parms_b.lmder_solver = GL_TRUE;
+
+return(compare_fit_modes(java_class_path, regions, spectrum, peaklist,
+                         &parms_a, "Commons Math", &parms_b,
+                         "LmderSolver", ex, wx, 1.0e-4, 0.001, GL_TRUE,
+                         error_message, error_message_length));
+}
+
+static GLRtnCode test_fit_speculative(const char *java_class_path,
+                                      const GLChanRange *fit_region,
+                                      const GLSpectrum *spectrum,
+                                      const GLPeakList *peaklist,
+                                      const GLFitParms *parms,
+                                      const GLEnergyEqn *ex,
+                                      const GLWidthEqn *wx,
+                                      char *error_message,
+                                      int error_message_length)
+{
+GLFitParms    all_parms;
+GLFitRecList  *serial_fitlist;
+GLFitRecList  *speculative_fitlist;
+GLFitRecList  *serial_list;
+GLFitRecList  *speculative_list;
+double        start;
+double        serial_seconds;
+double        speculative_seconds;
+int           ncycles;
+GLRtnCode     ret_code;
+
+/* return every cycle, so that all of them can be compared */
+
+all_parms = *parms;
+all_parms.nout = all_parms.ncycle;
+
+serial_fitlist = NULL;
+speculative_fitlist = NULL;
+
+all_parms.speculate = GL_FALSE;
+start = get_wall_seconds();
+ret_code = GL_fitregn(java_class_path, fit_region, spectrum, peaklist,
+                      &all_parms, ex, wx, 1, &serial_fitlist, error_message,
+                      error_message_length);
+serial_seconds = get_wall_seconds() - start;
+
+if (GL_SUCCESS == ret_code)
+   {
+   all_parms.speculate = GL_TRUE;
+   start = get_wall_seconds();
+   ret_code = GL_fitregn(java_class_path, fit_region, spectrum, peaklist,
+                         &all_parms, ex, wx, 1, &speculative_fitlist,
+                         error_message, error_message_length);
+   speculative_seconds = get_wall_seconds() - start;
+   }
+
+if (GL_SUCCESS == ret_code)
+   {
+   ncycles = 0;
+   serial_list = serial_fitlist;
+   speculative_list = speculative_fitlist;
+   while ((NULL != serial_list) && (NULL != speculative_list))
+      {
+      if ((serial_list->record->cycle_number !=
+           speculative_list->record->cycle_number) ||
+          (serial_list->record->chi_sq != speculative_list->record->chi_sq))
+         break;
+      ncycles++;
+      serial_list = serial_list->next;
+      speculative_list = speculative_list->next;
+      }
+
+   fprintf_s(stdout, "%d cycles: serial %.3f s, speculative %.3f s\n",
+             ncycles, serial_seconds, speculative_seconds);
+   if ((NULL != serial_list) || (NULL != speculative_list))
+      {
+      sprintf_s(error_message, error_message_length,
+                "speculative fit differs from serial fit at cycle %d\n",
+                ncycles + 1);
+      ret_code = GL_FAILURE;
+      }
+   }
+
+if (NULL != serial_fitlist)
+   GL_fitreclist_free(serial_fitlist);
+if (NULL != speculative_fitlist)
+   GL_fitreclist_free(speculative_fitlist);
+
+return(ret_code);
+}
+
+static GLRtnCode test_fit_spectrum(const char *java_class_path,
+                                   const GLRegions *regions,
+                                   const GLSpectrum *spectrum,
+                                   const GLPeakList *peaklist,
+                                   const GLFitParms *parms,
+                                   const GLEnergyEqn *ex,
+                                   const GLWidthEqn *wx, int nthreads,
+                                   char *error_message,
+                                   int error_message_length)
+{
+GLRegions     *fit_regions;
+GLPeakList    *pks_in_rgn;
+GLFitRecList  **serial_lists;
+GLFitRecList  **parallel_lists;
+GLFitRecList  *serial_list;
+GLFitRecList  *parallel_list;
+double        start;
+double        serial_seconds;
+double        parallel_seconds;
+int           i;
+int           nmismatch;
+GLRtnCode     ret_code;
+
+/* only fit the regions that the fit parameters allow */
+
+fit_regions = GL_regions_alloc(regions->nregions + 1);
+pks_in_rgn = GL_peaks_alloc(peaklist->npeaks + 1);
+if ((NULL == fit_regions) || (NULL == pks_in_rgn))
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate regions or peaks\n");
+   if (NULL != fit_regions)
+      GL_regions_free(fit_regions);
+   if (NULL != pks_in_rgn)
+      GL_peaks_free(pks_in_rgn);
+   return(GL_BADMALLOC);
+   }
+
+fit_regions->nregions = 0;
+for (i = 0; i < regions->nregions; i++)
+   {
+   GL_get_regnpks(&regions->chanrange[i], peaklist, pks_in_rgn);
+   if ((0 < pks_in_rgn->npeaks) && (parms->max_npeaks >= pks_in_rgn->npeaks))
+      {
+      fit_regions->chanrange[fit_regions->nregions++] = regions->chanrange[i];
+      }
+   }
+
+serial_lists = (GLFitRecList **) calloc(fit_regions->nregions + 1,
+                                        sizeof(GLFitRecList *));
+parallel_lists = (GLFitRecList **) calloc(fit_regions->nregions + 1,
+                                          sizeof(GLFitRecList *));
+if ((NULL == serial_lists) || (NULL == parallel_lists))
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate fit lists\n");
+   free(serial_lists);
+   free(parallel_lists);
+   GL_regions_free(fit_regions);
+   GL_peaks_free(pks_in_rgn);
+   return(GL_BADMALLOC);
+   }
+
+/* an untimed fit first, so that neither timed fit runs on a cold JVM */
+
+ret_code = GL_fit_spectrum(java_class_path, fit_regions, spectrum, peaklist,
+                           parms, ex, wx, 1, nthreads, parallel_lists,
+                           error_message, error_message_length);
+for (i = 0; i < fit_regions->nregions; i++)
+   {
+   if (NULL != parallel_lists[i])
+      GL_fitreclist_free(parallel_lists[i]);
+   parallel_lists[i] = NULL;
+   }
+
+/* one region at a time */
+
+start = get_wall_seconds();
+for (i = 0; (i < fit_regions->nregions) && (GL_SUCCESS == ret_code); i++)
+   {
+   GL_get_regnpks(&fit_regions->chanrange[i], peaklist, pks_in_rgn);
+   ret_code = GL_fitregn(java_class_path, &fit_regions->chanrange[i],
+                         spectrum, pks_in_rgn, parms, ex, wx, 1,
+                         &serial_lists[i], error_message,
+                         error_message_length);
+   }
+serial_seconds = get_wall_seconds() - start;
+
+/* the whole spectrum at once */
+
+if (GL_SUCCESS == ret_code)
+   {
+   start = get_wall_seconds();
+   ret_code = GL_fit_spectrum(java_class_path, fit_regions, spectrum,
+                              peaklist, parms, ex, wx, 1, nthreads,
+                              parallel_lists, error_message,
+                              error_message_length);
+   parallel_seconds = get_wall_seconds() - start;
+   }
+
+if (GL_SUCCESS == ret_code)
+   {
+   fprintf_s(stdout, "fitted %d regions\n", fit_regions->nregions);
+   fprintf_s(stdout, "GL_fitregn: %.3f s, %.1f regions/s\n", serial_seconds,
+             (0.0 < serial_seconds) ?
+             fit_regions->nregions / serial_seconds : 0.0);
+   fprintf_s(stdout, "GL_fit_spectrum, %d threads: %.3f s, %.1f regions/s\n",
+             nthreads, parallel_seconds, (0.0 < parallel_seconds) ?
+             fit_regions->nregions / parallel_seconds : 0.0);
+
+   /* the threads must not change the fits */
+
+   nmismatch = 0;
+   for (i = 0; i < fit_regions->nregions; i++)
+      {
+      serial_list = serial_lists[i];
+      parallel_list = parallel_lists[i];
+      while ((NULL != serial_list) && (NULL != parallel_list))
+         {
+         if (serial_list->record->chi_sq != parallel_list->record->chi_sq)
+            break;
+         serial_list = serial_list->next;
+         parallel_list = parallel_list->next;
+         }
+      if ((NULL != serial_list) || (NULL != parallel_list))
+         {
+         fprintf_s(stdout, "region %d --> %d: fits differ\n",
+                   fit_regions->chanrange[i].first,
+                   fit_regions->chanrange[i].last);
+         nmismatch++;
+         }
+      }
+
+   if (0 != nmismatch)
+      {
+      sprintf_s(error_message, error_message_length,
+                "GL_fit_spectrum differs from GL_fitregn in %d regions\n",
+                nmismatch);
+      ret_code = GL_FAILURE;
+      }
+   }
+
+for (i = 0; i < fit_regions->nregions; i++)
+   {
+   if (NULL != serial_lists[i])
+      GL_fitreclist_free(serial_lists[i]);
+   if (NULL != parallel_lists[i])
+      GL_fitreclist_free(parallel_lists[i]);
+   }
+free(serial_lists);
+free(parallel_lists);
+GL_regions_free(fit_regions);
+GL_peaks_free(pks_in_rgn);
+
+return(ret_code);
+}
+
+static GLRtnCode test_fit_variable_projection(const char *java_class_path,
+                                              const GLRegions *regions,
+                                              const GLSpectrum *spectrum,
+                                              const GLPeakList *peaklist,
+                                              const GLFitParms *parms,
+                                              const GLEnergyEqn *ex,
+                                              const GLWidthEqn *wx,
+                                              char *error_message,
+                                              int error_message_length)
+{
+GLFitParms  parms_a;
+GLFitParms  parms_b;
+
+/* variable projection takes another path to the minimum, so the fits
+   may differ */
+
+parms_a = *parms;
+parms_a.variable_projection = GL_FALSE;
+parms_b = *parms;
+parms_b.variable_projection = GL_TRUE;
+
+return(compare_fit_modes(java_class_path, regions, spectrum, peaklist,
+                         &parms_a, "full", &parms_b,
+                         "variable projection", ex, wx, 0.001, 0.01, GL_FALSE,
+                         error_message, error_message_length));
+}
+
+static GLRtnCode test_get_regn_pks(const GLChanRange *region,
+                                   const GLPeakList *peaks,
+                                   GLPeakList *pks_in_rgn,
+                                   char *error_message,
+                                   int error_message_length)
+{
+int          npeaks;
+int          i;
+GLRtnCode    ret_code;
+
+ret_code = GL_get_regnpks(region, peaks, pks_in_rgn);
+
+if (GL_SUCCESS == ret_code)
+   {
+   fprintf_s(stdout, "found these peaks in region %d-->%d:\n",
+             region->first, region->last);
+   npeaks = pks_in_rgn->npeaks;
+   for (i = 0; i < npeaks; i++)
+      {
+      fprintf_s(stdout, "    %.2f\n", pks_in_rgn->peak[i].channel);
+      }
+   }
+else if (GL_OVRLMT == ret_code)
+   {
+   sprintf_s(error_message, error_message_length,
+             "not enough space to hold answer");
+   }
+else
+   {
+   sprintf_s(error_message, error_message_length,
+             "unknown error");
+   }
+
+return(ret_code);
 }
 
 static GLRtnCode test_neg_alarms(const char *java_class_path,
@@ -900,6 +2032,102 @@ if (GL_SUCCESS == ret_code)
 return(ret_code);
 }
 
+static GLRtnCode test_partition_pks(const GLRegions *regions,
+                                    const GLPeakList *peaks,
+                                    char *error_message,
+                                    int error_message_length)
+{
+GLPeakIndex  *index;
+GLPeakList   **pks_in_rgns;
+GLPeakList   *pks_in_rgn;
+int          r;
+int          i;
+int          nmismatch;
+int          npeaks;
+GLRtnCode    ret_code;
+
+index = GL_peak_index_alloc(peaks);
+pks_in_rgns = (GLPeakList **) calloc(regions->nregions + 1,
+                                     sizeof(GLPeakList *));
+pks_in_rgn = GL_peaks_alloc(peaks->npeaks + 1);
+ret_code = GL_SUCCESS;
+if ((NULL == index) || (NULL == pks_in_rgns) || (NULL == pks_in_rgn))
+   {
+   ret_code = GL_BADMALLOC;
+   }
+for (r = 0; (r < regions->nregions) && (GL_SUCCESS == ret_code); r++)
+   {
+   pks_in_rgns[r] = GL_peaks_alloc(peaks->npeaks + 1);
+   if (NULL == pks_in_rgns[r])
+      ret_code = GL_BADMALLOC;
+   }
+if (GL_SUCCESS != ret_code)
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate peak lists\n");
+   }
+
+/* every region's list must match GL_get_regnpks() */
+
+if (GL_SUCCESS == ret_code)
+   {
+   ret_code = GL_partition_peaks_by_regions(regions, peaks, index,
+                                            pks_in_rgns);
+   }
+
+if (GL_SUCCESS == ret_code)
+   {
+   nmismatch = 0;
+   npeaks = 0;
+   for (r = 0; (r < regions->nregions) && (GL_SUCCESS == ret_code); r++)
+      {
+      ret_code = GL_get_regnpks(&regions->chanrange[r], peaks, pks_in_rgn);
+      if (GL_SUCCESS != ret_code)
+         break;
+
+      npeaks += pks_in_rgns[r]->npeaks;
+      if (pks_in_rgn->npeaks != pks_in_rgns[r]->npeaks)
+         {
+         nmismatch++;
+         continue;
+         }
+      for (i = 0; i < pks_in_rgn->npeaks; i++)
+         {
+         if (pks_in_rgn->peak[i].channel != pks_in_rgns[r]->peak[i].channel)
+            nmismatch++;
+         }
+      }
+
+   if (GL_SUCCESS == ret_code)
+      {
+      fprintf_s(stdout, "%d of %d peaks are in the %d regions\n", npeaks,
+                peaks->npeaks, regions->nregions);
+      if (0 != nmismatch)
+         {
+         sprintf_s(error_message, error_message_length,
+                   "partitioned peaks differ from GL_get_regnpks\n");
+         ret_code = GL_FAILURE;
+         }
+      }
+   }
+
+if (NULL != pks_in_rgns)
+   {
+   for (r = 0; r < regions->nregions; r++)
+      {
+      if (NULL != pks_in_rgns[r])
+         GL_peaks_free(pks_in_rgns[r]);
+      }
+   free(pks_in_rgns);
+   }
+if (NULL != pks_in_rgn)
+   GL_peaks_free(pks_in_rgn);
+if (NULL != index)
+   GL_peak_index_free(index);
+
+return(ret_code);
+}
+
 static GLRtnCode test_pksrch(const char *java_class_path, const GLWidthEqn *wx,
                              int srch_threshold, const GLSpectrum *spectrum,
                              GLPeakSearchResults *results,
@@ -932,21 +2160,21 @@ if (GL_SUCCESS == ret_code)
    fprintf_s(stdout, "here are the cross-correlations:\n");
    for (i = 0; i < results->listlength; )
       {
-      fprintf_s(stdout, "%d,%d  ", i, results->crosscorrs[i]);
+      fprintf_s(stdout, "%d,%lld  ", i, results->crosscorrs[i]);
       i++;
-      fprintf_s(stdout, "%d,%d  ", i, results->crosscorrs[i]);
+      fprintf_s(stdout, "%d,%lld  ", i, results->crosscorrs[i]);
       i++;
-      fprintf_s(stdout, "%d,%d  ", i, results->crosscorrs[i]);
+      fprintf_s(stdout, "%d,%lld  ", i, results->crosscorrs[i]);
       i++;
-      fprintf_s(stdout, "%d,%d  ", i, results->crosscorrs[i]);
+      fprintf_s(stdout, "%d,%lld  ", i, results->crosscorrs[i]);
       i++;
-      fprintf_s(stdout, "%d,%d  ", i, results->crosscorrs[i]);
+      fprintf_s(stdout, "%d,%lld  ", i, results->crosscorrs[i]);
       i++;
-      fprintf_s(stdout, "%d,%d  ", i, results->crosscorrs[i]);
+      fprintf_s(stdout, "%d,%lld  ", i, results->crosscorrs[i]);
       i++;
-      fprintf_s(stdout, "%d,%d  ", i, results->crosscorrs[i]);
+      fprintf_s(stdout, "%d,%lld  ", i, results->crosscorrs[i]);
       i++;
-      fprintf_s(stdout, "%d,%d\n", i, results->crosscorrs[i]);
+      fprintf_s(stdout, "%d,%lld\n", i, results->crosscorrs[i]);
       i++;
       }
 
@@ -968,6 +2196,80 @@ if (GL_SUCCESS == ret_code)
 return(ret_code);
 }
 
+static GLRtnCode test_pksrch_multires(const char *java_class_path,
+                                      const GLWidthEqn *wx,
+                                      int srch_threshold, int levels,
+                                      const GLSpectrum *spectrum,
+                                      const GLPeakSearchResults *full_results,
+                                      char *error_message,
+                                      int error_message_length)
+{
+GLChanRange          search_range;
+GLPeakSearchResults  *results;
+int                  nfound;
+int                  i, j;
+GLRtnCode            ret_code;
+
+search_range.first = spectrum->firstchannel + 20;
+search_range.last = spectrum->firstchannel + spectrum->nchannels - 20;
+
+results = GL_peak_results_alloc(spectrum->nchannels, spectrum->nchannels);
+if (NULL == results)
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate space for peak searching\n");
+   return(GL_BADMALLOC);
+   }
+
+ret_code = GL_peaksearch_multires(java_class_path, &search_range, wx,
+                                  srch_threshold, levels, spectrum, results,
+                                  error_message, error_message_length);
+
+if (GL_SUCCESS == ret_code)
+   {
+   /* count the full search peaks that were also found at multi-res */
+
+   nfound = 0;
+   for (i = 0; i < full_results->peaklist->npeaks; i++)
+      {
+      for (j = 0; j < results->peaklist->npeaks; j++)
+         {
+         if (full_results->refinements[i].raw_channel ==
+             results->refinements[j].raw_channel)
+            {
+            nfound++;
+            break;
+            }
+         }
+      }
+
+   fprintf_s(stdout, "found %d peaks with %d levels\n",
+             results->peaklist->npeaks, levels);
+   fprintf_s(stdout, "recall against full search is %d of %d peaks\n",
+             nfound, full_results->peaklist->npeaks);
+   for (i = 0; i < full_results->peaklist->npeaks; i++)
+      {
+      for (j = 0; j < results->peaklist->npeaks; j++)
+         {
+         if (full_results->refinements[i].raw_channel ==
+             results->refinements[j].raw_channel)
+            {
+            break;
+            }
+         }
+      if (j == results->peaklist->npeaks)
+         {
+         fprintf_s(stdout, "missed peak@%f\n",
+                   full_results->refinements[i].raw_channel);
+         }
+      }
+   }
+
+GL_peak_results_free(results);
+
+return(ret_code);
+}
+
 static GLRtnCode test_prune_pks(const char *java_class_path,
                                 const GLWidthEqn *wx,
                                 const GLPeakList *searchpks,
@@ -1050,6 +2352,200 @@ if (GL_SUCCESS == ret_code)
 return(ret_code);
 }
 
+static GLRtnCode test_rgnsrch_incremental(const char *java_class_path,
+                                          const GLWidthEqn *wx,
+                                          double srch_threshold, int irw,
+                                          int irch,
+                                          const GLSpectrum *spectrum,
+                                          const GLPeakList *peaklist,
+                                          int maxrgnwid, char *error_message,
+                                          int error_message_length)
+{
+GLChanRange     search_range;
+GLPeakList      half_peaklist;
+const GLPeakList *pass_peaklist;
+GLRgnSrchState  *state;
+GLRegions       *full_regions;
+GLRegions       *incr_regions;
+int             i;
+int             pass;
+int             nmismatch;
+char            free_message[256];
+GLRtnCode       ret_code;
+
+search_range.first = spectrum->firstchannel + 20;
+search_range.last = spectrum->firstchannel + spectrum->nchannels - 20;
+
+/* the second pass keeps the spectrum but drops half the peaks */
+
+half_peaklist.npeaks = peaklist->npeaks / 2;
+half_peaklist.peak = peaklist->peak;
+
+state = GL_regnsearch_state_alloc();
+full_regions = GL_regions_alloc(spectrum->nchannels);
+incr_regions = GL_regions_alloc(spectrum->nchannels);
+if ((NULL == state) || (NULL == full_regions) || (NULL == incr_regions))
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate regions\n");
+   if (NULL != state)
+      free(state);
+   if (NULL != full_regions)
+      GL_regions_free(full_regions);
+   if (NULL != incr_regions)
+      GL_regions_free(incr_regions);
+   return(GL_BADMALLOC);
+   }
+
+ret_code = GL_SUCCESS;
+for (pass = 0; (pass < 2) && (GL_SUCCESS == ret_code); pass++)
+   {
+   pass_peaklist = (0 == pass) ? peaklist : &half_peaklist;
+   full_regions->nregions = 0;
+   incr_regions->nregions = 0;
+
+   ret_code = GL_regnsearch(java_class_path, &search_range, wx,
+                            srch_threshold, irw, irch, spectrum,
+                            pass_peaklist, GL_RGNSRCH_ALL, maxrgnwid,
+                            full_regions, error_message,
+                            error_message_length);
+   if (GL_SUCCESS == ret_code)
+      {
+      ret_code = GL_regnsearch_incremental(java_class_path, &search_range,
+                                           wx, srch_threshold, irw, irch,
+                                           spectrum, pass_peaklist,
+                                           GL_RGNSRCH_ALL, maxrgnwid, state,
+                                           incr_regions, error_message,
+                                           error_message_length);
+      }
+
+   if (GL_SUCCESS == ret_code)
+      {
+      nmismatch = 0;
+      if (full_regions->nregions != incr_regions->nregions)
+         {
+         nmismatch++;
+         }
+      for (i = 0; (i < full_regions->nregions) &&
+                  (i < incr_regions->nregions); i++)
+         {
+         if ((full_regions->chanrange[i].first !=
+              incr_regions->chanrange[i].first) ||
+             (full_regions->chanrange[i].last !=
+              incr_regions->chanrange[i].last))
+            {
+            nmismatch++;
+            }
+         }
+
+      fprintf_s(stdout, "pass %d with %d peaks: incremental found %d "
+                "regions, full found %d\n", pass, pass_peaklist->npeaks,
+                incr_regions->nregions, full_regions->nregions);
+      if (0 != nmismatch)
+         {
+         sprintf_s(error_message, error_message_length,
+                   "incremental search differs from full search\n");
+         ret_code = GL_FAILURE;
+         }
+      }
+   }
+
+GL_regnsearch_state_free(java_class_path, state, free_message,
+                         sizeof(free_message));
+GL_regions_free(full_regions);
+GL_regions_free(incr_regions);
+
+return(ret_code);
+}
+
+static GLRtnCode test_rgnsrch_parallel(const char *java_class_path,
+                                       const GLWidthEqn *wx,
+                                       double srch_threshold, int irw,
+                                       int irch, int nthreads,
+                                       const GLSpectrum *spectrum,
+                                       const GLPeakList *peaklist,
+                                       int maxrgnwid, char *error_message,
+                                       int error_message_length)
+{
+GLChanRange  search_range;
+GLRegions    *serial_regions;
+GLRegions    *parallel_regions;
+int          i;
+int          nmismatch;
+GLRtnCode    ret_code;
+
+search_range.first = spectrum->firstchannel + 20;
+search_range.last = spectrum->firstchannel + spectrum->nchannels - 20;
+
+serial_regions = GL_regions_alloc(spectrum->nchannels);
+parallel_regions = GL_regions_alloc(spectrum->nchannels);
+if ((NULL == serial_regions) || (NULL == parallel_regions))
+   {
+   strcpy_s(error_message, error_message_length,
+            "unable to allocate regions\n");
+   if (NULL != serial_regions)
+      GL_regions_free(serial_regions);
+   if (NULL != parallel_regions)
+      GL_regions_free(parallel_regions);
+   return(GL_BADMALLOC);
+   }
+serial_regions->nregions = 0;
+parallel_regions->nregions = 0;
+
+ret_code = GL_regnsearch(java_class_path, &search_range, wx, srch_threshold,
+                         irw, irch, spectrum, peaklist, GL_RGNSRCH_ALL,
+                         maxrgnwid, serial_regions, error_message,
+                         error_message_length);
+if (GL_SUCCESS == ret_code)
+   {
+   ret_code = GL_regnsearch_parallel(java_class_path, &search_range, wx,
+                                     srch_threshold, irw, irch, spectrum,
+                                     peaklist, GL_RGNSRCH_ALL, maxrgnwid,
+                                     nthreads, parallel_regions,
+                                     error_message, error_message_length);
+   }
+
+if (GL_SUCCESS == ret_code)
+   {
+   nmismatch = 0;
+   if (serial_regions->nregions != parallel_regions->nregions)
+      {
+      nmismatch++;
+      }
+   for (i = 0; (i < serial_regions->nregions) &&
+               (i < parallel_regions->nregions); i++)
+      {
+      if ((serial_regions->chanrange[i].first !=
+           parallel_regions->chanrange[i].first) ||
+          (serial_regions->chanrange[i].last !=
+           parallel_regions->chanrange[i].last))
+         {
+         fprintf_s(stdout,
+                   "region %d: serial %d --> %d, parallel %d --> %d\n",
+                   i, serial_regions->chanrange[i].first,
+                   serial_regions->chanrange[i].last,
+                   parallel_regions->chanrange[i].first,
+                   parallel_regions->chanrange[i].last);
+         nmismatch++;
+         }
+      }
+
+   fprintf_s(stdout, "%d threads found %d regions, serial found %d\n",
+             nthreads, parallel_regions->nregions, serial_regions->nregions);
+   if (0 != nmismatch)
+      {
+      sprintf_s(error_message, error_message_length,
+                "parallel search differs from serial search\n");
+      ret_code = GL_FAILURE;
+      }
+   }
+
+GL_regions_free(serial_regions);
+GL_regions_free(parallel_regions);
+
+return(ret_code);
+}
+
 static GLRtnCode test_wcalib(const char *java_class_path, GLWidEqnMode mode,
                              GLboolean weighted, GLWidthEqn *wx,
                              char *error_message, int error_message_length)
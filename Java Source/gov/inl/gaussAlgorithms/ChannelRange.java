@@ -91,6 +91,12 @@ public class ChannelRange implements Comparable<Object> {
 		return workingList;
 	}	
 
+	// same answer without scanning the whole list
+	public TreeSet<Peak> peaksInRange(final PeakIndex peakIndex) {
+
+		return peakIndex.peaksInRange(this);
+	}
+
 	public int getFirstChannel() {
 
 		return m_firstChannel;
@@ -47,15 +47,18 @@ public class Curve {
 		m_peakCurves = new Vector<Vector<Point2D.Double>>();
 		for (Iterator<PeakInfo> it = fitInfo.getPeakIterator();
 			 it.hasNext(); ) {
-			m_peakCurves.add(constructPeakCurve(m_backgroundCurve, it.next()));
+			m_peakCurves.add(constructPeakCurve(m_nPlotsPerChannel,
+					m_backgroundCurve, it.next()));
 		}
 		
 		m_fitCurveAllPlots = constructFitCurve(m_nPlotsPerChannel,
 				m_backgroundCurve, m_peakCurves);
 		
-		m_fitsAtChannels = constructFitsAtChannels(region, fitInfo);
+		double[] fits = calculateFitsAtChannels(region, fitInfo);
+		m_fitsAtChannels = constructChannelPoints(region, fits);
 		
-		m_chanResiduals = constructResiduals(spectrum, m_fitsAtChannels);
+		m_chanResiduals = constructChannelPoints(region,
+				calculateResiduals(spectrum, region, fits));
 	}
 
 	public Vector<Point2D.Double> getBackPoints() {
@@ -153,8 +156,91 @@ public class Curve {
 		return m_chanResiduals;
 	}
 	
+	// package methods
+	
+	/*
+	 * calculateFitsAtChannels - the fit at each channel of "region", the
+	 *                           same values as getFit() without building
+	 *                           the curve
+	 */
+	static double[] calculateFitsAtChannels(ChannelRange region,
+			final FitInfo fitInfo) {
+		
+		int channelCount = region.widthChannels();
+		double intercept = fitInfo.getBckIntercept();
+		double slope = fitInfo.getBckSlope();
+		
+		double[] xs = new double[channelCount];
+		double[] backgrounds = new double[channelCount];
+		double[] fits = new double[channelCount];
+		double x = region.getFirstChannel();
+		for (int i = 0; i < channelCount; i++, x++) {
+			xs[i] = x;
+			backgrounds[i] = intercept + (slope * i);
+			fits[i] = backgrounds[i];
+		}
+		
+		// take background back out of each component, as
+		// constructFitCurve() does; each peak only adds to its window,
+		// as in LmderFcn
+		double[] ys = new double[channelCount];
+		for (Iterator<PeakInfo> it = fitInfo.getPeakIterator();
+			 it.hasNext(); ) {
+			PeakInfo peakInfo = it.next();
+			int first = InlGaussian.windowFirst(region.getFirstChannel(), 1,
+					channelCount, peakInfo.getCentroidChannels(),
+					peakInfo.getFwhm());
+			int last = InlGaussian.windowLast(region.getFirstChannel(), 1,
+					channelCount, peakInfo.getCentroidChannels(),
+					peakInfo.getFwhm());
+			InlGaussian inlGaussian = new InlGaussian(peakInfo);
+			inlGaussian.valuesConstrained(xs, ys, first, last);
+			for (int i = first; i <= last; i++) {
+				fits[i] += (ys[i] + backgrounds[i]) - backgrounds[i];
+			}
+		}
+		
+		return fits;
+	}
+	
+	/*
+	 * calculateResiduals - the weighted residual at each channel of
+	 *                      "region" for "fits" from
+	 *                      calculateFitsAtChannels(), the same values as
+	 *                      getResiduals()
+	 */
+	static double[] calculateResiduals(Spectrum spectrum, ChannelRange region,
+			final double[] fits) {
+		
+		double[] residuals = new double[fits.length];
+		int channel = region.getFirstChannel();
+		for (int i = 0; i < fits.length; i++, channel++) {
+			double count = spectrum.getCountAt(channel);
+			double sigCount = spectrum.getSigCountAt(channel);
+			residuals[i] = 0;
+			if (0 != sigCount) {
+				residuals[i] = (count - fits[i]) / sigCount;
+			}
+		}
+		
+		return residuals;
+	}
+	
 	// private methods
 	
+	private static Vector<Point2D.Double> constructChannelPoints(
+			ChannelRange region, final double[] ys) {
+		
+		Vector<Point2D.Double> points = new Vector<Point2D.Double>();
+		
+		int channel = region.getFirstChannel();
+		for (int i = 0; i < ys.length; i++, channel++) {
+			points.add(new Point2D.Double(channel, ys[i]));
+		}
+		
+		return points;
+	}
+	
 	private static Vector<Point2D.Double> constructFitBackgroundCurve(
 			ChannelRange region, int nPlotsPerChannel, double slope,
 			double intercept) {
@@ -202,26 +288,8 @@ public class Curve {
 		return points;
 	}
 	
-	private static Vector<Point2D.Double> constructFitsAtChannels(
-			ChannelRange region, final FitInfo fitInfo) {
-			
-		Vector<Point2D.Double> backgroundCurve = constructFitBackgroundCurve(
-				region, 1, fitInfo.getBckSlope(), fitInfo.getBckIntercept());
-
-		Vector<Vector<Point2D.Double>> peakCurves =
-				new Vector<Vector<Point2D.Double>>();
-		for (Iterator<PeakInfo> it = fitInfo.getPeakIterator();
-			 it.hasNext(); ) {
-			peakCurves.add(constructPeakCurve(backgroundCurve, it.next()));
-		}
-		
-		Vector<Point2D.Double> fitsAtChannels = constructFitCurve(
-				1, backgroundCurve, peakCurves);
-				
-		return fitsAtChannels;
-	}
-	
 	private static Vector<Point2D.Double> constructPeakCurve(
+			int nPlotsPerChannel,
 			final Vector<Point2D.Double> backgroundPoints,
 			final PeakInfo peakInfo) {
 		
@@ -230,38 +298,29 @@ public class Curve {
 		InlGaussian inlGaussian = new InlGaussian(peakInfo);
 
     	int plotCount = backgroundPoints.size();
+    	double[] xs = new double[plotCount];
     	for (int i = 0; i < plotCount; i++) {
-    		Point2D.Double backgroundPoint = backgroundPoints.get(i);
-    		double x = backgroundPoint.getX();
-    		double y = inlGaussian.valueConstrained(x);
-    		y += backgroundPoint.getY();
-    		points.add(new Point2D.Double(x, y));
+    		xs[i] = backgroundPoints.get(i).getX();
+    	}
+    	
+    	// the peak's window at once, as LmderFcn evaluates it; the
+    	// peak is 0 outside it
+    	double plotDelta = 1.0 / (double) nPlotsPerChannel;
+    	int first = InlGaussian.windowFirst(xs[0], plotDelta, plotCount,
+    			peakInfo.getCentroidChannels(), peakInfo.getFwhm());
+    	int last = InlGaussian.windowLast(xs[0], plotDelta, plotCount,
+    			peakInfo.getCentroidChannels(), peakInfo.getFwhm());
+    	double[] ys = new double[plotCount];
+    	inlGaussian.valuesConstrained(xs, ys, first, last);
+    	
+    	for (int i = 0; i < plotCount; i++) {
+    		double y = ys[i] + backgroundPoints.get(i).getY();
+    		points.add(new Point2D.Double(xs[i], y));
     	}
 
     	return points;
 	}
 	
-	private static Vector<Point2D.Double> constructResiduals(Spectrum spectrum,
-			final Vector<Point2D.Double> fitsAtChannels) {
-				
-		Vector<Point2D.Double> residuals = new Vector<Point2D.Double>();
-				
-		for (Iterator<Point2D.Double> it = fitsAtChannels.iterator();
-			 it.hasNext(); ) {
-			Point2D.Double fitPoint = it.next();
-			int channel = (int) fitPoint.getX();
-			double count = spectrum.getCountAt(channel);
-			double sigCount = spectrum.getSigCountAt(channel);
-			double resid = 0;
-			if (0 != sigCount) {
-				resid = (count - fitPoint.getY()) / sigCount;
-			}
-			residuals.add(new Point2D.Double(channel, resid));
-		}
-						
-		return residuals;
-	}
-
 	private static int getPlotCount(ChannelRange region,
 			int nPlotsPerChannel) {
 		
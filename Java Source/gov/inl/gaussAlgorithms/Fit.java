@@ -10,9 +10,9 @@
  */
 package gov.inl.gaussAlgorithms;
 
+import gov.inl.gaussAlgorithms.FitInfo.PeakInfo;
 import gov.inl.gaussAlgorithms.Summary.PeakSummary;
 
-import java.awt.geom.Point2D;
 import java.text.NumberFormat;
 import java.util.Iterator;
 import java.util.TreeSet;
@@ -21,6 +21,11 @@ import java.util.Vector;
 /**
  * contains all inputs and results of a region fit
  *
+ * A fit cycle only computes what the cycles need: the fit at each channel,
+ * the residuals and chi squared. The uncertainties, background, summary
+ * and curve are computed when first asked for, which fitRegion() does
+ * only for the fits that it returns.
+ *
  */
 public class Fit {
 	
@@ -38,9 +43,15 @@ public class Fit {
 	private final CycleReturnCode     m_cycleReturnCode; // new with java work
 	private final Exception           m_cycleException; // new with java work
 	private final FitInfo             m_fitInfo;
-	private final BackgroundEquation  m_background;
+	private final FitVary             m_fitVary;
+	private final double[]            m_residuals;       // at each channel
+	private final double[]            m_fitsAtChannels;
+	private LmderSolver               m_solver;  // until finish()
+	private BackgroundEquation        m_background;
 	private Curve                     m_curve;
-	private final Summary             m_summary;
+	private Summary                   m_summary;
+	private SolverStatistics          m_solverStatistics;
+	private SolverStatistics          m_regionSolverStatistics;
 	
 	// constructors
 	
@@ -53,15 +64,24 @@ public class Fit {
 				
 		m_inputs = null;
 		m_fitInfo = null;
+		m_fitVary = null;
+		m_residuals = null;
+		m_fitsAtChannels = null;
+		m_solver = null;
 		m_background = null;
 		m_curve = null;
 		m_summary = null;
 		m_chiSq = 0;
+		m_solverStatistics = new SolverStatistics();
+		m_regionSolverStatistics = new SolverStatistics();
 	}
 	
+	/*
+	 * solver - the solver that returned "fitInfo"; its factorization of
+	 *          the Jacobian gives the covariances in finish()
+	 */
 	Fit(final FitInputs inputs, int cycleNumber,
-			final FitInfo fitInfo, FitVary fitVary,
-			final FitInfoUncertainty fitInfoUncertainty,
+			final FitInfo fitInfo, FitVary fitVary, LmderSolver solver,
 			CycleReturnCode cycleReturnCode) {
 				
 		m_cycleNumber = cycleNumber;
@@ -70,21 +90,27 @@ public class Fit {
 		
 		m_inputs = inputs;
 		m_fitInfo = fitInfo;
-		m_background = new BackgroundEquation(fitInfo, fitInfoUncertainty);
+		m_fitVary = fitVary;
+		m_solver = solver;
 		
-		Spectrum spectrum = inputs.getSpectrum();
 		ChannelRange region = inputs.getRegion();
-		m_curve = new Curve(spectrum, region, 1, fitInfo);
-		m_chiSq = calculateChiSq(m_curve, fitVary.getVaryCount());
-		EnergyEquation usedEx = inputs.getEnergyEquation();
-		TreeSet<Peak> inputPeaks = inputs.getInputPeaks();
-		m_summary = new Summary(spectrum, region, usedEx, inputPeaks,
-				fitInfo, fitInfoUncertainty);
+		m_fitsAtChannels = Curve.calculateFitsAtChannels(region, fitInfo);
+		m_residuals = Curve.calculateResiduals(inputs.getSpectrum(), region,
+				m_fitsAtChannels);
+		m_chiSq = calculateChiSq(m_residuals, fitVary.getVaryCount());
+		m_background = null;
+		m_curve = null;
+		m_summary = null;
+		m_solverStatistics = new SolverStatistics();
+		m_regionSolverStatistics = new SolverStatistics();
 	}
 	
 	// public methods
 	
 	public BackgroundEquation getBackground() {
+		
+		finish();
+		
 		return m_background;
 	}
 		
@@ -95,7 +121,11 @@ public class Fit {
 
 	public Curve getCurve(int nPlotsPerChannel) {
 		
-		if (nPlotsPerChannel != m_curve.getNPlotsPerChannel()) {
+		if (null == m_fitInfo) {
+			return null;
+		}
+		if ((null == m_curve) ||
+			(nPlotsPerChannel != m_curve.getNPlotsPerChannel())) {
 			m_curve = new Curve(m_inputs.getSpectrum(), m_inputs.getRegion(),
 					nPlotsPerChannel, m_fitInfo);
 		}
@@ -132,7 +162,7 @@ public class Fit {
 		TreeSet<Peak> peaks = new TreeSet<Peak>();
 
 		for (Iterator<PeakSummary> it =
-				m_summary.getPeakSummaries().iterator(); it.hasNext(); ) {
+				getSummary().getPeakSummaries().iterator(); it.hasNext(); ) {
 			PeakSummary peakSummary = it.next();
 			
 			boolean fixed = false;
@@ -166,11 +196,24 @@ public class Fit {
 		return m_inputs.getRegion();
 	}
 	
+	// the solver work of every cycle of the region fit, including failed,
+	// dropped and cancelled ones; the same for each fit it returned
+	public SolverStatistics getRegionSolverStatistics() {
+		return m_regionSolverStatistics;
+	}
+	
 	public Spectrum getSpectrum() {
 		return m_inputs.getSpectrum();
 	}
 
+	public SolverStatistics getSolverStatistics() {
+		return m_solverStatistics;
+	}
+	
 	public Summary getSummary() {
+		
+		finish();
+		
 		return m_summary;
 	}
 	
@@ -204,21 +247,98 @@ public class Fit {
 	public WidthEquation getWidthEquation() {
 		return m_inputs.getWidthEquation();
 	}
+	
+	// package methods
+	
+	/*
+	 * finish - computes the uncertainties, the background and the summary
+	 *          of the fit, once. Nothing is done for a failed cycle.
+	 *          Throws SingularMatrixException if the Jacobian at the
+	 *          solution is rank deficient.
+	 */
+	void finish() {
+		
+		if ((null == m_fitInfo) || (null != m_summary)) {
+			return;
+		}
+		
+		// NOTE: the covariances are the inverse of transpose(J)J, as
+		// the Apache code computed them, but taken from the solver's QR
+		// factor. old code used covariance tolerance = 0
+		EnergyEquation usedEx = m_inputs.getEnergyEquation();
+		FitInfoUncertainty fitInfoUncertainty = new FitInfoUncertainty(
+				m_fitInfo, m_fitVary, m_solver.getCovariances(0), usedEx);
+		m_solver = null;
+		
+		m_background = new BackgroundEquation(m_fitInfo, fitInfoUncertainty);
+		m_summary = new Summary(m_inputs.getSpectrum(), m_inputs.getRegion(),
+				usedEx, m_inputs.getInputPeaks(), m_fitInfo,
+				fitInfoUncertainty);
+	}
+	
+	// the fitted parameters; null for a failed cycle
+	FitInfo getFitInfo() {
+		return m_fitInfo;
+	}
+	
+	// the parameters that varied; null for a failed cycle
+	FitVary getFitVary() {
+		return m_fitVary;
+	}
+	
+	// the fit at each channel of the region, for RegionFitting.addPeak()
+	double[] getFitsAtChannels() {
+		return m_fitsAtChannels;
+	}
+	
+	/*
+	 * getOutputPeakCount - getOutputPeaks().size() without the summary:
+	 *                      peaks whose centroids are the same to within
+	 *                      Peak.THRESHOLD count once
+	 */
+	int getOutputPeakCount() {
+		
+		TreeSet<Double> channels = new TreeSet<Double>();
+		for (Iterator<PeakInfo> it = m_fitInfo.getPeakIterator();
+			 it.hasNext(); ) {
+			channels.add(new Double(it.next().getCentroidChannels()));
+		}
+		
+		TreeSet<Peak> peaks = new TreeSet<Peak>();
+		for (Iterator<Double> it = channels.iterator(); it.hasNext(); ) {
+			peaks.add(new Peak(it.next().doubleValue(), false));
+		}
+		
+		return peaks.size();
+	}
+	
+	// the weighted residual at each channel of the region
+	double[] getResiduals() {
+		return m_residuals;
+	}
+	
+	// set by RegionFitting.fitCycles() on the fits that it returns
+	void setRegionSolverStatistics(
+			final SolverStatistics regionSolverStatistics) {
+		m_regionSolverStatistics = regionSolverStatistics;
+	}
+	
+	// set by RegionFitting.nllsqs() once the solver has returned
+	void setSolverStatistics(final SolverStatistics solverStatistics) {
+		m_solverStatistics = solverStatistics;
+	}
 		
 	// private methods
 
-	private static double calculateChiSq(final Curve curve, int varyCount) {
+	private static double calculateChiSq(final double[] residuals,
+			int varyCount) {
 		
-		Vector<Point2D.Double> residuals = curve.getResiduals();
-				
 		double sumSquares = 0;
-		for (Iterator<Point2D.Double> it = residuals.iterator();
-			 it.hasNext(); ) {
-			Point2D.Double point = it.next();
-			sumSquares += Math.pow(point.getY(), 2);
+		for (int i = 0; i < residuals.length; i++) {
+			sumSquares += Math.pow(residuals[i], 2);
 		}
 		
-		double denominator = residuals.size() - varyCount;
+		double denominator = residuals.length - varyCount;
 		
 		return sumSquares / denominator;
 	}
@@ -241,18 +361,19 @@ public class Fit {
 		lines.add("Peak Width=" + pw + "; Convergence Criteria=" + cc);
 
 		NumberFormat format = ofMaxFractionDigits;
-		int nPeaks = m_summary.getPeakSummaries().size();
+		Summary summary = getSummary();
+		int nPeaks = summary.getPeakSummaries().size();
 		lines.add("Fit Cycle=" + m_cycleNumber +
 				  "; Cycle returned=" + m_cycleReturnCode +
 				  "; Fit Chi Squared=" + format.format(m_chiSq) +
-				  "; Area Ratio=" + format.format(m_summary.getRatio()) +
+				  "; Area Ratio=" + format.format(summary.getRatio()) +
 				  "; NPeaks=" + nPeaks);
 
 		lines.add("Peak Record: chan, sigc, height, sigh, " +
 				  "width, sigw, area, siga, energy, sige");
 		int i = 0;
 		for (Iterator<PeakSummary> it =
-				m_summary.getPeakSummaries().iterator(); it.hasNext(); i++) {
+				summary.getPeakSummaries().iterator(); it.hasNext(); i++) {
 			PeakSummary peakSummary = it.next();
 			lines.add("Peak " + (i+1) + ": " +
 					format.format(peakSummary.getChannel()) + ", " +
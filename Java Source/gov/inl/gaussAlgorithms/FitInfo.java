@@ -16,8 +16,6 @@ import java.util.Iterator;
 import java.util.TreeSet;
 import java.util.Vector;
 
-import org.apache.commons.math3.linear.RealVector;
-
 /**
  * holds information used by the region fit algorithm
  *
@@ -59,8 +57,10 @@ public class FitInfo {
 
 	}
 	
+	// background is null, or has one value per spectrum channel
 	FitInfo(Spectrum spectrum, ChannelRange region, EnergyEquation ex,
-			WidthEquation wx, final TreeSet<Peak> peaks) {
+			WidthEquation wx, final TreeSet<Peak> peaks,
+			final long[] background) {
 				
 		m_contains511KeV = false;
 		
@@ -68,6 +68,9 @@ public class FitInfo {
 				((double) spectrum.getCountAt(region.getLastChannel() - 1) +
 				 (double) spectrum.getCountAt(region.getLastChannel())) / 2.0;
 		m_backgroundSlope = 0;
+		if (null != background) {
+			seedBackground(spectrum, region, background);
+		}
 		
 		// 8/18/2000 - Larry Blackwood noted that as originally
 		//             calculated, xmid was rounded to the closest
@@ -103,7 +106,7 @@ public class FitInfo {
 			
 			int roundedChannel = (int) Math.round(peak.getChannel());
 			double heightCounts = spectrum.getCountAt(roundedChannel) -
-					m_backgroundIntercept;
+					getBackgroundAt(region, roundedChannel);
 			double addWidth511Channels = 0;
 			if (!m_contains511KeV) {
 				if (isNear511KeV(ex.getEnergy(peak.getChannel()))) {
@@ -123,10 +126,10 @@ public class FitInfo {
 		
 		int lastChannel = region.getLastChannel();
 		int chanOfMaxCounts = 0;
-		int maxCounts = 0;
+		long maxCounts = 0;
 		if (0 >= m_peakInfoList.size()) {
 			for (int i = region.getFirstChannel(); i <= lastChannel; i++) {
-				int chanCounts = spectrum.getCountAt(i);
+				long chanCounts = spectrum.getCountAt(i);
 				if (chanCounts > maxCounts) {
 					chanOfMaxCounts = i;
 					maxCounts = chanCounts;
@@ -148,7 +151,8 @@ public class FitInfo {
 				}
 			}
 			
-			double heightCounts = maxCounts - m_backgroundIntercept;
+			double heightCounts = maxCounts -
+					getBackgroundAt(region, chanOfMaxCounts);
 			PeakInfo peakInfo = new PeakInfo(chanOfMaxCounts,
 					heightCounts, addWidth511Channels, false,
 					m_averagePeakWidthChannels);
@@ -211,20 +215,20 @@ public class FitInfo {
 		return X;
 	}
 	
-	public void update(final RealVector X, final FitVary fitVary) {
+	public void update(final double[] X, final FitVary fitVary) {
 		
 		int i = 0;
 		
 		if (fitVary.bckInterceptVaries()) {
-			setBckIntercept(X.getEntry(i));
+			setBckIntercept(X[i]);
 			i++;
 		}
 		if (fitVary.bckSlopeVaries()) {
-			setBckSlope(X.getEntry(i));
+			setBckSlope(X[i]);
 			i++;
 		}
 		if (fitVary.avgWidthVaries()) {
-			setAvgWid(X.getEntry(i));
+			setAvgWid(X[i]);
 			i++;
 		}
 		
@@ -235,15 +239,15 @@ public class FitInfo {
 			PeakVary peakVary = pvt.next();
 			
 			if (peakVary.heightCountsVaries()) {
-				peakInfo.setHeight(X.getEntry(i));
+				peakInfo.setHeight(X[i]);
 				i++;
 			}
 			if (peakVary.centroidChannelsVaries()) {
-				peakInfo.setCentroid(X.getEntry(i));
+				peakInfo.setCentroid(X[i]);
 				i++;
 			}
 			if (peakVary.addWidth511Varies()) {
-				peakInfo.setAddWidth511(X.getEntry(i));
+				peakInfo.setAddWidth511(X[i]);
 				i++;
 			}
 		}
@@ -299,6 +303,12 @@ public class FitInfo {
 	
 	// private methods
 
+	private double getBackgroundAt(ChannelRange region, int channel) {
+		
+		// same line as Curve: x is measured from the region's first channel
+		return m_backgroundIntercept +
+				(m_backgroundSlope * (channel - region.getFirstChannel()));
+	}
 	private static boolean isNear511KeV(double energy) {
 		
 		boolean answer = false;
@@ -309,6 +319,54 @@ public class FitInfo {
 		
 		return answer;
 	}
+	/*
+	 * seedBackground - least squares line through the region search
+	 *                  background over the region. The search leaves
+	 *                  zero in the channels it did not compute, 5 at
+	 *                  each end of its range or all of them, so zero
+	 *                  channels are left out. If fewer than 2 remain,
+	 *                  the default guess is kept.
+	 */
+	private void seedBackground(Spectrum spectrum, ChannelRange region,
+			final long[] background) {
+		
+		int firstChannel = region.getFirstChannel();
+		int lastChannel = region.getLastChannel();
+		int offset = spectrum.getFirstChannel();
+		
+		double n = 0;
+		double sumX = 0;
+		double sumY = 0;
+		double sumXX = 0;
+		double sumXY = 0;
+		for (int chan = firstChannel; chan <= lastChannel; chan++) {
+			int index = chan - offset;
+			if ((0 > index) || (background.length <= index) ||
+				(0 == background[index])) {
+				continue;
+			}
+			double x = chan - firstChannel;
+			double y = background[index];
+			n++;
+			sumX += x;
+			sumY += y;
+			sumXX += x * x;
+			sumXY += x * y;
+		}
+		
+		if (2 > n) {
+			return;
+		}
+		
+		double denominator = (n * sumXX) - (sumX * sumX);
+		if (0 == denominator) {
+			m_backgroundIntercept = sumY / n;
+			m_backgroundSlope = 0;
+		} else {
+			m_backgroundSlope = ((n * sumXY) - (sumX * sumY)) / denominator;
+			m_backgroundIntercept = (sumY - (m_backgroundSlope * sumX)) / n;
+		}
+	}
 	private void setAvgWid(double averagePeakWidthChannels) {
 		
 		m_averagePeakWidthChannels = averagePeakWidthChannels;
@@ -331,6 +389,11 @@ public class FitInfo {
 	 */
 	public static class PeakInfo {
 		
+		// limits enforced by constrain(), and during the fit in bounded
+		// mode, see FitParameters.isBounded()
+		final static double MIN_HEIGHT_COUNTS = 10;
+		final static int CENTROID_MARGIN_CHANNELS = 2;
+		
 		// member data
 		
 		private double       m_heightCounts;
@@ -365,17 +428,22 @@ public class FitInfo {
 		// used by RegionFitting.checkFit()
 		void constrain(ChannelRange region, double initialPeakwidthChannels) {
 			
-			if ((10 > m_heightCounts) && (0 != m_heightCounts)) {
-				m_heightCounts = 10;
+			if ((MIN_HEIGHT_COUNTS > m_heightCounts) &&
+				(0 != m_heightCounts)) {
+				m_heightCounts = MIN_HEIGHT_COUNTS;
 			}
 			if (0 > m_addWidth511Channels) {
 				m_addWidth511Channels = initialPeakwidthChannels;
 			}
-			if ((region.getFirstChannel() + 2) > m_centroidChannels) {
-				m_centroidChannels = region.getFirstChannel() + 2;
+			int minCentroid =
+					region.getFirstChannel() + CENTROID_MARGIN_CHANNELS;
+			if (minCentroid > m_centroidChannels) {
+				m_centroidChannels = minCentroid;
 			}
-			if ((region.getLastChannel() - 2) < m_centroidChannels) {
-				m_centroidChannels = region.getLastChannel() - 2;
+			int maxCentroid =
+					region.getLastChannel() - CENTROID_MARGIN_CHANNELS;
+			if (maxCentroid < m_centroidChannels) {
+				m_centroidChannels = maxCentroid;
 			}
 		}
 		
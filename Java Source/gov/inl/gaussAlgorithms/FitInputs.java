@@ -28,14 +28,41 @@ public class FitInputs {
 	private final ChannelRange     m_region;
 	private final TreeSet<Peak>    m_inputPeaks;
 	private final FitParameters    m_parms;
+	private final long[]           m_background;
 	
-	// constructor
+	// constructors
 	
 	public FitInputs(final Spectrum spectrum, final EnergyEquation ex,
 			final WidthEquation wx, final ChannelRange region,
 			final TreeSet<Peak> inputPeaks, final FitParameters parms) {
 		
+		this(spectrum, ex, wx, region, inputPeaks, parms, null);
+	}
+	
+	/*
+	 * takes the input peaks from an index of the whole peak list, which
+	 * is the same as passing region.peaksInRange(peaks)
+	 */
+	public FitInputs(final Spectrum spectrum, final EnergyEquation ex,
+			final WidthEquation wx, final ChannelRange region,
+			final PeakIndex peakIndex, final FitParameters parms) {
+		
+		this(spectrum, ex, wx, region, peakIndex.peaksInRange(region), parms,
+				null);
+	}
+	
+	/*
+	 * background has one value per spectrum channel, as returned by
+	 * RegionSearching.searchWithBackground(). It only seeds the fit's
+	 * background line; null means use the default guess.
+	 */
+	public FitInputs(final Spectrum spectrum, final EnergyEquation ex,
+			final WidthEquation wx, final ChannelRange region,
+			final TreeSet<Peak> inputPeaks, final FitParameters parms,
+			final long[] background) {
+		
 		m_spectrum = spectrum;
+		m_background = background;
 		m_ex = ex;
 		m_wx = wx;
 		m_region = region;
@@ -54,6 +81,10 @@ public class FitInputs {
 	
 	// public methods
 
+	public long[] getBackground() {
+		return m_background;
+	}
+	
 	public EnergyEquation getEnergyEquation() {
 		return m_ex;
 	}
@@ -99,6 +99,11 @@ public class FitParameters implements Cloneable {
 	private PeakWidthMode     DEFAULT_PKWDMODE = PeakWidthMode.VARIES;
 	private CCType            DEFAULT_CCTYPE = CCType.LARGER;
 	private float             DEFAULT_RESIDUAL = (float) 20.0;
+	private boolean           DEFAULT_SPECULATIVE = false;
+	private boolean           DEFAULT_BOUNDED = false;
+	private boolean           DEFAULT_VARIABLE_PROJECTION = false;
+	private boolean           DEFAULT_ADAPTIVE_TOLERANCES = false;
+	private boolean           DEFAULT_LMDER_SOLVER = false;
 
 	// member data
 
@@ -108,6 +113,11 @@ public class FitParameters implements Cloneable {
 	private float                  m_maxResid;
 	private PeakWidthMode          m_peakwidthMode;
 	private CCType                 m_ccType;
+	private boolean                m_speculative;
+	private boolean                m_bounded;
+	private boolean                m_variableProjection;
+	private boolean                m_adaptiveTolerances;
+	private boolean                m_lmderSolver;
 
 	// constructors
 
@@ -119,6 +129,11 @@ public class FitParameters implements Cloneable {
 		setPeakwidthMode(DEFAULT_PKWDMODE);
 		setCcType(DEFAULT_CCTYPE);
 		setMaxResid(DEFAULT_RESIDUAL);
+		setSpeculative(DEFAULT_SPECULATIVE);
+		setBounded(DEFAULT_BOUNDED);
+		setVariableProjection(DEFAULT_VARIABLE_PROJECTION);
+		setAdaptiveTolerances(DEFAULT_ADAPTIVE_TOLERANCES);
+		setLmderSolver(DEFAULT_LMDER_SOLVER);
 	}
 
 	public FitParameters(int nCycle, int nOut, int maxNpeaks,
@@ -131,14 +146,26 @@ public class FitParameters implements Cloneable {
 		setPeakwidthMode(peakwidthMode);
 		setCcType(ccType);
 		setMaxResid(maxResid);
+		setSpeculative(DEFAULT_SPECULATIVE);
+		setBounded(DEFAULT_BOUNDED);
+		setVariableProjection(DEFAULT_VARIABLE_PROJECTION);
+		setAdaptiveTolerances(DEFAULT_ADAPTIVE_TOLERANCES);
+		setLmderSolver(DEFAULT_LMDER_SOLVER);
 	}
 
 	// public methods
 	
 	public Object clone() {
 		
-		return new FitParameters(m_nCycle, m_nOut, m_maxNpeaks,
-				m_peakwidthMode, m_ccType, m_maxResid);
+		FitParameters parms = new FitParameters(m_nCycle, m_nOut,
+				m_maxNpeaks, m_peakwidthMode, m_ccType, m_maxResid);
+		parms.setSpeculative(m_speculative);
+		parms.setBounded(m_bounded);
+		parms.setVariableProjection(m_variableProjection);
+		parms.setAdaptiveTolerances(m_adaptiveTolerances);
+		parms.setLmderSolver(m_lmderSolver);
+		
+		return parms;
 	}
 
 	public CCType getCcType() {
@@ -171,11 +198,91 @@ public class FitParameters implements Cloneable {
 		return m_peakwidthMode;
 	}
 
+	/*
+	 * isAdaptiveTolerances - true if each fit cycle is solved with
+	 *                        tolerances 100 times looser than those of
+	 *                        the convergence criteria, then refined from
+	 *                        its answer with the usual tolerances. The
+	 *                        peaks to add or delete are chosen from the
+	 *                        refined fits, so they are the same as
+	 *                        without it when the two solves converge to
+	 *                        the same answer.
+	 */
+	public boolean isAdaptiveTolerances() {
+
+		return m_adaptiveTolerances;
+	}
+
+	/*
+	 * isBounded - true if the solver keeps the peak heights at 10 or
+	 *             more, the 511 keV extra widths at 0 or more and the
+	 *             centroids 2 channels inside the region at every step,
+	 *             instead of the fit cycle fixing them afterwards. Peaks
+	 *             cannot go negative in this mode.
+	 */
+	public boolean isBounded() {
+
+		return m_bounded;
+	}
+
+	/*
+	 * isLmderSolver - true if the fit cycles are solved with LmderSolver
+	 *                 instead of the Commons Math
+	 *                 LevenbergMarquardtOptimizer. It has not yet been
+	 *                 checked against the optimizer on a JVM, see
+	 *                 test_fit_lmder_solver in testGauss. Bounded and
+	 *                 variable projection fits need it, so they always
+	 *                 use it.
+	 */
+	public boolean isLmderSolver() {
+
+		return m_lmderSolver;
+	}
+
+	/*
+	 * isSpeculative - true if a fit cycle that is sure to follow the
+	 *                 current one is started on another thread before
+	 *                 the current one ends. The fits are the same either
+	 *                 way.
+	 */
+	public boolean isSpeculative() {
+
+		return m_speculative;
+	}
+
+	/*
+	 * isVariableProjection - true if the solver only varies the average
+	 *                        width, the centroids and the 511 keV extra
+	 *                        widths, and the background and heights are
+	 *                        solved by linear least squares at each step.
+	 *                        In bounded mode the heights are only bounded
+	 *                        between cycles.
+	 */
+	public boolean isVariableProjection() {
+
+		return m_variableProjection;
+	}
+
+	public void setAdaptiveTolerances(boolean adaptiveTolerances) {
+
+		m_adaptiveTolerances = adaptiveTolerances;
+	}
+
+	public void setBounded(boolean bounded) {
+
+		m_bounded = bounded;
+	}
+
 	public void setCcType(CCType ccType) {
 
 		m_ccType = ccType;
 	}
 
+	public void setLmderSolver(boolean lmderSolver) {
+
+		m_lmderSolver = lmderSolver;
+	}
+
 	public void setMaxNpeaks(int maxNpeaks) {
 
 		m_maxNpeaks = maxNpeaks;
@@ -200,4 +307,14 @@ public class FitParameters implements Cloneable {
 
 		m_peakwidthMode = peakwidthMode;
 	}
+
+	public void setSpeculative(boolean speculative) {
+
+		m_speculative = speculative;
+	}
+
+	public void setVariableProjection(boolean variableProjection) {
+
+		m_variableProjection = variableProjection;
+	}
 }
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2017 Battelle Energy Alliance
+ */
+/*
+ *  Gauss Algorithms
+ *
+ *  File Name: FitWarmStartCache.java
+ *
+ *  Description: keeps the results of region fits to start later fits of
+ *               the same region
+ */
+package gov.inl.gaussAlgorithms;
+
+import gov.inl.gaussAlgorithms.FitInfo.PeakInfo;
+
+import java.util.HashMap;
+import java.util.Iterator;
+
+/**
+ * the final fit parameters and peak count of earlier region fits, keyed by
+ * detector ID and region, so that fitting the same region of a later
+ * spectrum from the same detector can start from the answer instead of
+ * from the usual guess. See RegionFitting.fitRegion(FitInputs,
+ * FitWarmStartCache, String).
+ *
+ * The methods are synchronized, so one cache may be shared by fits that
+ * run on several threads.
+ *
+ */
+public class FitWarmStartCache {
+
+	public final static double DEFAULT_CHI_SQUARED_FACTOR = 1.5;
+
+	// member data
+
+	private final double          m_chiSquaredFactor;
+	private final HashMap<String, HashMap<ChannelRange, Entry>> m_entries;
+
+	// constructors
+
+	public FitWarmStartCache() {
+
+		this(DEFAULT_CHI_SQUARED_FACTOR);
+	}
+
+	/*
+	 * chiSquaredFactor - a warm started fit whose best chi squared is
+	 *                    more than this times that of the region's last
+	 *                    cold fit is thrown away and the region is fitted
+	 *                    cold
+	 */
+	public FitWarmStartCache(double chiSquaredFactor) {
+
+		m_chiSquaredFactor = chiSquaredFactor;
+		m_entries = new HashMap<String, HashMap<ChannelRange, Entry>>();
+	}
+
+	// public methods
+
+	public synchronized void clear() {
+
+		m_entries.clear();
+	}
+
+	/*
+	 * clear - forget the fits of one detector
+	 */
+	public synchronized void clear(String detectorId) {
+
+		m_entries.remove(detectorId);
+	}
+
+	public double getChiSquaredFactor() {
+
+		return m_chiSquaredFactor;
+	}
+
+	/*
+	 * getPeakCount - number of peaks in the saved fit, or -1 if there is
+	 *                none
+	 */
+	public synchronized int getPeakCount(String detectorId,
+			ChannelRange region) {
+
+		Entry entry = getEntry(detectorId, region);
+		if (null == entry) {
+			return -1;
+		}
+
+		return entry.m_fitInfo.getPeakCount();
+	}
+
+	public synchronized int size() {
+
+		int count = 0;
+		for (Iterator<HashMap<ChannelRange, Entry>> it =
+				m_entries.values().iterator(); it.hasNext(); ) {
+			count += it.next().size();
+		}
+
+		return count;
+	}
+
+	// package methods, used by RegionFitting
+
+	/*
+	 * getStart - copy of the saved fit parameters, constrained to the
+	 *            region the same way checkFit() constrains them between
+	 *            cycles, or null if there is no usable saved fit
+	 */
+	synchronized FitInfo getStart(String detectorId, ChannelRange region,
+			int maxPeakCount) {
+
+		Entry entry = getEntry(detectorId, region);
+		if ((null == entry) ||
+			(entry.m_fitInfo.getPeakCount() > maxPeakCount)) {
+			return null;
+		}
+
+		FitInfo start = entry.m_fitInfo.clone();
+		double initialPeakwidthChannels =
+				start.getInitialPeakWidthChannels();
+		for (Iterator<PeakInfo> it = start.getPeakIterator();
+			 it.hasNext(); ) {
+			it.next().constrain(region, initialPeakwidthChannels);
+		}
+
+		return start;
+	}
+
+	/*
+	 * isDegraded - true if "chiSquared" is too much worse than that of
+	 *              the last cold fit of the region
+	 */
+	synchronized boolean isDegraded(String detectorId, ChannelRange region,
+			double chiSquared) {
+
+		Entry entry = getEntry(detectorId, region);
+		if (null == entry) {
+			return false;
+		}
+
+		return (chiSquared > (m_chiSquaredFactor * entry.m_coldChiSquared));
+	}
+
+	/*
+	 * put - save the best fit of a region. A cold fit also becomes the
+	 *       chi squared reference; a warm fit keeps the old reference, so
+	 *       a run of warm fits cannot drift away from it.
+	 */
+	synchronized void put(String detectorId, ChannelRange region,
+			final Fit bestFit, boolean cold) {
+
+		HashMap<ChannelRange, Entry> regions = m_entries.get(detectorId);
+		if (null == regions) {
+			regions = new HashMap<ChannelRange, Entry>();
+			m_entries.put(detectorId, regions);
+		}
+
+		double coldChiSquared = bestFit.getChiSquared();
+		Entry oldEntry = regions.get(region);
+		if ((!cold) && (null != oldEntry)) {
+			coldChiSquared = oldEntry.m_coldChiSquared;
+		}
+
+		regions.put(region, new Entry(bestFit.getFitInfo().clone(),
+				coldChiSquared));
+	}
+
+	// private methods
+
+	private Entry getEntry(String detectorId, ChannelRange region) {
+
+		HashMap<ChannelRange, Entry> regions = m_entries.get(detectorId);
+		if (null == regions) {
+			return null;
+		}
+
+		return regions.get(region);
+	}
+
+	// inner class
+
+	private static class Entry {
+
+		// member data
+
+		private final FitInfo       m_fitInfo;
+		private final double        m_coldChiSquared;
+
+		// constructor
+
+		Entry(final FitInfo fitInfo, double coldChiSquared) {
+
+			m_fitInfo = fitInfo;
+			m_coldChiSquared = coldChiSquared;
+		}
+	}
+}
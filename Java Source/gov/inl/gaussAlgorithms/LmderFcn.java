@@ -13,21 +13,10 @@ package gov.inl.gaussAlgorithms;
 import gov.inl.gaussAlgorithms.FitInfo.PeakInfo;
 import gov.inl.gaussAlgorithms.FitVary.PeakVary;
 
-import java.awt.geom.Point2D;
 //import java.io.File;
 //import java.text.NumberFormat;
+import java.util.Arrays;
 import java.util.Iterator;
-import java.util.Vector;
-
-import org.apache.commons.math3.fitting.leastsquares.LeastSquaresFactory;
-import org.apache.commons.math3.fitting.leastsquares.LeastSquaresProblem;
-import org.apache.commons.math3.fitting.leastsquares.MultivariateJacobianFunction;
-import org.apache.commons.math3.linear.Array2DRowRealMatrix;
-import org.apache.commons.math3.linear.ArrayRealVector;
-import org.apache.commons.math3.linear.RealMatrix;
-import org.apache.commons.math3.linear.RealVector;
-import org.apache.commons.math3.optim.ConvergenceChecker;
-import org.apache.commons.math3.util.Pair;
 
 /**
  * the famous "lmder" (Levenberg-Marquardt) fit used to fit regions
@@ -41,228 +30,770 @@ public class LmderFcn {
 	private final ChannelRange          m_region;
 	private FitInfo                     m_fitInfo;
 	private final FitVary               m_fitVary;
-	private LeastSquaresProblem         m_problem;
+	private final FcnJacobian           m_problem;
+	private VarProJacobian              m_varProProblem;
+	private final boolean               m_bounded;
 	
-	// constructor
+	// constructors
 		
 	public LmderFcn(Spectrum spectrum, ChannelRange region,
 			final FitInfo fitInfo, FitVary fitVary) {
 		
+		this(spectrum, region, fitInfo, fitVary, false);
+	}
+	
+	/*
+	 * bounded - give the solver the limits that PeakInfo.constrain()
+	 *           enforces, see FitParameters.isBounded()
+	 */
+	public LmderFcn(Spectrum spectrum, ChannelRange region,
+			final FitInfo fitInfo, FitVary fitVary, boolean bounded) {
+		
+		m_bounded = bounded;
 		m_spectrum = spectrum;
 		m_region = region;
 		m_fitInfo = fitInfo.clone();
 		m_fitVary = fitVary;
 		
-		double[] target = getTarget(region);
-		RealVector observations = new ArrayRealVector(target);
 		double[] X = fitInfo.getX(fitVary);
-		RealVector start = new ArrayRealVector(X);
 		int maxEval = 100 * (X.length + 1);
 		int maxIter = maxEval;
-		MultivariateJacobianFunction model = new FcnJacobian();
-		ConvergenceChecker<LeastSquaresProblem.Evaluation> checker = null;
 		
-		m_problem = LeastSquaresFactory.create(model, observations, start,
-				checker, maxEval, maxIter);
+		m_problem = new FcnJacobian(X, maxEval, maxIter);
+		m_varProProblem = null;
 	}
 	
-	public FitInfo getFinalFitInfo() {
+	/*
+	 * getFinalFitInfo - the fit at the solution returned by the solver
+	 */
+	public FitInfo getFinalFitInfo(final double[] X) {
+		
+		m_fitInfo.update(X, m_fitVary);
+		
 		return m_fitInfo;
 	}
 	
-	public LeastSquaresProblem getProblem() {
+	public LmderSolver.Problem getProblem() {
 		return m_problem;
 	}
-		
-	// private methods
 	
-	private static double[] getTarget(final ChannelRange region) {
-		
-		double[] target = new double[region.widthChannels()];
+	/*
+	 * getVarProProblem - the fit in variable projection form: the solver
+	 *                    only varies the average width, the centroids and
+	 *                    the 511 keV extra widths, and every evaluation
+	 *                    solves the background and the heights by linear
+	 *                    least squares. The parameters at its solution
+	 *                    are given by getVarProSolution().
+	 */
+	public LmderSolver.Problem getVarProProblem() {
 		
-		int top = region.getLastChannel();
-		for (int i = 0, chan = region.getFirstChannel(); chan < top;
-			 i++, chan++) {
-			target[i] = 0;
+		if (null == m_varProProblem) {
+			m_varProProblem = new VarProJacobian(m_problem);
 		}
 		
-		return target;
+		return m_varProProblem;
+	}
+	
+	/*
+	 * getVarProSolution - all the parameters, in getProblem() order, for
+	 *                     "nonlinearX", a point of getVarProProblem()
+	 */
+	public double[] getVarProSolution(final double[] nonlinearX) {
+		
+		getVarProProblem();
+		m_varProProblem.solveLinear(nonlinearX);
+		
+		return m_varProProblem.m_fullX.clone();
 	}
 	
 	// inner classes
 	
-	private class FcnJacobian implements MultivariateJacobianFunction {
+	/**
+	 * the problem for the solver. Everything a function evaluation needs
+	 * is set up once per fit: the counts and uncertainties of the region
+	 * and the column of each varying parameter. The solver owns the
+	 * arrays that every evaluation writes into.
+	 *
+	 */
+	private class FcnJacobian implements LmderSolver.Problem {
+		
+		// member data
+		
+		private final double[]      m_start;
+		private final int           m_maxEvaluations;
+		private final int           m_maxIterations;
+		private final double[]      m_counts;
+		private final double[]      m_sigCounts;
+		private final int           m_interceptCol;
+		private final int           m_slopeCol;
+		private final int           m_avgWidthCol;
+		private final int[]         m_heightCols;
+		private final int[]         m_centroidCols;
+		private final int[]         m_addWidth511Cols;
+		private final double[]      m_lowerBounds;      // null if unbounded
+		private final double[]      m_upperBounds;      // null if unbounded
+		private final double[]      m_mu;               // of one peak
+		private final double[]      m_expNegMuSquared;  // of one peak
 		
 		// constructor
-		private FcnJacobian() {
+		private FcnJacobian(final double[] start, int maxEvaluations,
+				int maxIterations) {
+			
+			m_start = start;
+			m_maxEvaluations = maxEvaluations;
+			m_maxIterations = maxIterations;
 			
+			int rowDimension = m_region.widthChannels();
+			m_counts = new double[rowDimension];
+			m_sigCounts = new double[rowDimension];
+			int chan = m_region.getFirstChannel();
+			for (int i = 0; i < rowDimension; i++, chan++) {
+				m_counts[i] = m_spectrum.getCountAt(chan);
+				m_sigCounts[i] = m_spectrum.getSigCountAt(chan);
+			}
+			m_mu = new double[rowDimension];
+			m_expNegMuSquared = new double[rowDimension];
+			
+			// column of each varying parameter, -1 if it is fixed
+			int colIndex = 0;
+			if (m_fitVary.bckInterceptVaries()) {
+				m_interceptCol = colIndex;
+				colIndex++;
+			} else {
+				m_interceptCol = -1;
+			}
+			if (m_fitVary.bckSlopeVaries()) {
+				m_slopeCol = colIndex;
+				colIndex++;
+			} else {
+				m_slopeCol = -1;
+			}
+			if (m_fitVary.avgWidthVaries()) {
+				m_avgWidthCol = colIndex;
+				colIndex++;
+			} else {
+				m_avgWidthCol = -1;
+			}
+			
+			int peakCount = m_fitInfo.getPeakCount();
+			m_heightCols = new int[peakCount];
+			m_centroidCols = new int[peakCount];
+			m_addWidth511Cols = new int[peakCount];
+			
+			Iterator<PeakVary> pvt = m_fitVary.getPeakIterator();
+			for (int k = 0; k < peakCount; k++) {
+				m_heightCols[k] = -1;
+				m_centroidCols[k] = -1;
+				m_addWidth511Cols[k] = -1;
+				if (!pvt.hasNext()) {
+					continue;
+				}
+				
+				PeakVary peakVary = pvt.next();
+				if (peakVary.heightCountsVaries()) {
+					m_heightCols[k] = colIndex;
+					colIndex++;
+				}
+				if (peakVary.centroidChannelsVaries()) {
+					m_centroidCols[k] = colIndex;
+					colIndex++;
+				}
+				if (peakVary.addWidth511Varies()) {
+					m_addWidth511Cols[k] = colIndex;
+					colIndex++;
+				}
+			}
+			
+			if (m_bounded) {
+				m_lowerBounds = new double[start.length];
+				m_upperBounds = new double[start.length];
+				setBounds();
+			} else {
+				m_lowerBounds = null;
+				m_upperBounds = null;
+			}
 		}
 		
 		// public methods
 
-		public Pair<RealVector, RealMatrix> value(RealVector currentX) {
-						
-			m_fitInfo.update(currentX, m_fitVary);
+		public double[] getLowerBounds() {
+			return m_lowerBounds;
+		}
+		public int getMaxEvaluations() {
+			return m_maxEvaluations;
+		}
+		public int getMaxIterations() {
+			return m_maxIterations;
+		}
+		public int getObservationSize() {
+			return m_counts.length;
+		}
+		public double[] getStart() {
+			return m_start;
+		}
+		public double[] getUpperBounds() {
+			return m_upperBounds;
+		}
+		
+		/*
+		 * evaluate - fills the weighted residuals and the Jacobian rows for
+		 *            the fit at "X" in one pass over the peaks. Each peak's
+		 *            mu and exp(-mu^2) are computed once per channel, a
+		 *            block of its window at a time, and used for its share
+		 *            of the fit and for all of its columns. Outside its
+		 *            window, see InlGaussian.windowFirst(), a peak adds
+		 *            nothing and its columns are zero. The residuals are
+		 *            the same as those of Curve.getResiduals().
+		 */
+		public void evaluate(final double[] X, double[] resid,
+				double[][] jacobian) {
+									
+			m_fitInfo.update(X, m_fitVary);
+			
+			//  see output.c:GP_calc_jacobian
+			
+			// NOTE: target is all zeros, so the model is the residual
+			
+			int rowDimension = resid.length;
+			int firstChannel = m_region.getFirstChannel();
+			double intercept = m_fitInfo.getBckIntercept();
+			double slope = m_fitInfo.getBckSlope();
+			
+			// resid holds the fit until the last pass;
+			// background columns are 1 and the row index
+			for (int i = 0; i < rowDimension; i++) {
+				resid[i] = intercept + (slope * i);
+				Arrays.fill(jacobian[i], 0);
+				if (0 <= m_interceptCol) {
+					jacobian[i][m_interceptCol] = 1;
+				}
+				if (0 <= m_slopeCol) {
+					jacobian[i][m_slopeCol] = i;
+				}
+			}
 
-			Pair<RealVector, RealMatrix> answer =
-					new Pair<RealVector, RealMatrix>(getFx(),
-							getJacobian());
+			int k = 0;
+			for (Iterator<PeakInfo> pit = m_fitInfo.getPeakIterator();
+				 pit.hasNext(); k++) {
+				PeakInfo peakInfo = pit.next();
+				
+				int heightCol = m_heightCols[k];
+				int centroidCol = m_centroidCols[k];
+				int addWidth511Col = m_addWidth511Cols[k];
+				
+				double heightCounts = peakInfo.getHeightCounts();
+				double centroidChannels = peakInfo.getCentroidChannels();
+				double fwhm = peakInfo.getFwhm();
+				int first = InlGaussian.windowFirst(firstChannel, 1,
+						rowDimension, centroidChannels, fwhm);
+				int last = InlGaussian.windowLast(firstChannel, 1,
+						rowDimension, centroidChannels, fwhm);
+				
+				int chan = firstChannel + first;
+				for (int i = first; i <= last; i++, chan++) {
+					m_mu[i] = InlGaussian.mu(chan, centroidChannels, fwhm);
+				}
+				InlGaussian.expNegMuSquaredConstrained(m_mu,
+						m_expNegMuSquared, first, last);
+				
+				for (int i = first; i <= last; i++) {
+					double[] row = jacobian[i];
+					
+					double mu = m_mu[i];
+					double expNegMuSquared = m_expNegMuSquared[i];
+					double gaussian = heightCounts * expNegMuSquared;
+					
+					// add the peak as Curve does, on top of the background
+					double background = intercept + (slope * i);
+					resid[i] += (gaussian + background) - background;
+					
+					// d/dheight is exp(-muSquared), d/dcentroid is
+					// 2*y*mu*factor/fwhm and d/dwidth is 2*y*muSquared/fwhm
+					double centroid = 0;
+					double addWidth511 = 0;
+					if (0 != fwhm) {
+						centroid = 2.0 * gaussian * mu *
+								InlGaussian.MU_FACTOR / fwhm;
+						addWidth511 = 2 * gaussian * mu * mu / fwhm;
+					}
+					if (0 <= m_avgWidthCol) {
+						row[m_avgWidthCol] += addWidth511;
+					}
+					if (0 <= heightCol) {
+						row[heightCol] = expNegMuSquared;
+					}
+					if (0 <= centroidCol) {
+						row[centroidCol] = centroid;
+					}
+					if (0 <= addWidth511Col) {
+						row[addWidth511Col] = addWidth511;
+					}
+				}
+			}
 			
-			return answer;
+			// divide by the uncertainty: the residual by the positive one,
+			// the derivatives by the negative one
+			for (int i = 0; i < rowDimension; i++) {
+				double sigCount = m_sigCounts[i];
+				double fit = resid[i];
+				resid[i] = 0;
+				if (0 != sigCount) {
+					resid[i] = (m_counts[i] - fit) / sigCount;
+				}
+				
+				double[] row = jacobian[i];
+				for (int j = 0; j < row.length; j++) {
+					row[j] = - row[j] / sigCount;
+				}
+			}
 		}
 		
 		// private methods
 		
-		private RealVector getFx() {
-			
-			// NOTE: target is all zeros
-						
-			Curve curve = new Curve(m_spectrum, m_region, 1, m_fitInfo);
-			
-			Vector<Point2D.Double> residPoints = curve.getResiduals();
-			double[] resid = new double[residPoints.size()];
-			int i = 0;
-			for (Iterator<Point2D.Double> it = residPoints.iterator();
-				 it.hasNext(); i++) {
-				Point2D.Double point = it.next();
-				resid[i] = point.getY();
-			}
-			ArrayRealVector fx = new ArrayRealVector(resid);
-						
-			return fx;
+		/*
+		 * setBounds:
+		 *   routine that sets the limits of PeakInfo.constrain() on the
+		 *   height, centroid and 511 keV extra width columns; the
+		 *   background and average width are not bounded
+		 */
+		private void setBounds() {
+			
+			Arrays.fill(m_lowerBounds, Double.NEGATIVE_INFINITY);
+			Arrays.fill(m_upperBounds, Double.POSITIVE_INFINITY);
+			
+			double minCentroid = m_region.getFirstChannel() +
+					PeakInfo.CENTROID_MARGIN_CHANNELS;
+			double maxCentroid = m_region.getLastChannel() -
+					PeakInfo.CENTROID_MARGIN_CHANNELS;
+			for (int k = 0; k < m_heightCols.length; k++) {
+				if (0 <= m_heightCols[k]) {
+					m_lowerBounds[m_heightCols[k]] =
+							PeakInfo.MIN_HEIGHT_COUNTS;
+				}
+				if (0 <= m_centroidCols[k]) {
+					m_lowerBounds[m_centroidCols[k]] = minCentroid;
+					m_upperBounds[m_centroidCols[k]] = maxCentroid;
+				}
+				if (0 <= m_addWidth511Cols[k]) {
+					m_lowerBounds[m_addWidth511Cols[k]] = 0;
+				}
+			}
 		}
+	} // FcnJacobian
+	
+	/**
+	 * the problem in variable projection form (Golub and Pereyra, with
+	 * Kaufman's Jacobian). The background and the heights enter the model
+	 * linearly, so for given widths and centroids they are solved exactly
+	 * by a Householder least squares fit, and the solver only sees the
+	 * other parameters. The values are the weighted residuals of the model
+	 * with the solved background and heights, and the Jacobian is the one
+	 * FcnJacobian gives for the solver's parameters with the part in the
+	 * span of the linear columns projected out. Evaluation is always in
+	 * double.
+	 *
+	 */
+	private class VarProJacobian implements LmderSolver.Problem {
 		
-		private RealMatrix getJacobian() {
-									
-			//  see output.c:GP_calc_jacobian
+		// columns whose diagonal element of R is this small, relative to
+		// the column norm, are left out of the linear fit
+		private final static double RANK_THRESHOLD = 1.0e-12;
+		
+		// member data
+		
+		private final FcnJacobian   m_full;
+		private final double[]      m_fullX;        // last point solved
+		private final int[]         m_linearCols;   // in m_fullX
+		private final int[]         m_nonlinearCols;  // in m_fullX
+		private final int[]         m_varProCols;   // of m_fullX, or -1
+		private final double[]      m_start;
+		private final double[]      m_lowerBounds;  // null if unbounded
+		private final double[]      m_upperBounds;  // null if unbounded
+		private final int           m_maxEvaluations;
+		private final int           m_maxIterations;
+		private final double[]      m_weights;      // 0 if no uncertainty
+		private final double[][]    m_peakMu;
+		private final double[][]    m_peakExp;      // exp(-mu^2)
+		private final int[]         m_windowFirst;  // of each peak
+		private final int[]         m_windowLast;   // of each peak
+		private final double[][]    m_linear;       // factored in place
+		private final double[]      m_beta;
+		private final boolean[]     m_solvable;
+		private final double[]      m_diagR;        // of the linear columns
+		private final double[]      m_rhs;
+		private final double[]      m_column;
+		
+		// constructor
+		private VarProJacobian(final FcnJacobian full) {
 			
-			int rowDimension = m_region.widthChannels();
-			int colDimension = m_fitVary.getVaryCount();
-			RealMatrix jacobian = new Array2DRowRealMatrix(
-					rowDimension, colDimension);
-						
-			// loop over columns
-			int colIndex = 0;
+			m_full = full;
+			m_fullX = full.m_start.clone();
 			
-			if (m_fitVary.bckInterceptVaries()) {
-				// make a vector of all 1's and copy to matrix
-				// after dividing by negative spectrum uncertainty
-				double[] column = new double[rowDimension];
-				int chan = m_region.getFirstChannel();
-				for (int i = 0; i < rowDimension; i++, chan++) {
-					column[i] = 1;
-					column[i] = - column[i] / m_spectrum.getSigCountAt(chan);
-				}
-				jacobian.setColumn(colIndex, column);
-				colIndex++;
+			// linear columns in m_fullX order: intercept, slope, heights
+			int fullCount = m_fullX.length;
+			boolean[] isLinear = new boolean[fullCount];
+			if (0 <= full.m_interceptCol) {
+				isLinear[full.m_interceptCol] = true;
 			}
-			if (m_fitVary.bckSlopeVaries()) {
-				// make an array of row indices and copy to matrix
-				// after dividing by negative spectrum uncertainty
-				double[] column = new double[rowDimension];
-				int chan = m_region.getFirstChannel();
-				for (int i = 0; i < rowDimension; i++, chan++) {
-					column[i] = i;
-					column[i] = - column[i] / m_spectrum.getSigCountAt(chan);
-				}
-				jacobian.setColumn(colIndex, column);
-				colIndex++;
+			if (0 <= full.m_slopeCol) {
+				isLinear[full.m_slopeCol] = true;
 			}
-			if (m_fitVary.avgWidthVaries()) {
-				// set each row to sum of "2*y*muSquared/fwhm" of each peak
-				// divided by negative spectrum uncertainty
-				double[] column = new double[rowDimension];
-				int chan = m_region.getFirstChannel();
-				for (int i = 0; i < rowDimension; i++, chan++) {
-					column[i] = 0;
-					Iterator<PeakInfo> pit = m_fitInfo.getPeakIterator();
-					for ( ; pit.hasNext(); ) {
-						PeakInfo peakInfo = pit.next();
-						InlGaussian inlGaussian = new InlGaussian(peakInfo);
-						double gaussian = inlGaussian.valueConstrained(chan);
-						double mu = inlGaussian.mu(chan);
-						double addWidth511 = 0;
-						double fwhm = peakInfo.getFwhm();
-						if (0 != fwhm) {
-							addWidth511 = 2 * gaussian * mu * mu / fwhm;
-						}
-						column[i] += addWidth511;
+			for (int k = 0; k < full.m_heightCols.length; k++) {
+				if (0 <= full.m_heightCols[k]) {
+					isLinear[full.m_heightCols[k]] = true;
+				}
+			}
+			int linearCount = 0;
+			for (int j = 0; j < fullCount; j++) {
+				if (isLinear[j]) {
+					linearCount++;
+				}
+			}
+			
+			m_linearCols = new int[linearCount];
+			m_nonlinearCols = new int[fullCount - linearCount];
+			m_varProCols = new int[fullCount];
+			int l = 0;
+			int n = 0;
+			for (int j = 0; j < fullCount; j++) {
+				m_varProCols[j] = -1;
+				if (isLinear[j]) {
+					m_linearCols[l++] = j;
+				} else {
+					m_varProCols[j] = n;
+					m_nonlinearCols[n++] = j;
+				}
+			}
+			
+			m_start = new double[n];
+			for (int j = 0; j < n; j++) {
+				m_start[j] = m_fullX[m_nonlinearCols[j]];
+			}
+			if (null != full.m_lowerBounds) {
+				m_lowerBounds = new double[n];
+				m_upperBounds = new double[n];
+				for (int j = 0; j < n; j++) {
+					m_lowerBounds[j] = full.m_lowerBounds[m_nonlinearCols[j]];
+					m_upperBounds[j] = full.m_upperBounds[m_nonlinearCols[j]];
+				}
+			} else {
+				m_lowerBounds = null;
+				m_upperBounds = null;
+			}
+			m_maxEvaluations = 100 * (n + 1);
+			m_maxIterations = m_maxEvaluations;
+			
+			int rowDimension = full.m_counts.length;
+			m_weights = new double[rowDimension];
+			for (int i = 0; i < rowDimension; i++) {
+				m_weights[i] = 0;
+				if (0 != full.m_sigCounts[i]) {
+					m_weights[i] = 1.0 / full.m_sigCounts[i];
+				}
+			}
+			
+			int peakCount = full.m_heightCols.length;
+			m_peakMu = new double[peakCount][rowDimension];
+			m_peakExp = new double[peakCount][rowDimension];
+			m_windowFirst = new int[peakCount];
+			m_windowLast = new int[peakCount];
+			m_linear = new double[rowDimension][linearCount];
+			m_beta = new double[linearCount];
+			m_solvable = new boolean[linearCount];
+			m_diagR = new double[linearCount];
+			m_rhs = new double[rowDimension];
+			m_column = new double[rowDimension];
+		}
+		
+		// public methods
+		
+		public double[] getLowerBounds() {
+			return m_lowerBounds;
+		}
+		public int getMaxEvaluations() {
+			return m_maxEvaluations;
+		}
+		public int getMaxIterations() {
+			return m_maxIterations;
+		}
+		public int getObservationSize() {
+			return m_full.m_counts.length;
+		}
+		public double[] getStart() {
+			return m_start;
+		}
+		public double[] getUpperBounds() {
+			return m_upperBounds;
+		}
+		
+		/*
+		 * evaluate - solves the linear parameters for "X", then fills the
+		 *            weighted residuals and the projected Jacobian
+		 */
+		public void evaluate(final double[] X, double[] resid,
+				double[][] jacobian) {
+			
+			solveLinear(X);
+			
+			int rowDimension = resid.length;
+			double intercept = m_fitInfo.getBckIntercept();
+			double slope = m_fitInfo.getBckSlope();
+			int avgWidthCol = (0 <= m_full.m_avgWidthCol) ?
+					m_varProCols[m_full.m_avgWidthCol] : -1;
+			
+			// resid holds the fit until the last pass
+			for (int i = 0; i < rowDimension; i++) {
+				resid[i] = intercept + (slope * i);
+				Arrays.fill(jacobian[i], 0);
+			}
+			
+			int k = 0;
+			for (Iterator<PeakInfo> pit = m_fitInfo.getPeakIterator();
+				 pit.hasNext(); k++) {
+				PeakInfo peakInfo = pit.next();
+				
+				int centroidCol = (0 <= m_full.m_centroidCols[k]) ?
+						m_varProCols[m_full.m_centroidCols[k]] : -1;
+				int addWidth511Col = (0 <= m_full.m_addWidth511Cols[k]) ?
+						m_varProCols[m_full.m_addWidth511Cols[k]] : -1;
+				double heightCounts = peakInfo.getHeightCounts();
+				double fwhm = peakInfo.getFwhm();
+				double[] peakMu = m_peakMu[k];
+				double[] peakExp = m_peakExp[k];
+				
+				for (int i = m_windowFirst[k]; i <= m_windowLast[k]; i++) {
+					double[] row = jacobian[i];
+					
+					double mu = peakMu[i];
+					double gaussian = heightCounts * peakExp[i];
+					resid[i] += gaussian;
+					
+					double centroid = 0;
+					double addWidth511 = 0;
+					if (0 != fwhm) {
+						centroid = 2.0 * gaussian * mu *
+								InlGaussian.MU_FACTOR / fwhm;
+						addWidth511 = 2 * gaussian * mu * mu / fwhm;
+					}
+					if (0 <= avgWidthCol) {
+						row[avgWidthCol] += addWidth511;
+					}
+					if (0 <= centroidCol) {
+						row[centroidCol] = centroid;
+					}
+					if (0 <= addWidth511Col) {
+						row[addWidth511Col] = addWidth511;
 					}
-					column[i] = - column[i] / m_spectrum.getSigCountAt(chan);
 				}
-				jacobian.setColumn(colIndex, column);
-				colIndex++;
+			}
+			
+			for (int i = 0; i < rowDimension; i++) {
+				double weight = m_weights[i];
+				resid[i] = (m_full.m_counts[i] - resid[i]) * weight;
 				
+				double[] row = jacobian[i];
+				for (int j = 0; j < row.length; j++) {
+					row[j] = - row[j] * weight;
+				}
 			}
-
-			Iterator<PeakInfo> pit = m_fitInfo.getPeakIterator();
-			Iterator<PeakVary> pvt = m_fitVary.getPeakIterator();
-			for ( ; pit.hasNext() && pvt.hasNext(); ) {
+			
+			// the linear parameters follow the others, so only the part
+			// of each column outside the span of the linear columns is
+			// seen by the solver
+			for (int j = 0; j < m_start.length; j++) {
+				for (int i = 0; i < rowDimension; i++) {
+					m_column[i] = jacobian[i][j];
+				}
+				project(m_column);
+				for (int i = 0; i < rowDimension; i++) {
+					jacobian[i][j] = m_column[i];
+				}
+			}
+		}
+		
+		// private methods
+		
+		/*
+		 * applyReflection:
+		 *   routine that applies the Householder reflection of linear
+		 *   column "k" to "y"
+		 */
+		private void applyReflection(int k, double[] y) {
+			
+			if (0 == m_beta[k]) {
+				return;
+			}
+			
+			double gamma = 0;
+			for (int i = k; i < y.length; i++) {
+				gamma += m_linear[i][k] * y[i];
+			}
+			gamma *= m_beta[k];
+			for (int i = k; i < y.length; i++) {
+				y[i] -= gamma * m_linear[i][k];
+			}
+		}
+		
+		/*
+		 * project:
+		 *   routine that removes from "y" its part in the span of the
+		 *   solvable linear columns
+		 */
+		private void project(double[] y) {
+			
+			int linearCount = m_linearCols.length;
+			for (int k = 0; k < linearCount; k++) {
+				applyReflection(k, y);
+			}
+			for (int k = 0; k < linearCount; k++) {
+				if (m_solvable[k]) {
+					y[k] = 0;
+				}
+			}
+			for (int k = linearCount - 1; k >= 0; k--) {
+				applyReflection(k, y);
+			}
+		}
+		
+		/*
+		 * solveLinear:
+		 *   routine that sets the nonlinear parameters to "X", fits the
+		 *   background and the heights to the counts by least squares with
+		 *   them, and leaves the result in m_fullX and m_fitInfo. The peak
+		 *   shapes are kept in m_peakMu and m_peakExp, zero outside the
+		 *   windows in m_windowFirst and m_windowLast, and the factored
+		 *   linear columns in m_linear, for evaluate().
+		 */
+		private void solveLinear(final double[] X) {
+			
+			for (int j = 0; j < X.length; j++) {
+				m_fullX[m_nonlinearCols[j]] = X[j];
+			}
+			m_fitInfo.update(m_fullX, m_fitVary);
+			
+			int rowDimension = m_rhs.length;
+			int firstChannel = m_region.getFirstChannel();
+			
+			// the fixed part of the fit goes into the right hand side
+			for (int i = 0; i < rowDimension; i++) {
+				m_rhs[i] = 0;
+				if (0 > m_full.m_interceptCol) {
+					m_rhs[i] += m_fitInfo.getBckIntercept();
+				}
+				if (0 > m_full.m_slopeCol) {
+					m_rhs[i] += m_fitInfo.getBckSlope() * i;
+				}
+			}
+			
+			int l = 0;
+			if (0 <= m_full.m_interceptCol) {
+				for (int i = 0; i < rowDimension; i++) {
+					m_linear[i][l] = m_weights[i];
+				}
+				l++;
+			}
+			if (0 <= m_full.m_slopeCol) {
+				for (int i = 0; i < rowDimension; i++) {
+					m_linear[i][l] = m_weights[i] * i;
+				}
+				l++;
+			}
+			
+			int k = 0;
+			for (Iterator<PeakInfo> pit = m_fitInfo.getPeakIterator();
+				 pit.hasNext(); k++) {
 				PeakInfo peakInfo = pit.next();
-				PeakVary peakVary = pvt.next();
 				
-				InlGaussian inlGaussian = new InlGaussian(peakInfo);
-
-				if (peakVary.heightCountsVaries()) {
-					
-					// set each row to exp(-muSquared)
-					// divided by negative spectrum uncertainty
-					double[] column = new double[rowDimension];
-					int chan = m_region.getFirstChannel();
-					for (int i = 0; i < rowDimension; i++, chan++) {
-						double mu = inlGaussian.mu(chan);
-						double muConstrained = InlGaussian.muConstrained(mu);
-						column[i] = InlGaussian.expNegMuSquared(muConstrained);
-						
-						column[i] = -  column[i]/
-								m_spectrum.getSigCountAt(chan);
+				double centroidChannels = peakInfo.getCentroidChannels();
+				double fwhm = peakInfo.getFwhm();
+				double[] peakMu = m_peakMu[k];
+				double[] peakExp = m_peakExp[k];
+				int first = InlGaussian.windowFirst(firstChannel, 1,
+						rowDimension, centroidChannels, fwhm);
+				int last = InlGaussian.windowLast(firstChannel, 1,
+						rowDimension, centroidChannels, fwhm);
+				m_windowFirst[k] = first;
+				m_windowLast[k] = last;
+				
+				Arrays.fill(peakMu, 0);
+				Arrays.fill(peakExp, 0);
+				int chan = firstChannel + first;
+				for (int i = first; i <= last; i++, chan++) {
+					peakMu[i] = InlGaussian.mu(chan, centroidChannels, fwhm);
+				}
+				InlGaussian.expNegMuSquaredConstrained(peakMu, peakExp,
+						first, last);
+				
+				if (0 <= m_full.m_heightCols[k]) {
+					for (int i = 0; i < rowDimension; i++) {
+						m_linear[i][l] = m_weights[i] * peakExp[i];
+					}
+					l++;
+				} else {
+					double heightCounts = peakInfo.getHeightCounts();
+					for (int i = first; i <= last; i++) {
+						m_rhs[i] += heightCounts * peakExp[i];
 					}
-					jacobian.setColumn(colIndex, column);
-					colIndex++;
 				}
-				if (peakVary.centroidChannelsVaries()) {
-					// set each row to 2*y*mu*factor / fwhm
-					// divided by negative spectrum uncertainty
-					double[] column = new double[rowDimension];
-					int chan = m_region.getFirstChannel();
-					for (int i = 0; i < rowDimension; i++, chan++) {
-						double gaussian = inlGaussian.valueConstrained(chan);
-						double mu = inlGaussian.mu(chan);
-						double centroid = 0;
-						double fwhm = peakInfo.getFwhm();
-						if (0 != fwhm) {
-							centroid = 2.0 * gaussian * mu *
-									InlGaussian.MU_FACTOR / fwhm;
-						}
-						column[i] = centroid;
-						column[i] = - column[i] /
-								m_spectrum.getSigCountAt(chan);
+			}
+			
+			for (int i = 0; i < rowDimension; i++) {
+				m_rhs[i] = (m_full.m_counts[i] - m_rhs[i]) * m_weights[i];
+			}
+			
+			// Householder QR of the linear columns, as LmderSolver does
+			// it but without pivoting
+			int linearCount = m_linearCols.length;
+			for (k = 0; k < linearCount; k++) {
+				double norm2 = 0;
+				for (int i = k; i < rowDimension; i++) {
+					norm2 += m_linear[i][k] * m_linear[i][k];
+				}
+				double columnNorm2 = norm2;
+				for (int i = 0; i < k; i++) {
+					columnNorm2 += m_linear[i][k] * m_linear[i][k];
+				}
+				double alpha = (m_linear[k][k] > 0) ?
+						-Math.sqrt(norm2) : Math.sqrt(norm2);
+				m_solvable[k] = (Math.abs(alpha) >
+						RANK_THRESHOLD * Math.sqrt(columnNorm2));
+				m_diagR[k] = alpha;
+				m_beta[k] = 0;
+				if (0 == alpha) {
+					continue;
+				}
+				
+				m_beta[k] = 1.0 / (norm2 - m_linear[k][k] * alpha);
+				m_linear[k][k] -= alpha;
+				for (int j = k + 1; j < linearCount; j++) {
+					double gamma = 0;
+					for (int i = k; i < rowDimension; i++) {
+						gamma += m_linear[i][k] * m_linear[i][j];
+					}
+					gamma *= m_beta[k];
+					for (int i = k; i < rowDimension; i++) {
+						m_linear[i][j] -= gamma * m_linear[i][k];
 					}
-					jacobian.setColumn(colIndex, column);
-					colIndex++;
 				}
-				if (peakVary.addWidth511Varies()) {
-					// set each row to 2*y*muSquared / fwhm
-					// divided by negative spectrum uncertainty
-					double[] column = new double[rowDimension];
-					int chan = m_region.getFirstChannel();
-					for (int i = 0; i < rowDimension; i++, chan++) {
-						double gaussian = inlGaussian.valueConstrained(chan);
-						double mu = inlGaussian.mu(chan);
-						double addWidth511 = 0;
-						double fwhm = peakInfo.getFwhm();
-						if (0 != fwhm) {
-							addWidth511 = 2 * gaussian * mu * mu / fwhm;
-						}
-						column[i] = - addWidth511 /
-								m_spectrum.getSigCountAt(chan);
+			}
+			
+			// Qt.rhs, then back substitution; a column that is not
+			// solvable gets 0
+			for (k = 0; k < linearCount; k++) {
+				applyReflection(k, m_rhs);
+			}
+			for (k = linearCount - 1; k >= 0; k--) {
+				double coefficient = 0;
+				if (m_solvable[k]) {
+					double sum = m_rhs[k];
+					for (int j = k + 1; j < linearCount; j++) {
+						sum -= m_linear[k][j] * m_fullX[m_linearCols[j]];
 					}
-					jacobian.setColumn(colIndex, column);
-					colIndex++;
+					coefficient = sum / m_diagR[k];
 				}
+				m_fullX[m_linearCols[k]] = coefficient;
 			}
-									
-			return jacobian;
+			m_fitInfo.update(m_fullX, m_fitVary);
 		}
-	} // FcnJacobian
+	} // VarProJacobian
 }
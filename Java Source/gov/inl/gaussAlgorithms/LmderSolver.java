@@ -0,0 +1,1178 @@
+/*
+ * Copyright 2017 Battelle Energy Alliance
+ */
+/*
+ *  Gauss Algorithms
+ *
+ *  File Name: LmderSolver.java
+ *
+ *  Description: Levenberg-Marquardt solver for the region fits
+ */
+package gov.inl.gaussAlgorithms;
+
+import java.util.Arrays;
+
+import org.apache.commons.math3.linear.Array2DRowRealMatrix;
+import org.apache.commons.math3.linear.RealMatrix;
+import org.apache.commons.math3.linear.SingularMatrixException;
+import org.apache.commons.math3.util.Precision;
+
+/**
+ * the "lmder" (Levenberg-Marquardt) least squares solver used to fit
+ * regions. This is the algorithm of the Apache Commons Math
+ * LevenbergMarquardtOptimizer (a translation of MINPACK lmder), step for
+ * step, so the fits and the ftol/xtol tests are the same. It works on
+ * plain arrays that are allocated once per fit, and the model fills the
+ * values and the Jacobian in one call.
+ *
+ * A problem may give bounds on its parameters. The start and every trial
+ * point are then projected onto the bounds, and the predicted reduction
+ * is that of the projected step, so a parameter that the model pushes
+ * against its bound stays there and the fit converges at the bound.
+ *
+ * When most columns of the Jacobian are nonzero only in a window of
+ * rows, as those of narrow peaks in a wide region are, it is factored by
+ * Givens rotations one row at a time instead of by the dense Householder
+ * QR, so the work grows with the number of peaks instead of its square.
+ *
+ */
+public class LmderSolver {
+
+	private final static double TWO_EPS = 2 * Precision.EPSILON;
+
+	// see bandedDecomposition(): entries of a column not larger than
+	// SPARSE_DROP times its largest one are outside its window, a column
+	// whose window is more than DENSE_FRACTION of the rows is full, and
+	// the banded factorization is used for at least BANDED_MIN_COLUMNS
+	// columns whose windows cover at most DENSE_FRACTION of the jacobian
+	private final static double SPARSE_DROP =
+			Precision.EPSILON * Precision.EPSILON;
+	private final static double DENSE_FRACTION = 0.5;
+	private final static int BANDED_MIN_COLUMNS = 12;
+
+	/**
+	 * the problem to solve: minimize the sum of squares of the model
+	 * values, which are weighted residuals (the target is all zeros)
+	 *
+	 */
+	public interface Problem {
+
+		int getMaxEvaluations();
+		int getMaxIterations();
+		int getObservationSize();
+		double[] getStart();
+
+		/*
+		 * getLowerBounds, getUpperBounds - the smallest and largest
+		 *                                  value of each parameter, or
+		 *                                  null if the parameters are
+		 *                                  not bounded
+		 */
+		double[] getLowerBounds();
+		double[] getUpperBounds();
+
+		/*
+		 * evaluate - fills the model values and the Jacobian of the
+		 *            model at "point"
+		 */
+		void evaluate(final double[] point, double[] value,
+				double[][] jacobian);
+	}
+
+	// member data
+
+	private final double     m_initialStepBoundFactor;
+	private final double     m_costRelativeTolerance;
+	private final double     m_parRelativeTolerance;
+	private final double     m_orthoTolerance;
+	private final double     m_qrRankingThreshold;
+
+	private int              m_evaluations;
+	private int              m_iterations;
+	private double[][]       m_jacobian;     // at the solution
+
+	// work arrays for one fit, see optimize()
+	private int              m_nR;
+	private int              m_nC;
+	private double[][]       m_weightedJacobian;
+	private int[]            m_permutation;
+	private int              m_rank;
+	private double[]         m_diagR;
+	private double[]         m_jacNorm;
+	private double[]         m_beta;
+	private boolean          m_factorizationCurrent;  // of m_jacobian
+
+	// work arrays of bandedDecomposition()
+	private int[]            m_firstRow;
+	private int[]            m_lastRow;
+	private int[]            m_rowEnd;
+	private double[][]       m_bandedR;
+	private double[]         m_givensRow;
+
+	// constructor
+
+	public LmderSolver(double initialStepBoundFactor,
+			double costRelativeTolerance, double parRelativeTolerance,
+			double orthoTolerance, double qrRankingThreshold) {
+
+		m_initialStepBoundFactor = initialStepBoundFactor;
+		m_costRelativeTolerance = costRelativeTolerance;
+		m_parRelativeTolerance = parRelativeTolerance;
+		m_orthoTolerance = orthoTolerance;
+		m_qrRankingThreshold = qrRankingThreshold;
+
+		m_evaluations = 0;
+		m_iterations = 0;
+		m_jacobian = null;
+		m_factorizationCurrent = false;
+	}
+
+	// public methods
+
+	/*
+	 * getCovariances - covariance matrix of the parameters at the
+	 *                  solution, the inverse of transpose(J)J. With
+	 *                  JP = QR from the solver's pivoted factorization it
+	 *                  is P inverse(R) transpose(inverse(R)) transpose(P),
+	 *                  so transpose(J)J is neither formed nor inverted.
+	 *                  The last factorization is used when it is of the
+	 *                  Jacobian at the solution; otherwise J is factored
+	 *                  once more. Throws SingularMatrixException if J is
+	 *                  rank deficient or a diagonal element of R is not
+	 *                  larger than "threshold" in magnitude.
+	 */
+	public RealMatrix getCovariances(double threshold) {
+
+		final int nC = m_nC;
+		if (!m_factorizationCurrent) {
+			try {
+				if (!bandedDecomposition(m_jacobian, null, null)) {
+					qrDecomposition(m_jacobian, Math.min(m_nR, nC));
+				}
+			} catch (Exception e) {
+				throw new IllegalStateException(e.getMessage());
+			}
+			m_factorizationCurrent = true;
+		}
+		if (m_rank < nC) {
+			throw new SingularMatrixException();
+		}
+
+		// R in pivoted order: the diagonal is kept in m_diagR, the
+		// rest above it in m_weightedJacobian
+		final int[] permutation = m_permutation;
+		double[][] r = new double[nC][nC];
+		for (int j = 0; j < nC; ++j) {
+			int pj = permutation[j];
+			for (int i = 0; i < j; ++i) {
+				r[i][j] = m_weightedJacobian[i][pj];
+			}
+			r[j][j] = m_diagR[pj];
+			if (Math.abs(r[j][j]) <= threshold) {
+				throw new SingularMatrixException();
+			}
+		}
+
+		// inverse of R by back substitution, column by column;
+		// it is upper triangular too
+		double[][] rInv = new double[nC][nC];
+		for (int j = 0; j < nC; ++j) {
+			rInv[j][j] = 1.0 / r[j][j];
+			for (int i = j - 1; i >= 0; --i) {
+				double sum = 0;
+				for (int k = i + 1; k <= j; ++k) {
+					sum += r[i][k] * rInv[k][j];
+				}
+				rInv[i][j] = -sum / r[i][i];
+			}
+		}
+
+		// covariance of parameters pa and pb is the dot product of
+		// rows a and b of inverse(R)
+		double[][] covariances = new double[nC][nC];
+		for (int a = 0; a < nC; ++a) {
+			for (int b = a; b < nC; ++b) {
+				double sum = 0;
+				for (int k = b; k < nC; ++k) {
+					sum += rInv[a][k] * rInv[b][k];
+				}
+				covariances[permutation[a]][permutation[b]] = sum;
+				covariances[permutation[b]][permutation[a]] = sum;
+			}
+		}
+
+		return new Array2DRowRealMatrix(covariances, false);
+	}
+
+	/*
+	 * evaluateAt - evaluates "problem" once at "point", without solving,
+	 *              so that getCovariances() is of the Jacobian there. Used
+	 *              when "point" was found by another solver, see
+	 *              LmderFcn.getVarProProblem().
+	 */
+	public void evaluateAt(Problem problem, final double[] point) {
+
+		allocate(problem.getObservationSize(), point.length);
+		m_evaluations = 1;
+		m_iterations = 0;
+		problem.evaluate(point, new double[m_nR], m_jacobian);
+	}
+
+	public int getEvaluations() {
+		return m_evaluations;
+	}
+
+	public int getIterations() {
+		return m_iterations;
+	}
+
+	/*
+	 * optimize - runs the fit and returns the parameters at the solution.
+	 *            Throws if the evaluation or iteration limit is passed,
+	 *            or the tolerances are too small to be met.
+	 */
+	public double[] optimize(Problem problem) throws Exception {
+
+		double[] currentPoint = problem.getStart().clone();
+		final double[] lower = problem.getLowerBounds();
+		final double[] upper = problem.getUpperBounds();
+		if (null != lower) {
+			for (int j = 0; j < currentPoint.length; ++j) {
+				currentPoint[j] = project(currentPoint[j], lower[j],
+						upper[j]);
+			}
+		}
+
+		allocate(problem.getObservationSize(), currentPoint.length);
+		final int nR = m_nR;
+		final int nC = m_nC;
+		final int maxEvaluations = problem.getMaxEvaluations();
+		final int maxIterations = problem.getMaxIterations();
+		final int solvedCols  = Math.min(nR, nC);
+
+		m_evaluations = 0;
+		m_iterations = 0;
+
+		// everything the iterations need is allocated here, once;
+		// the Jacobian of the last accepted point and the Jacobian of
+		// the trial point swap when a step is accepted
+		double[][] trialJacobian = new double[nR][nC];
+		double[] value = new double[nR];
+		double[] currentResiduals = new double[nR];
+
+		double[] lmDir = new double[nC];
+		double lmPar = 0;
+		double delta = 0;
+		double xNorm = 0;
+		double[] diag = new double[nC];
+		double[] oldX = new double[nC];
+		double[] qtf = new double[nR];
+		double[] work1 = new double[nC];
+		double[] work2 = new double[nC];
+		double[] work3 = new double[nC];
+
+		// evaluate the function at the starting point and calculate
+		// its norm
+		incrementEvaluations(maxEvaluations);
+		problem.evaluate(currentPoint, value, m_jacobian);
+		double currentCost = getResiduals(value, currentResiduals);
+
+		boolean firstIteration = true;
+		while (true) {
+			incrementIterations(maxIterations);
+
+			// QR decomposition of the jacobian matrix and Qt.res
+			if (!bandedDecomposition(m_jacobian, currentResiduals, qtf)) {
+				qrDecomposition(m_jacobian, solvedCols);
+
+				for (int i = 0; i < nR; i++) {
+					qtf[i] = currentResiduals[i];
+				}
+				qTy(qtf);
+			}
+			m_factorizationCurrent = true;
+
+			// now we don't need Q anymore, so let jacobian contain the
+			// R matrix with its diagonal elements
+			for (int k = 0; k < solvedCols; ++k) {
+				int pk = m_permutation[k];
+				m_weightedJacobian[k][pk] = m_diagR[pk];
+			}
+
+			if (firstIteration) {
+				// scale the point according to the norms of the columns
+				// of the initial jacobian
+				xNorm = 0;
+				for (int k = 0; k < nC; ++k) {
+					double dk = m_jacNorm[k];
+					if (dk == 0) {
+						dk = 1.0;
+					}
+					double xk = dk * currentPoint[k];
+					xNorm  += xk * xk;
+					diag[k] = dk;
+				}
+				xNorm = Math.sqrt(xNorm);
+
+				// initialize the step bound delta
+				delta = (xNorm == 0) ? m_initialStepBoundFactor :
+						(m_initialStepBoundFactor * xNorm);
+			}
+
+			// check orthogonality between function vector and jacobian
+			// columns
+			double maxCosine = 0;
+			if (currentCost != 0) {
+				for (int j = 0; j < solvedCols; ++j) {
+					int pj = m_permutation[j];
+					double s = m_jacNorm[pj];
+					if (s != 0) {
+						double sum = 0;
+						for (int i = 0; i <= j; ++i) {
+							sum += m_weightedJacobian[i][pj] * qtf[i];
+						}
+						maxCosine = Math.max(maxCosine,
+								Math.abs(sum) / (s * currentCost));
+					}
+				}
+			}
+			if (maxCosine <= m_orthoTolerance) {
+				// convergence has been reached
+				return currentPoint;
+			}
+
+			// rescale if necessary
+			for (int j = 0; j < nC; ++j) {
+				diag[j] = Math.max(diag[j], m_jacNorm[j]);
+			}
+
+			// inner loop
+			for (double ratio = 0; ratio < 1.0e-4; ) {
+
+				// save the state
+				for (int j = 0; j < solvedCols; ++j) {
+					int pj = m_permutation[j];
+					oldX[pj] = currentPoint[pj];
+				}
+				final double previousCost = currentCost;
+
+				// determine the Levenberg-Marquardt parameter
+				lmPar = determineLMParameter(qtf, delta, diag, solvedCols,
+						work1, work2, work3, lmDir, lmPar);
+
+				// compute the new point and the norm of the evolution
+				// direction; a bounded step is cut back to the bounds
+				double lmNorm = 0;
+				boolean projected = false;
+				for (int j = 0; j < solvedCols; ++j) {
+					int pj = m_permutation[j];
+					lmDir[pj] = -lmDir[pj];
+					currentPoint[pj] = oldX[pj] + lmDir[pj];
+					if (null != lower) {
+						double x = project(currentPoint[pj], lower[pj],
+								upper[pj]);
+						if (x != currentPoint[pj]) {
+							currentPoint[pj] = x;
+							lmDir[pj] = x - oldX[pj];
+							projected = true;
+						}
+					}
+					double s = diag[pj] * lmDir[pj];
+					lmNorm  += s * s;
+				}
+				lmNorm = Math.sqrt(lmNorm);
+				// on the first iteration, adjust the initial step bound
+				if (firstIteration) {
+					delta = Math.min(delta, lmNorm);
+				}
+
+				// evaluate the function at x + p and calculate its norm
+				incrementEvaluations(maxEvaluations);
+				problem.evaluate(currentPoint, value, trialJacobian);
+				currentCost = getResiduals(value, currentResiduals);
+
+				// compute the scaled actual reduction
+				double actRed = -1.0;
+				if (0.1 * currentCost < previousCost) {
+					double r = currentCost / previousCost;
+					actRed = 1.0 - r * r;
+				}
+
+				// compute the scaled predicted reduction and the scaled
+				// directional derivative
+				for (int j = 0; j < solvedCols; ++j) {
+					int pj = m_permutation[j];
+					double dirJ = lmDir[pj];
+					work1[j] = 0;
+					for (int i = 0; i <= j; ++i) {
+						work1[i] += m_weightedJacobian[i][pj] * dirJ;
+					}
+				}
+				double coeff1 = 0;
+				for (int j = 0; j < solvedCols; ++j) {
+					coeff1 += work1[j] * work1[j];
+				}
+				double pc2 = previousCost * previousCost;
+				coeff1 /= pc2;
+				double coeff2 = lmPar * lmNorm * lmNorm / pc2;
+				double preRed = coeff1 + 2 * coeff2;
+				double dirDer = -(coeff1 + coeff2);
+				if (projected) {
+					// the cut step does not solve the damped problem, so
+					// take the reduction of the linear model directly:
+					// the residuals become Qt.res + R.p. A cut step that
+					// is not downhill is rejected below.
+					double qtfDotRp = 0;
+					for (int j = 0; j < solvedCols; ++j) {
+						qtfDotRp += qtf[j] * work1[j];
+					}
+					qtfDotRp /= pc2;
+					preRed = -(2 * qtfDotRp + coeff1);
+					dirDer = Math.min(qtfDotRp, 0);
+				}
+
+				// ratio of the actual to the predicted reduction
+				ratio = (preRed <= 0) ? 0 : (actRed / preRed);
+
+				// update the step bound
+				if (ratio <= 0.25) {
+					double tmp = (actRed < 0) ?
+							(0.5 * dirDer / (dirDer + 0.5 * actRed)) : 0.5;
+					if ((0.1 * currentCost >= previousCost) || (tmp < 0.1)) {
+						tmp = 0.1;
+					}
+					delta = tmp * Math.min(delta, 10.0 * lmNorm);
+					lmPar /= tmp;
+				} else if ((lmPar == 0) || (ratio >= 0.75)) {
+					delta = 2 * lmNorm;
+					lmPar *= 0.5;
+				}
+
+				// test for successful iteration
+				if (ratio >= 1.0e-4) {
+					// successful iteration, keep its jacobian and update
+					// the norm
+					double[][] acceptedJacobian = trialJacobian;
+					trialJacobian = m_jacobian;
+					m_jacobian = acceptedJacobian;
+					m_factorizationCurrent = false;
+
+					firstIteration = false;
+					xNorm = 0;
+					for (int k = 0; k < nC; ++k) {
+						double xK = diag[k] * currentPoint[k];
+						xNorm += xK * xK;
+					}
+					xNorm = Math.sqrt(xNorm);
+				} else {
+					// failed iteration, reset the previous values
+					currentCost = previousCost;
+					for (int j = 0; j < solvedCols; ++j) {
+						int pj = m_permutation[j];
+						currentPoint[pj] = oldX[pj];
+					}
+				}
+
+				// default convergence criteria
+				if ((Math.abs(actRed) <= m_costRelativeTolerance &&
+					 preRed <= m_costRelativeTolerance &&
+					 ratio <= 2.0) ||
+					delta <= m_parRelativeTolerance * xNorm) {
+					return currentPoint;
+				}
+
+				// tests for termination and stringent tolerances
+				if (Math.abs(actRed) <= TWO_EPS &&
+					preRed <= TWO_EPS &&
+					ratio <= 2.0) {
+					throw new Exception("cost relative tolerance is too " +
+							"small (" + m_costRelativeTolerance + "), no " +
+							"further reduction in the sum of squares is " +
+							"possible");
+				} else if (delta <= TWO_EPS * xNorm) {
+					throw new Exception("parameters relative tolerance " +
+							"is too small (" + m_parRelativeTolerance +
+							"), no further improvement in the approximate " +
+							"solution is possible");
+				} else if (maxCosine <= TWO_EPS) {
+					throw new Exception("orthogonality tolerance is too " +
+							"small (" + m_orthoTolerance + "), solution " +
+							"is orthogonal to the jacobian");
+				}
+			}
+		}
+	}
+
+	// private methods
+
+	/*
+	 * allocate:
+	 *   routine that allocates the Jacobian and the factorization arrays
+	 *   for a fit of "nR" observations and "nC" parameters
+	 */
+	private void allocate(int nR, int nC) {
+
+		m_nR = nR;
+		m_nC = nC;
+		m_weightedJacobian = new double[nR][nC];
+		m_permutation = new int[nC];
+		m_diagR = new double[nC];
+		m_jacNorm = new double[nC];
+		m_beta = new double[nC];
+		m_jacobian = new double[nR][nC];
+		m_factorizationCurrent = false;
+
+		m_firstRow = new int[nC];
+		m_lastRow = new int[nC];
+		m_rowEnd = new int[nC];
+		m_bandedR = new double[nC][nC + 1];
+		m_givensRow = new double[nC + 1];
+	}
+
+	/*
+	 * bandedDecomposition:
+	 *   routine that factors the negated jacobian as qrDecomposition()
+	 *   does, and puts Qt."residuals" in "qtf" unless "residuals" is
+	 *   null, when most of its columns are nonzero only in a window of
+	 *   rows. The columns are ordered by the first row of their window,
+	 *   with the full ones (background, average width) last, and each row
+	 *   is rotated into R with Givens rotations. A row then only touches
+	 *   the columns whose windows cover it, and R is banded apart from its
+	 *   last columns. Entries outside a window are below SPARSE_DROP of
+	 *   the column's largest one, so leaving them out changes R and Qt.res
+	 *   by less than rounding. There is no pivoting: it returns false for
+	 *   a jacobian that is small, mostly full or may be rank deficient,
+	 *   which qrDecomposition() must then factor.
+	 */
+	private boolean bandedDecomposition(final double[][] jacobian,
+			final double[] residuals, double[] qtf) {
+
+		final int nR = m_nR;
+		final int nC = m_nC;
+		if ((nC < BANDED_MIN_COLUMNS) || (nR < nC)) {
+			return false;
+		}
+
+		// find the window of rows of each column
+		final int[] first = m_firstRow;
+		final int[] last = m_lastRow;
+		long windowRows = 0;
+		for (int k = 0; k < nC; ++k) {
+			double largest = 0;
+			double norm2 = 0;
+			for (int i = 0; i < nR; ++i) {
+				double aik = jacobian[i][k];
+				norm2 += aik * aik;
+				largest = Math.max(largest, Math.abs(aik));
+			}
+			if ((largest == 0) || Double.isInfinite(norm2) ||
+				Double.isNaN(norm2)) {
+				return false;
+			}
+			m_jacNorm[k] = Math.sqrt(norm2);
+
+			double drop = SPARSE_DROP * largest;
+			int f = 0;
+			while (Math.abs(jacobian[f][k]) <= drop) {
+				++f;
+			}
+			int l = nR - 1;
+			while (Math.abs(jacobian[l][k]) <= drop) {
+				--l;
+			}
+			if ((l - f + 1) > (DENSE_FRACTION * nR)) {
+				f = 0;
+				l = nR - 1;
+			}
+			first[k] = f;
+			last[k] = l;
+			windowRows += l - f + 1;
+		}
+		if (windowRows > (DENSE_FRACTION * nR * nC)) {
+			return false;
+		}
+
+		// order the windowed columns by their first row, then the full
+		// ones; a windowed column is never full
+		final int[] permutation = m_permutation;
+		int sparse = 0;
+		for (int k = 0; k < nC; ++k) {
+			if ((last[k] - first[k] + 1) < nR) {
+				int j = sparse;
+				while ((j > 0) && (first[permutation[j - 1]] > first[k])) {
+					permutation[j] = permutation[j - 1];
+					--j;
+				}
+				permutation[j] = k;
+				++sparse;
+			}
+		}
+		int full = sparse;
+		for (int k = 0; k < nC; ++k) {
+			if ((last[k] - first[k] + 1) == nR) {
+				permutation[full] = k;
+				++full;
+			}
+		}
+
+		// r holds R in the new column order, and Qt.res in column nC;
+		// rowEnd is the last windowed column used by each row of R, -1
+		// while the row is empty
+		final double[][] r = m_bandedR;
+		final int[] rowEnd = m_rowEnd;
+		final double[] w = m_givensRow;
+		for (int k = 0; k < nC; ++k) {
+			Arrays.fill(r[k], 0);
+			rowEnd[k] = -1;
+		}
+		Arrays.fill(w, 0);
+
+		// rotate the rows into R in order; the windowed columns that
+		// cover row i lie in [a, b], and w is all zeros after each row
+		int a = 0;
+		int b = -1;
+		for (int i = 0; i < nR; ++i) {
+			final double[] row = jacobian[i];
+			while (((b + 1) < sparse) && (first[permutation[b + 1]] <= i)) {
+				++b;
+			}
+			while ((a <= b) && (last[permutation[a]] < i)) {
+				++a;
+			}
+			for (int c = a; c <= b; ++c) {
+				int pc = permutation[c];
+				if (last[pc] >= i) {
+					w[c] = -1 * row[pc];
+				}
+			}
+			for (int c = sparse; c < nC; ++c) {
+				w[c] = -1 * row[permutation[c]];
+			}
+			w[nC] = (null == residuals) ? 0 : residuals[i];
+
+			int end = b;
+			for (int k = a; k <= end; ++k) {
+				if (w[k] != 0) {
+					end = Math.max(end, rowEnd[k]);
+					rowEnd[k] = end;
+					givensRotation(r[k], w, k, end, sparse);
+				}
+			}
+			for (int k = sparse; k < nC; ++k) {
+				if (w[k] != 0) {
+					givensRotation(r[k], w, k, k, k + 1);
+				}
+			}
+			w[nC] = 0;
+		}
+
+		for (int k = 0; k < nC; ++k) {
+			double rkk = r[k][k];
+			if (rkk * rkk <= m_qrRankingThreshold) {
+				return false;
+			}
+		}
+
+		// store R and Qt.res as qrDecomposition() and qTy() leave them
+		for (int k = 0; k < nC; ++k) {
+			int pk = permutation[k];
+			m_diagR[pk] = r[k][k];
+			for (int c = k; c < nC; ++c) {
+				m_weightedJacobian[k][permutation[c]] = r[k][c];
+			}
+			if (null != qtf) {
+				qtf[k] = r[k][nC];
+			}
+		}
+		m_rank = nC;
+
+		return true;
+	}
+
+	/*
+	 * determineLMDirection:
+	 *   routine that solves the damped least squares system for the
+	 *   Levenberg-Marquardt direction, eliminating the diagonal matrix
+	 *   with Givens rotations
+	 */
+	private void determineLMDirection(double[] qy, double[] diag,
+			double[] lmDiag, int solvedCols, double[] work,
+			double[] lmDir) {
+
+		final int[] permutation = m_permutation;
+		final double[][] weightedJacobian = m_weightedJacobian;
+
+		// copy R and Qty to preserve input and initialize s;
+		// in particular, save the diagonal elements of R in lmDir
+		for (int j = 0; j < solvedCols; ++j) {
+			int pj = permutation[j];
+			for (int i = j + 1; i < solvedCols; ++i) {
+				weightedJacobian[i][pj] = weightedJacobian[j][permutation[i]];
+			}
+			lmDir[j] = m_diagR[pj];
+			work[j]  = qy[j];
+		}
+
+		// eliminate the diagonal matrix d using a Givens rotation
+		for (int j = 0; j < solvedCols; ++j) {
+
+			// prepare the row of d to be eliminated, locating the
+			// diagonal element using p from the Q.R. factorization
+			int pj = permutation[j];
+			double dpj = diag[pj];
+			if (dpj != 0) {
+				Arrays.fill(lmDiag, j + 1, lmDiag.length, 0);
+			}
+			lmDiag[j] = dpj;
+
+			// the transformations to eliminate the row of d modify only
+			// a single element of Qty beyond the first n, which is
+			// initially zero
+			double qtbpj = 0;
+			for (int k = j; k < solvedCols; ++k) {
+				int pk = permutation[k];
+
+				// determine a Givens rotation which eliminates the
+				// appropriate element in the current row of d
+				if (lmDiag[k] != 0) {
+
+					final double sin;
+					final double cos;
+					double rkk = weightedJacobian[k][pk];
+					if (Math.abs(rkk) < Math.abs(lmDiag[k])) {
+						final double cotan = rkk / lmDiag[k];
+						sin   = 1.0 / Math.sqrt(1.0 + cotan * cotan);
+						cos   = sin * cotan;
+					} else {
+						final double tan = lmDiag[k] / rkk;
+						cos = 1.0 / Math.sqrt(1.0 + tan * tan);
+						sin = cos * tan;
+					}
+
+					// compute the modified diagonal element of R and the
+					// modified element of (Qty,0)
+					weightedJacobian[k][pk] = cos * rkk + sin * lmDiag[k];
+					final double temp = cos * work[k] + sin * qtbpj;
+					qtbpj = -sin * work[k] + cos * qtbpj;
+					work[k] = temp;
+
+					// accumulate the tranformation in the row of s
+					for (int i = k + 1; i < solvedCols; ++i) {
+						double rik = weightedJacobian[i][pk];
+						final double temp2 = cos * rik + sin * lmDiag[i];
+						lmDiag[i] = -sin * rik + cos * lmDiag[i];
+						weightedJacobian[i][pk] = temp2;
+					}
+				}
+			}
+
+			// store the diagonal element of s and restore the
+			// corresponding diagonal element of R
+			lmDiag[j] = weightedJacobian[j][permutation[j]];
+			weightedJacobian[j][permutation[j]] = lmDir[j];
+		}
+
+		// solve the triangular system for z, if the system is singular,
+		// then obtain a least squares solution
+		int nSing = solvedCols;
+		for (int j = 0; j < solvedCols; ++j) {
+			if ((lmDiag[j] == 0) && (nSing == solvedCols)) {
+				nSing = j;
+			}
+			if (nSing < solvedCols) {
+				work[j] = 0;
+			}
+		}
+		if (nSing > 0) {
+			for (int j = nSing - 1; j >= 0; --j) {
+				int pj = permutation[j];
+				double sum = 0;
+				for (int i = j + 1; i < nSing; ++i) {
+					sum += weightedJacobian[i][pj] * work[i];
+				}
+				work[j] = (work[j] - sum) / lmDiag[j];
+			}
+		}
+
+		// permute the components of z back to components of lmDir
+		for (int j = 0; j < lmDir.length; ++j) {
+			lmDir[permutation[j]] = work[j];
+		}
+	}
+
+	/*
+	 * determineLMParameter:
+	 *   routine that finds the Levenberg-Marquardt parameter for which
+	 *   the scaled step is within 10% of the step bound delta, and
+	 *   leaves that step in lmDir
+	 */
+	private double determineLMParameter(double[] qy, double delta,
+			double[] diag, int solvedCols, double[] work1, double[] work2,
+			double[] work3, double[] lmDir, double lmPar) {
+
+		final double[][] weightedJacobian = m_weightedJacobian;
+		final int[] permutation = m_permutation;
+		final int rank = m_rank;
+		final double[] diagR = m_diagR;
+		final int nC = m_nC;
+
+		// compute and store in x the gauss-newton direction, if the
+		// jacobian is rank-deficient, obtain a least squares solution
+		for (int j = 0; j < rank; ++j) {
+			lmDir[permutation[j]] = qy[j];
+		}
+		for (int j = rank; j < nC; ++j) {
+			lmDir[permutation[j]] = 0;
+		}
+		for (int k = rank - 1; k >= 0; --k) {
+			int pk = permutation[k];
+			double ypk = lmDir[pk] / diagR[pk];
+			for (int i = 0; i < k; ++i) {
+				lmDir[permutation[i]] -= ypk * weightedJacobian[i][pk];
+			}
+			lmDir[pk] = ypk;
+		}
+
+		// evaluate the function at the origin, and test for acceptance
+		// of the Gauss-Newton direction
+		double dxNorm = 0;
+		for (int j = 0; j < solvedCols; ++j) {
+			int pj = permutation[j];
+			double s = diag[pj] * lmDir[pj];
+			work1[pj] = s;
+			dxNorm += s * s;
+		}
+		dxNorm = Math.sqrt(dxNorm);
+		double fp = dxNorm - delta;
+		if (fp <= 0.1 * delta) {
+			lmPar = 0;
+			return lmPar;
+		}
+
+		// if the jacobian is not rank deficient, the Newton step provides
+		// a lower bound, parl, for the zero of the function, otherwise
+		// set this bound to zero
+		double sum2;
+		double parl = 0;
+		if (rank == solvedCols) {
+			for (int j = 0; j < solvedCols; ++j) {
+				int pj = permutation[j];
+				work1[pj] *= diag[pj] / dxNorm;
+			}
+			sum2 = 0;
+			for (int j = 0; j < solvedCols; ++j) {
+				int pj = permutation[j];
+				double sum = 0;
+				for (int i = 0; i < j; ++i) {
+					sum += weightedJacobian[i][pj] * work1[permutation[i]];
+				}
+				double s = (work1[pj] - sum) / diagR[pj];
+				work1[pj] = s;
+				sum2 += s * s;
+			}
+			parl = fp / (delta * sum2);
+		}
+
+		// calculate an upper bound, paru, for the zero of the function
+		sum2 = 0;
+		for (int j = 0; j < solvedCols; ++j) {
+			int pj = permutation[j];
+			double sum = 0;
+			for (int i = 0; i <= j; ++i) {
+				sum += weightedJacobian[i][pj] * qy[i];
+			}
+			sum /= diag[pj];
+			sum2 += sum * sum;
+		}
+		double gNorm = Math.sqrt(sum2);
+		double paru = gNorm / delta;
+		if (paru == 0) {
+			paru = Precision.SAFE_MIN / Math.min(delta, 0.1);
+		}
+
+		// if the input par lies outside of the interval (parl,paru),
+		// set par to the closer endpoint
+		lmPar = Math.min(paru, Math.max(lmPar, parl));
+		if (lmPar == 0) {
+			lmPar = gNorm / dxNorm;
+		}
+
+		for (int countdown = 10; countdown >= 0; --countdown) {
+
+			// evaluate the function at the current value of lmPar
+			if (lmPar == 0) {
+				lmPar = Math.max(Precision.SAFE_MIN, 0.001 * paru);
+			}
+			double sPar = Math.sqrt(lmPar);
+			for (int j = 0; j < solvedCols; ++j) {
+				int pj = permutation[j];
+				work1[pj] = sPar * diag[pj];
+			}
+			determineLMDirection(qy, work1, work2, solvedCols, work3, lmDir);
+
+			dxNorm = 0;
+			for (int j = 0; j < solvedCols; ++j) {
+				int pj = permutation[j];
+				double s = diag[pj] * lmDir[pj];
+				work3[pj] = s;
+				dxNorm += s * s;
+			}
+			dxNorm = Math.sqrt(dxNorm);
+			double previousFP = fp;
+			fp = dxNorm - delta;
+
+			// if the function is small enough, accept the current value
+			// of lmPar, also test for the exceptional cases where parl
+			// is zero or the number of iterations has reached 10
+			if (Math.abs(fp) <= 0.1 * delta ||
+				(parl == 0 &&
+				 fp <= previousFP &&
+				 previousFP < 0)) {
+				return lmPar;
+			}
+
+			// compute the Newton correction
+			for (int j = 0; j < solvedCols; ++j) {
+				int pj = permutation[j];
+				work1[pj] = work3[pj] * diag[pj] / dxNorm;
+			}
+			for (int j = 0; j < solvedCols; ++j) {
+				int pj = permutation[j];
+				work1[pj] /= work2[j];
+				double tmp = work1[pj];
+				for (int i = j + 1; i < solvedCols; ++i) {
+					work1[permutation[i]] -= weightedJacobian[i][pj] * tmp;
+				}
+			}
+			sum2 = 0;
+			for (int j = 0; j < solvedCols; ++j) {
+				double s = work1[permutation[j]];
+				sum2 += s * s;
+			}
+			double correction = fp / (delta * sum2);
+
+			// depending on the sign of the function, update parl or paru
+			if (fp > 0) {
+				parl = Math.max(parl, lmPar);
+			} else if (fp < 0) {
+				paru = Math.min(paru, lmPar);
+			}
+
+			// compute an improved estimate for lmPar
+			lmPar = Math.max(parl, lmPar + correction);
+		}
+
+		return lmPar;
+	}
+
+	/*
+	 * getResiduals:
+	 *   routine that sets the residuals, target minus model with a zero
+	 *   target, and returns their norm
+	 */
+	private static double getResiduals(final double[] value,
+			double[] residuals) {
+
+		double cost = 0;
+		for (int i = 0; i < value.length; i++) {
+			residuals[i] = 0 - value[i];
+			cost += residuals[i] * residuals[i];
+		}
+
+		return Math.sqrt(cost);
+	}
+
+	/*
+	 * givensRotation:
+	 *   routine that rotates row "rk" of R and the row "w" so that w[k]
+	 *   becomes zero. Only columns k to "sparseEnd" and "denseStart" to
+	 *   the end of the rows, Qt.res included, can be nonzero in either.
+	 */
+	private static void givensRotation(double[] rk, double[] w, int k,
+			int sparseEnd, int denseStart) {
+
+		final double sin;
+		final double cos;
+		double rkk = rk[k];
+		if (Math.abs(rkk) < Math.abs(w[k])) {
+			final double cotan = rkk / w[k];
+			sin = 1.0 / Math.sqrt(1.0 + cotan * cotan);
+			cos = sin * cotan;
+		} else {
+			final double tan = w[k] / rkk;
+			cos = 1.0 / Math.sqrt(1.0 + tan * tan);
+			sin = cos * tan;
+		}
+		rk[k] = cos * rkk + sin * w[k];
+		w[k] = 0;
+
+		for (int j = k + 1; j <= sparseEnd; ++j) {
+			double rkj = rk[j];
+			rk[j] = cos * rkj + sin * w[j];
+			w[j] = -sin * rkj + cos * w[j];
+		}
+		for (int j = Math.max(denseStart, k + 1); j < rk.length; ++j) {
+			double rkj = rk[j];
+			rk[j] = cos * rkj + sin * w[j];
+			w[j] = -sin * rkj + cos * w[j];
+		}
+	}
+
+	private void incrementEvaluations(int maxEvaluations) throws Exception {
+
+		m_evaluations++;
+		if (m_evaluations > maxEvaluations) {
+			throw new Exception("maximal count (" + maxEvaluations +
+					") exceeded: evaluations");
+		}
+	}
+
+	private void incrementIterations(int maxIterations) throws Exception {
+
+		m_iterations++;
+		if (m_iterations > maxIterations) {
+			throw new Exception("maximal count (" + maxIterations +
+					") exceeded: iterations");
+		}
+
+		// a speculative fit cycle that is no longer wanted is interrupted
+		if (Thread.currentThread().isInterrupted()) {
+			throw new Exception("fit cancelled");
+		}
+	}
+
+	/*
+	 * project:
+	 *   routine that returns "x" moved onto [lower, upper]; the upper
+	 *   bound wins if they cross, as in PeakInfo.constrain()
+	 */
+	private static double project(double x, double lower, double upper) {
+
+		if (x < lower) {
+			x = lower;
+		}
+		if (x > upper) {
+			x = upper;
+		}
+
+		return x;
+	}
+
+	/*
+	 * qrDecomposition:
+	 *   routine that decomposes the negated jacobian into m_weightedJacobian
+	 *   with Householder transforms and column pivoting. The rank is the
+	 *   number of columns with a norm above the ranking threshold.
+	 */
+	private void qrDecomposition(final double[][] jacobian, int solvedCols)
+	throws Exception {
+
+		final double[][] weightedJacobian = m_weightedJacobian;
+		final int[] permutation = m_permutation;
+		final int nR = m_nR;
+		final int nC = m_nC;
+
+		// the weighted jacobian is -(W^(1/2) J)
+		for (int i = 0; i < nR; ++i) {
+			for (int k = 0; k < nC; ++k) {
+				weightedJacobian[i][k] = -1 * jacobian[i][k];
+			}
+		}
+
+		// initializations
+		for (int k = 0; k < nC; ++k) {
+			permutation[k] = k;
+			m_diagR[k] = 0;
+			m_beta[k] = 0;
+			double norm2 = 0;
+			for (int i = 0; i < nR; ++i) {
+				double akk = weightedJacobian[i][k];
+				norm2 += akk * akk;
+			}
+			m_jacNorm[k] = Math.sqrt(norm2);
+		}
+
+		// transform the matrix column after column
+		for (int k = 0; k < nC; ++k) {
+
+			// select the column with the greatest norm on active
+			// components
+			int nextColumn = -1;
+			double ak2 = Double.NEGATIVE_INFINITY;
+			for (int i = k; i < nC; ++i) {
+				double norm2 = 0;
+				for (int j = k; j < nR; ++j) {
+					double aki = weightedJacobian[j][permutation[i]];
+					norm2 += aki * aki;
+				}
+				if (Double.isInfinite(norm2) || Double.isNaN(norm2)) {
+					throw new Exception("unable to perform Q.R " +
+							"decomposition on the " + nR + "x" + nC +
+							" jacobian matrix");
+				}
+				if (norm2 > ak2) {
+					nextColumn = i;
+					ak2        = norm2;
+				}
+			}
+			if (ak2 <= m_qrRankingThreshold) {
+				m_rank = k;
+				return;
+			}
+			int pk = permutation[nextColumn];
+			permutation[nextColumn] = permutation[k];
+			permutation[k] = pk;
+
+			// choose alpha such that Hk.u = alpha ek
+			double akk = weightedJacobian[k][pk];
+			double alpha = (akk > 0) ? -Math.sqrt(ak2) : Math.sqrt(ak2);
+			double betak = 1.0 / (ak2 - akk * alpha);
+			m_beta[pk] = betak;
+
+			// transform the current column
+			m_diagR[pk] = alpha;
+			weightedJacobian[k][pk] -= alpha;
+
+			// transform the remaining columns
+			for (int dk = nC - 1 - k; dk > 0; --dk) {
+				double gamma = 0;
+				for (int j = k; j < nR; ++j) {
+					gamma += weightedJacobian[j][pk] *
+							weightedJacobian[j][permutation[k + dk]];
+				}
+				gamma *= betak;
+				for (int j = k; j < nR; ++j) {
+					weightedJacobian[j][permutation[k + dk]] -=
+							gamma * weightedJacobian[j][pk];
+				}
+			}
+		}
+
+		m_rank = solvedCols;
+	}
+
+	/*
+	 * qTy:
+	 *   routine that multiplies y by the transpose of Q from the last
+	 *   qrDecomposition()
+	 */
+	private void qTy(double[] y) {
+
+		final double[][] weightedJacobian = m_weightedJacobian;
+		final int[] permutation = m_permutation;
+		final int nR = m_nR;
+		final int nC = m_nC;
+
+		for (int k = 0; k < nC; ++k) {
+			int pk = permutation[k];
+			double gamma = 0;
+			for (int i = k; i < nR; ++i) {
+				gamma += weightedJacobian[i][pk] * y[i];
+			}
+			gamma *= m_beta[pk];
+			for (int i = k; i < nR; ++i) {
+				y[i] -= gamma * weightedJacobian[i][pk];
+			}
+		}
+	}
+}
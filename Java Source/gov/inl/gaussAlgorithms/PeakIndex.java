@@ -0,0 +1,186 @@
+/*
+ * Copyright 2017 Battelle Energy Alliance
+ */
+/*
+ *  Gauss Algorithms
+ *
+ *  File Name: PeakIndex.java
+ *
+ *  Description: channel-sorted index for finding the peaks in regions
+ */
+package gov.inl.gaussAlgorithms;
+
+import java.util.Arrays;
+import java.util.Comparator;
+import java.util.Iterator;
+import java.util.TreeSet;
+import java.util.Vector;
+
+/**
+ * the peaks with valid channels from a peak list, sorted by channel, so
+ * that the peaks in a region are found with a binary search instead of a
+ * scan of the whole list. Build it once per peak list; it does not see
+ * later changes to the list.
+ *
+ */
+public class PeakIndex {
+
+	// member data
+
+	private final Peak[]           m_peaks;
+	private final double[]         m_channels;
+
+	// constructor
+
+	public PeakIndex(final TreeSet<Peak> peaks) {
+
+		Vector<Peak> validPeaks = new Vector<Peak>();
+		for (Iterator<Peak> it = peaks.iterator(); it.hasNext(); ) {
+			Peak peak = it.next();
+			if (peak.isChannelValid()) {
+				validPeaks.add(peak);
+			}
+		}
+
+		m_peaks = validPeaks.toArray(new Peak[validPeaks.size()]);
+
+		// channel peaks come out of the TreeSet in channel order already,
+		// so only sort when energy peaks are mixed in
+		boolean sorted = true;
+		for (int i = 1; i < m_peaks.length; i++) {
+			if (m_peaks[i].getChannel() < m_peaks[i-1].getChannel()) {
+				sorted = false;
+				break;
+			}
+		}
+		if (!sorted) {
+			Arrays.sort(m_peaks, new Comparator<Peak>() {
+				public int compare(Peak peak1, Peak peak2) {
+					return Double.compare(peak1.getChannel(),
+							peak2.getChannel());
+				}
+			});
+		}
+
+		m_channels = new double[m_peaks.length];
+		for (int i = 0; i < m_peaks.length; i++) {
+			m_channels[i] = m_peaks[i].getChannel();
+		}
+	}
+
+	// public methods
+
+	/*
+	 * countInRange - number of peaks with first <= channel <= last
+	 */
+	public int countInRange(double firstChannel, double lastChannel) {
+
+		if (lastChannel < firstChannel) {
+			return 0;
+		}
+
+		return upperBound(lastChannel) - lowerBound(firstChannel);
+	}
+
+	/*
+	 * hasPeakIn - true if any peak is in the range, the same test as
+	 *             Peak.inChannelRange()
+	 */
+	public boolean hasPeakIn(final ChannelRange range) {
+
+		return (0 < countInRange(range.getFirstChannel(),
+				range.getLastChannel()));
+	}
+
+	/*
+	 * partition - peaks in each region, in the order of "regions". The
+	 *             regions come sorted from the TreeSet, so one sweep over
+	 *             the peaks serves them all.
+	 */
+	public Vector<TreeSet<Peak>> partition(
+			final TreeSet<ChannelRange> regions) {
+
+		Vector<TreeSet<Peak>> answer = new Vector<TreeSet<Peak>>();
+
+		int first = 0;
+		for (Iterator<ChannelRange> it = regions.iterator(); it.hasNext(); ) {
+			ChannelRange region = it.next();
+
+			// first channels never decrease, so neither does "first"
+			while ((first < m_channels.length) &&
+				   (m_channels[first] < region.getFirstChannel())) {
+				first++;
+			}
+
+			TreeSet<Peak> regionPeaks = new TreeSet<Peak>();
+			for (int i = first; (i < m_channels.length) &&
+					(m_channels[i] <= region.getLastChannel()); i++) {
+				regionPeaks.add(m_peaks[i]);
+			}
+			answer.add(regionPeaks);
+		}
+
+		return answer;
+	}
+
+	/*
+	 * peaksInRange - peaks that are in the range, the same answer as
+	 *                ChannelRange.peaksInRange() on the original list
+	 */
+	public TreeSet<Peak> peaksInRange(final ChannelRange range) {
+
+		TreeSet<Peak> answer = new TreeSet<Peak>();
+
+		int last = upperBound(range.getLastChannel());
+		for (int i = lowerBound(range.getFirstChannel()); i < last; i++) {
+			answer.add(m_peaks[i]);
+		}
+
+		return answer;
+	}
+
+	public int size() {
+
+		return m_peaks.length;
+	}
+
+	// private methods
+
+	/*
+	 * lowerBound - index of the first peak with channel >= "channel"
+	 */
+	private int lowerBound(double channel) {
+
+		int low = 0;
+		int high = m_channels.length;
+		while (low < high) {
+			int middle = (low + high) >>> 1;
+			if (m_channels[middle] < channel) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+
+		return low;
+	}
+
+	/*
+	 * upperBound - index of the first peak with channel > "channel"
+	 */
+	private int upperBound(double channel) {
+
+		int low = 0;
+		int high = m_channels.length;
+		while (low < high) {
+			int middle = (low + high) >>> 1;
+			if (m_channels[middle] <= channel) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+
+		return low;
+	}
+}
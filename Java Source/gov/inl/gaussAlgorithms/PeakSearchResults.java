@@ -24,14 +24,14 @@ public class PeakSearchResults {
 	
 	// maps the "raw" centroid to the search peak information
 	private final HashMap<Integer, SearchPeak>      m_peakRefinements;
-	private int[]                                   m_crossProducts;
+	private long[]                                  m_crossProducts;
 	
 	// constructor
 	
 	public PeakSearchResults() {
 		
 		m_peakRefinements = new HashMap<Integer, SearchPeak>();
-		m_crossProducts = new int[0];
+		m_crossProducts = new long[0];
 	}
 	
 	// public methods
@@ -42,7 +42,7 @@ public class PeakSearchResults {
 		m_peakRefinements.put(key, refinement);
 	}
 	
-	public int[] getCrossProducts() {
+	public long[] getCrossProducts() {
 		
 		return m_crossProducts;
 	}	
@@ -55,7 +55,7 @@ public class PeakSearchResults {
 		return peakList;
 	}
 	
-	public void setCrossProducts(int[] crossProducts) {
+	public void setCrossProducts(long[] crossProducts) {
 		
 		m_crossProducts = crossProducts;
 	}
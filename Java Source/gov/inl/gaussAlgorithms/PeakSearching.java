@@ -24,6 +24,8 @@ public class PeakSearching {
 	private final static int PS_MAX_PEAKWIDTH = 10;
 	private final static int PS_MIN_SQWAV = (PS_MIN_PEAKWIDTH * 3);	/* for peak search */
 	private final static int PS_MAX_FITWIDTH_ODD = 1001; /* for refining location of peak */
+	private final static int PS_MAX_LEVELS = 10;	/* for multi-resolution search */
+	private final static double PS_COARSE_FRACTION = .25;	/* of threshold, for coarse levels */
 
 
 	// constructor
@@ -151,7 +153,7 @@ public class PeakSearching {
 				(int) (3 * getSquareWaveWidth(wx, lastSearchChannel));
 				
 		int numChannels = spectrum.getCounts().length;
-		int[] crossProducts = new int[numChannels];
+		long[] crossProducts = new long[numChannels];
 		for (int i = 0; i < numChannels; i++) {
 			crossProducts[i] = 0;
 		}
@@ -161,23 +163,11 @@ public class PeakSearching {
 
 		// Determine first multiple of update interval after the start of the channels
 		// to be searched over.
-		
-		// increment "i" until the interval multiples exceed the starting point
-		int i = 1;
-		while (firstSearchChannel >= (PS_UPDATE_INTERVAL * i)) {
-			i++;
-		}
-		// now initialize the multiple of interval
-		int multInterval = PS_UPDATE_INTERVAL * i;
+		int multInterval = getFirstUpdateChannel(firstSearchChannel);
 		
 		// Make integer array of spectrum uncertainties for efficient
 		// use inside the cross product loop.
-		double[] uncertainties = spectrum.getSigCounts();
-		int numUncertainties = uncertainties.length;
-		int[] uncertaintiesInt = new int[numUncertainties];
-		for (int j = 0; j < numUncertainties; j++) {
-			uncertaintiesInt[j] = (int) uncertainties[j];
-		}
+		long[] uncertaintiesInt = getUncertaintiesInt(spectrum);
 		
 		// Make first guess at peak locations using cross product with
 		// zero area square wave.
@@ -188,37 +178,10 @@ public class PeakSearching {
 				multInterval += PS_UPDATE_INTERVAL;
 			}
 			
-			// Calculate the cross product of square wave and count uncertainties
-			// at "chan".
-			// 
-			// NOTE - GAUSS VII only used integer part of sigcount
-			
-			// from "chan" to "chan + sqwav_wid - 1"
-			int squareWaveY = -1;
-			int crossProduct = 0;
-			int pointer = chan - spectrum.getFirstChannel();
-			int top = pointer + squareWaveWidth;
-			for (; pointer < top; pointer++) {
-				crossProduct += squareWaveY * uncertaintiesInt[pointer];
-			}
-			
-			// from "chan + sqwav_wid" to "chan + (sqwav_wid * 2) - 1"
-			squareWaveY = 2;
-			top += squareWaveWidth;
-			for (; pointer < top; pointer++) {
-				crossProduct += squareWaveY * uncertaintiesInt[pointer];
-			}
-			
-			// from "chan + (sqwav_wid * 2)" to "chan + (sqwav_wid * 3) - 1"
-			squareWaveY = -1;
-			top += squareWaveWidth;
-			for (; pointer < top; pointer++) {
-				crossProduct += squareWaveY * uncertaintiesInt[pointer];
-			}
-			
 			// store cross product for this channel
-			pointer = chan - spectrum.getFirstChannel();
-			crossProducts[pointer] = crossProduct;
+			int pointer = chan - spectrum.getFirstChannel();
+			crossProducts[pointer] = getCrossProduct(uncertaintiesInt, pointer,
+					squareWaveWidth);
 			
 		} // end for (chan = firstSearchChannel...
 		PeakSearchResults results = new PeakSearchResults();
@@ -226,68 +189,208 @@ public class PeakSearching {
 		
 		// review cross products to find peaks
 		
-		TreeSet<Integer> rawPeakCentroids = new TreeSet<Integer>();
+		TreeSet<Integer> rawPeakCentroids = markRawPeaks(crossProducts, null,
+				spectrum, firstSearchChannel, hiChannel, wx, threshold);
 		
-		int passCount = 0;
-		int chan = firstSearchChannel + 2;
-		i = chan - spectrum.getFirstChannel();
-		for (; chan < hiChannel; i++, chan++) {
-			// calculate peak width
-			double peakWidth = getPeakWidth(wx, chan);
-			squareWaveWidth = getSquareWaveWidth(wx, chan);
+		// fine-tune peak locations using linear least-square fit
+		
+		refinePeaks(rawPeakCentroids, spectrum, wx, results);
+
+		return results;
+	}
+	
+	/*
+	 * searchMultiResolution - coarse-to-fine version of search for
+	 *                         spectra that are mostly smooth continuum.
+	 *
+	 * The count uncertainties are rebinned into a pyramid of "levels"
+	 * levels, each level summing pairs of bins of the level below it.
+	 * Starting at the coarsest level, the square wave cross product is
+	 * taken with the wave width scaled down to the bin size of the level,
+	 * and only the bins whose cross product reaches PS_COARSE_FRACTION of
+	 * the threshold are passed down, with a bin of padding on each side,
+	 * as candidate windows for the next finer level. A bin is always
+	 * passed down when the square wave is narrower than a bin, since the
+	 * wave cannot be resolved at that level.
+	 *
+	 * At full resolution, the cross product, peak marking and fitPeak
+	 * refinement are the same as in search, but they are only applied
+	 * inside the candidate windows. Cross products outside the windows are
+	 * returned as zero.
+	 *
+	 * The coarse screening is a heuristic and does not guarantee that
+	 * every peak found by search is found here. Use measureRecall to
+	 * compare the two searches on a reference spectrum before relying on
+	 * this mode. A "levels" of zero is the same as calling search.
+	 */
+	public static PeakSearchResults searchMultiResolution(Spectrum spectrum,
+			ChannelRange searchRange, WidthEquation wx, int threshold,
+			int levels) throws Exception {
+		
+		if ((levels < 0) || (levels > PS_MAX_LEVELS)) {
+			throw new Exception("bad number of levels");
+		}
+		if (0 == levels) {
+			return search(spectrum, searchRange, wx, threshold);
+		}
+		
+		int firstSearchChannel = searchRange.getFirstChannel();
+		int lastSearchChannel = searchRange.getLastChannel();
+		
+		if ((lastSearchChannel > spectrum.getLastChannel()) ||
+			(firstSearchChannel > lastSearchChannel)) {
+			throw new Exception("bad channel range");
+		}
+		if (threshold <= 0) {
+			throw new Exception("bad threshold");
+		}
+		
+		// calculate hiChannel to leave room for cross product
+		double hiChannel = lastSearchChannel -
+				(int) (3 * getSquareWaveWidth(wx, lastSearchChannel));
+		
+		int firstChannel = spectrum.getFirstChannel();
+		int firstUpdateChannel = getFirstUpdateChannel(firstSearchChannel);
+		long[] uncertaintiesInt = getUncertaintiesInt(spectrum);
+		
+		// build the pyramid of rebinned uncertainties
+		
+		long[][] pyramid = new long[levels + 1][];
+		pyramid[0] = uncertaintiesInt;
+		for (int level = 1; level <= levels; level++) {
+			long[] finer = pyramid[level - 1];
+			long[] coarser = new long[(finer.length + 1) / 2];
+			for (int j = 0; j < finer.length; j++) {
+				coarser[j / 2] += finer[j];
+			}
+			pyramid[level] = coarser;
+		}
+		
+		// every coarsest bin touching the search range is a candidate
+		
+		int firstPointer = firstSearchChannel - firstChannel;
+		int lastPointer = (int) Math.ceil(hiChannel) - 1 - firstChannel;
+		boolean[] candidates = new boolean[pyramid[levels].length];
+		for (int bin = Math.max(0, firstPointer >> levels);
+			 bin <= (lastPointer >> levels) && bin < candidates.length;
+			 bin++) {
+			candidates[bin] = true;
+		}
+		
+		// narrow the candidate windows one level at a time
+		
+		double coarseThreshold = PS_COARSE_FRACTION * threshold;
+		for (int level = levels; level > 0; level--) {
+			int binSize = 1 << level;
+			long[] bins = pyramid[level];
+			boolean[] finerCandidates = new boolean[pyramid[level - 1].length];
 			
-			if (peakWidth < PS_MAX_PEAKWIDTH) {
-				// use old algorithm for marking
+			for (int bin = 0; bin < bins.length; bin++) {
+				if (!candidates[bin]) {
+					continue;
+				}
 				
-			    // If previous cross product was greater than the threshold,
-			    // and this cross product is decreasing,
-			    // and previous two cross products were the same or increasing,
-			    // then record peak at 'previous chan + 3/2 of wave width'
-			    // because this is indexing from the left end of the square wave.
+				int chan = Math.max(firstSearchChannel,
+						(bin * binSize) + firstChannel);
+				int squareWaveWidth = getCrossProductWidth(wx,
+						firstSearchChannel, firstUpdateChannel, chan);
 				
-				if ((crossProducts[i-1] > threshold) &&
-					(crossProducts[i-1] > crossProducts[i]) &&
-					(crossProducts[i-1] >= crossProducts[i-2])) {
-					
-					int foundPeak = chan - 1 + (int) (1.5 * squareWaveWidth);
-					markRawPeak(rawPeakCentroids, foundPeak, peakWidth);
-					
-					passCount = 0;
+				boolean keep = true;
+				if (squareWaveWidth >= binSize) {
+					int coarseWidth = (int) Math.round(
+							(double) squareWaveWidth / binSize);
+					if ((bin + (3 * coarseWidth)) <= bins.length) {
+						// compare per channel of square wave, so the
+						// rounding of the coarse width does not matter
+						double crossProduct = getCrossProduct(bins, bin,
+								coarseWidth);
+						crossProduct *= (double) squareWaveWidth /
+								(coarseWidth * binSize);
+						keep = (crossProduct >= coarseThreshold);
+					}
 				}
-			} else {
-				// use new algorithm for wider peaks
 				
-				if (crossProducts[i] >= threshold) {
-					passCount++;
-				} else {
-					// cross product below threshold
-					
-					if (passCount > 0) {
-						// want to mark half-way back plus 3/2 of wave width
-						int foundPeak = (int) (chan -
-								(.5 * passCount) + (1.5 * squareWaveWidth));
-						markRawPeak(rawPeakCentroids, foundPeak, peakWidth);
-						
-						passCount = 0;
+				if (keep) {
+					int top = Math.min(finerCandidates.length - 1,
+							(2 * bin) + 3);
+					for (int j = Math.max(0, (2 * bin) - 2); j <= top; j++) {
+						finerCandidates[j] = true;
 					}
 				}
 			}
-		} // end for loop
+			
+			candidates = finerCandidates;
+		}
 		
-		// fine-tune peak locations using linear least-square fit
+		// full resolution cross product inside the candidate windows
 		
-		for (Iterator<Integer> it = rawPeakCentroids.iterator();
-			 it.hasNext(); ) {
-			Integer peak = it.next();
-			int rawChannel = peak.intValue();
-			double peakWidth = getPeakWidth(wx, rawChannel);
-			SearchPeak newPeak = fitPeak(rawChannel, peakWidth, spectrum);			
-			results.addPeak(newPeak);
+		int numChannels = spectrum.getCounts().length;
+		long[] crossProducts = new long[numChannels];
+		boolean[] computed = new boolean[numChannels];
+		int top = Math.min(Math.min(numChannels, candidates.length) - 1,
+				lastPointer);
+		for (int pointer = Math.max(0, firstPointer); pointer <= top;
+			 pointer++) {
+			if (candidates[pointer]) {
+				int squareWaveWidth = getCrossProductWidth(wx,
+						firstSearchChannel, firstUpdateChannel,
+						pointer + firstChannel);
+				crossProducts[pointer] = getCrossProduct(uncertaintiesInt,
+						pointer, squareWaveWidth);
+				computed[pointer] = true;
+			}
 		}
-
+		PeakSearchResults results = new PeakSearchResults();
+		results.setCrossProducts(crossProducts);
+		
+		// review cross products to find peaks
+		
+		TreeSet<Integer> rawPeakCentroids = markRawPeaks(crossProducts,
+				computed, spectrum, firstSearchChannel, hiChannel, wx,
+				threshold);
+		
+		// fine-tune peak locations using linear least-square fit
+		
+		refinePeaks(rawPeakCentroids, spectrum, wx, results);
+		
 		return results;
 	}
 	
+	/*
+	 * measureRecall - returns the fraction of the raw peaks found by
+	 *                 search that are also found by searchMultiResolution
+	 *                 with the same inputs. Returns 1 when search finds
+	 *                 no peaks.
+	 */
+	public static double measureRecall(Spectrum spectrum,
+			ChannelRange searchRange, WidthEquation wx, int threshold,
+			int levels) throws Exception {
+		
+		TreeSet<SearchPeak> fullPeaks = search(spectrum, searchRange, wx,
+				threshold).getSearchPeakList();
+		TreeSet<SearchPeak> coarsePeaks = searchMultiResolution(spectrum,
+				searchRange, wx, threshold, levels).getSearchPeakList();
+		
+		if (fullPeaks.isEmpty()) {
+			return 1.0;
+		}
+		
+		TreeSet<Integer> coarseCentroids = new TreeSet<Integer>();
+		for (Iterator<SearchPeak> it = coarsePeaks.iterator(); it.hasNext(); ) {
+			coarseCentroids.add(new Integer(it.next().getRawCentroid()));
+		}
+		
+		int found = 0;
+		for (Iterator<SearchPeak> it = fullPeaks.iterator(); it.hasNext(); ) {
+			Integer centroid = new Integer(it.next().getRawCentroid());
+			if (coarseCentroids.contains(centroid)) {
+				found++;
+			}
+		}
+		
+		return (double) found / fullPeaks.size();
+	}
+	
 	// private methods
 
 	/*
@@ -354,23 +457,23 @@ public class PeakSearching {
 
 		// estimate average background
 		
-		int[] counts = spectrum.getCounts();
+		long[] counts = spectrum.getCounts();
 		int firstChannel = spectrum.getFirstChannel();
-		int preAverageBack = 0;
+		long preAverageBack = 0;
 		int top = low - 1 - firstChannel;
 		for (int i = low - 5 - firstChannel; i <= top; i++) {
 			preAverageBack += counts[i];
 		}
 		preAverageBack = preAverageBack / 5;
 
-		int postAverageBack = 0;
+		long postAverageBack = 0;
 		top = high + 5 - firstChannel;
 		for (int i = high + 1 - firstChannel; i <= top; i++) {
 			postAverageBack += counts[i];
 		}
 		postAverageBack = postAverageBack / 5;
 		
-		int averageBack = Math.min(preAverageBack, postAverageBack);
+		long averageBack = Math.min(preAverageBack, postAverageBack);
 				
 		// Using the Gaussian shaped peak data, construct parabolic shaped
 		// peak data by taking the natural log of the number of counts
@@ -535,6 +638,176 @@ public class PeakSearching {
 		rawPeakCentroids.add(new Integer(newPeak));
 	}
 
+	/*
+	 * getCrossProduct - cross product of the square wave with the
+	 *                   uncertainties, starting at "pointer". The wave
+	 *                   is -1, 2, -1 over three blocks of "width" bins.
+	 *
+	 * NOTE - GAUSS VII only used integer part of sigcount
+	 */
+	private static long getCrossProduct(long[] uncertaintiesInt, int pointer,
+			int width) {
+		
+		// from "chan" to "chan + sqwav_wid - 1"
+		int squareWaveY = -1;
+		long crossProduct = 0;
+		int top = pointer + width;
+		for (; pointer < top; pointer++) {
+			crossProduct += squareWaveY * uncertaintiesInt[pointer];
+		}
+		
+		// from "chan + sqwav_wid" to "chan + (sqwav_wid * 2) - 1"
+		squareWaveY = 2;
+		top += width;
+		for (; pointer < top; pointer++) {
+			crossProduct += squareWaveY * uncertaintiesInt[pointer];
+		}
+		
+		// from "chan + (sqwav_wid * 2)" to "chan + (sqwav_wid * 3) - 1"
+		squareWaveY = -1;
+		top += width;
+		for (; pointer < top; pointer++) {
+			crossProduct += squareWaveY * uncertaintiesInt[pointer];
+		}
+		
+		return crossProduct;
+	}
+	
+	/*
+	 * getCrossProductWidth - square wave width that search uses at "chan",
+	 *                        which is only updated at multiples of
+	 *                        PS_UPDATE_INTERVAL
+	 */
+	private static int getCrossProductWidth(WidthEquation wx,
+			int firstSearchChannel, int firstUpdateChannel, int chan) {
+		
+		if (chan < firstUpdateChannel) {
+			return getSquareWaveWidth(wx, firstSearchChannel);
+		}
+		
+		int updateChannel = (chan / PS_UPDATE_INTERVAL) * PS_UPDATE_INTERVAL;
+		return getSquareWaveWidth(wx, updateChannel);
+	}
+	
+	/*
+	 * getFirstUpdateChannel - first multiple of the update interval after
+	 *                         the start of the channels to be searched over
+	 */
+	private static int getFirstUpdateChannel(int firstSearchChannel) {
+		
+		// increment "i" until the interval multiples exceed the starting point
+		int i = 1;
+		while (firstSearchChannel >= (PS_UPDATE_INTERVAL * i)) {
+			i++;
+		}
+		
+		return PS_UPDATE_INTERVAL * i;
+	}
+	
+	/*
+	 * getUncertaintiesInt - integer part of the spectrum's count
+	 *                       uncertainties
+	 */
+	private static long[] getUncertaintiesInt(Spectrum spectrum) {
+		
+		double[] uncertainties = spectrum.getSigCounts();
+		int numUncertainties = uncertainties.length;
+		long[] uncertaintiesInt = new long[numUncertainties];
+		for (int j = 0; j < numUncertainties; j++) {
+			uncertaintiesInt[j] = (long) uncertainties[j];
+		}
+		
+		return uncertaintiesInt;
+	}
+	
+	/*
+	 * markRawPeaks - review the cross products to find raw peak locations.
+	 *
+	 * When "computed" is not null, only the cross products it flags are
+	 * known, and the others are treated as below the threshold.
+	 */
+	private static TreeSet<Integer> markRawPeaks(long[] crossProducts,
+			boolean[] computed, Spectrum spectrum, int firstSearchChannel,
+			double hiChannel, WidthEquation wx, int threshold) {
+		
+		TreeSet<Integer> rawPeakCentroids = new TreeSet<Integer>();
+		
+		int passCount = 0;
+		int chan = firstSearchChannel + 2;
+		int i = chan - spectrum.getFirstChannel();
+		for (; chan < hiChannel; i++, chan++) {
+			if ((null != computed) && (!computed[i]) && (0 == passCount)) {
+				continue;
+			}
+			
+			// calculate peak width
+			double peakWidth = getPeakWidth(wx, chan);
+			int squareWaveWidth = getSquareWaveWidth(wx, chan);
+			
+			if (peakWidth < PS_MAX_PEAKWIDTH) {
+				// use old algorithm for marking
+				
+			    // If previous cross product was greater than the threshold,
+			    // and this cross product is decreasing,
+			    // and previous two cross products were the same or increasing,
+			    // then record peak at 'previous chan + 3/2 of wave width'
+			    // because this is indexing from the left end of the square wave.
+				
+				boolean known = (null == computed) ||
+						(computed[i] && computed[i-1] && computed[i-2]);
+				
+				if (known &&
+					(crossProducts[i-1] > threshold) &&
+					(crossProducts[i-1] > crossProducts[i]) &&
+					(crossProducts[i-1] >= crossProducts[i-2])) {
+					
+					int foundPeak = chan - 1 + (int) (1.5 * squareWaveWidth);
+					markRawPeak(rawPeakCentroids, foundPeak, peakWidth);
+					
+					passCount = 0;
+				}
+			} else {
+				// use new algorithm for wider peaks
+				
+				boolean known = (null == computed) || computed[i];
+				
+				if (known && (crossProducts[i] >= threshold)) {
+					passCount++;
+				} else {
+					// cross product below threshold
+					
+					if (passCount > 0) {
+						// want to mark half-way back plus 3/2 of wave width
+						int foundPeak = (int) (chan -
+								(.5 * passCount) + (1.5 * squareWaveWidth));
+						markRawPeak(rawPeakCentroids, foundPeak, peakWidth);
+						
+						passCount = 0;
+					}
+				}
+			}
+		} // end for loop
+		
+		return rawPeakCentroids;
+	}
+	
+	/*
+	 * refinePeaks - fine-tune each raw peak location with fitPeak and add
+	 *               it to the results
+	 */
+	private static void refinePeaks(TreeSet<Integer> rawPeakCentroids,
+			Spectrum spectrum, WidthEquation wx, PeakSearchResults results) {
+		
+		for (Iterator<Integer> it = rawPeakCentroids.iterator();
+			 it.hasNext(); ) {
+			Integer peak = it.next();
+			int rawChannel = peak.intValue();
+			double peakWidth = getPeakWidth(wx, rawChannel);
+			SearchPeak newPeak = fitPeak(rawChannel, peakWidth, spectrum);			
+			results.addPeak(newPeak);
+		}
+	}
+	
 	/*
 	 * getSquareWaveWidth - calculate width of the square wave
 	 */
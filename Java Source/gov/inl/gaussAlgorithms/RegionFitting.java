@@ -10,16 +10,34 @@
  */
 package gov.inl.gaussAlgorithms;
 
-import java.awt.geom.Point2D;
+import java.lang.management.ManagementFactory;
+import java.lang.management.ThreadMXBean;
+import java.util.Arrays;
+import java.util.Comparator;
 import java.util.HashMap;
 import java.util.Iterator;
 import java.util.Set;
 import java.util.TreeSet;
 import java.util.Vector;
+import java.util.concurrent.Callable;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.atomic.AtomicBoolean;
 
+import org.apache.commons.math3.fitting.leastsquares.LeastSquaresFactory;
 import org.apache.commons.math3.fitting.leastsquares.LeastSquaresOptimizer.Optimum;
 import org.apache.commons.math3.fitting.leastsquares.LeastSquaresProblem;
 import org.apache.commons.math3.fitting.leastsquares.LevenbergMarquardtOptimizer;
+import org.apache.commons.math3.fitting.leastsquares.MultivariateJacobianFunction;
+import org.apache.commons.math3.linear.Array2DRowRealMatrix;
+import org.apache.commons.math3.linear.ArrayRealVector;
+import org.apache.commons.math3.linear.RealMatrix;
+import org.apache.commons.math3.linear.RealVector;
+import org.apache.commons.math3.optim.ConvergenceChecker;
+import org.apache.commons.math3.util.Pair;
 import org.apache.commons.math3.util.Precision;
 
 import gov.inl.gaussAlgorithms.Fit.CycleReturnCode;
@@ -44,92 +62,152 @@ public class RegionFitting {
 	public static Vector<Fit> fitRegion(final FitInputs inputs)
 	throws Exception {
 		
-		Vector<Fit> answer = new Vector<Fit>();
+		return fitRegion(inputs, null, null);
+	}
+	
+	/*
+	 * fitRegion	public routine that does the same fit as
+	 *              fitRegion(inputs), but starts from the best fit saved
+	 *              in "cache" for this detector and region, if there is
+	 *              one. The saved fit already has the peaks that the add
+	 *              and delete cycles found last time, so those cycles are
+	 *              not repeated. The input peaks are only used when the
+	 *              region is fitted cold: when nothing is saved, when the
+	 *              warm fit fails, or when its chi squared is worse than
+	 *              the cache allows. The best fit is saved for next time.
+	 *              A null cache does fitRegion(inputs). The region
+	 *              solver statistics of the fits include the warm fit
+	 *              when it is thrown away.
+	 */
+	public static Vector<Fit> fitRegion(final FitInputs inputs,
+			FitWarmStartCache cache, String detectorId)
+	throws Exception {
 		
-		TreeSet<Peak> inputPeaks = inputs.getInputPeaks();
-		FitParameters parms = inputs.getFitParameters();
-		if (inputPeaks.size() > parms.getMaxNpeaks()) {
-			throw new Exception("Too many input peaks.");
+		ExecutorService speculator = speculates(inputs) ?
+				Executors.newSingleThreadExecutor() : null;
+		try {
+			return fitRegion(inputs, cache, detectorId, speculator);
+		} finally {
+			if (null != speculator) {
+				speculator.shutdown();
+			}
 		}
+	}
+	
+	/*
+	 * fitSpectrum	public routine that does fitRegion() for every one of
+	 *              "inputs" on numThreads threads, and returns the fits
+	 *              of each region in the order of "inputs".
+	 *
+	 * Fit times vary a lot with region width and peak count, so the
+	 * regions are queued most expensive first (see getFitCost()) and each
+	 * thread takes the next region as soon as it is free. The big
+	 * multiplets then start at once instead of holding up the last
+	 * thread. If fits fail, the exception of the first failed region in
+	 * input order is thrown once all fits are done.
+	 */
+	public static Vector<Vector<Fit>> fitSpectrum(
+			final Vector<FitInputs> inputs, int numThreads)
+	throws Exception {
 		
-		int maxCycles = parms.getNcycle();
-		int[] previousPeakCounts = new int[maxCycles];
+		return fitSpectrum(inputs, numThreads, null, null);
+	}
+	
+	/*
+	 * fitSpectrum	public routine that does the same as
+	 *              fitSpectrum(inputs, numThreads), but fits each region
+	 *              with fitRegion(inputs, cache, detectorId)
+	 */
+	public static Vector<Vector<Fit>> fitSpectrum(
+			final Vector<FitInputs> inputs, int numThreads,
+			final FitWarmStartCache cache, final String detectorId)
+	throws Exception {
 		
-		Spectrum spectrum = inputs.getSpectrum();
-		ChannelRange region = inputs.getRegion();
-		EnergyEquation ex = inputs.getEnergyEquation();
-		WidthEquation wx = inputs.getWidthEquation();
-
-		FitInfo fitInfo = new FitInfo(spectrum, region, ex, wx, inputPeaks);
+		if (numThreads < 1) {
+			throw new Exception("Bad number of threads.");
+		}
 		
-		ConvergenceCriteria cc = new ConvergenceCriteria(parms);
-				
-		int cycleNumber = 1;
-		FitVary fitVary = new FitVary(parms.getPeakwidthMode(), fitInfo);
-		Fit fit = cycle(cycleNumber, inputs, fitInfo, fitVary, cc);
+		int numRegions = inputs.size();
+		Vector<Vector<Fit>> answer = new Vector<Vector<Fit>>();
 		
-		if (null != fit.getCycleException()) {
-			throw  fit.getCycleException();
-		}
-				
-		if (fit.getCycleReturnCode() == CycleReturnCode.CONTINUE) {
-			answer.add(fit);
-			previousPeakCounts[0] = fit.getOutputPeaks().size();
-		} else {
-			Exception reason = fit.getCycleException();
-			if (null == reason) {
-				reason = new Exception("Fit failed for unknown reason.");
+		if ((numThreads == 1) || (numRegions <= 1)) {
+			ExecutorService speculator = getSpeculator(inputs, 1);
+			try {
+				for (Iterator<FitInputs> it = inputs.iterator();
+					 it.hasNext(); ) {
+					answer.add(fitRegion(it.next(), cache, detectorId,
+							speculator));
+				}
+			} finally {
+				if (null != speculator) {
+					speculator.shutdown();
+				}
 			}
-			throw reason;
+			return answer;
 		}
-				
-		double residualThreshold = parms.getMaxResid();
-		int maxPeakCount = parms.getMaxNpeaks();
-
-		for (cycleNumber = 2; cycleNumber <= maxCycles; cycleNumber++) {
-			int completedCycleCount = cycleNumber - 1;
-			int[] peakCountList = new int[completedCycleCount];
-			for (int i = 0; i < completedCycleCount; i++) {
-				peakCountList[i] = previousPeakCounts[i];
-			}
-									
-			if (CycleReturnCode.DONE == checkFit(fitInfo, peakCountList,
-					spectrum, region, fit.getCurve(1), residualThreshold,
-					maxPeakCount, ex)) {
-				break;
-			}
-			
-			fitVary = new FitVary(parms.getPeakwidthMode(), fitInfo);
-			fit = cycle(cycleNumber, inputs, fitInfo, fitVary, cc);
-			answer.add(fit);
-			previousPeakCounts[cycleNumber - 1] = fit.getOutputPeaks().size();
-			if (fit.getCycleReturnCode() != CycleReturnCode.CONTINUE) {
-				break;
-			}
+		
+		// order the regions by cost, most expensive first
+		Integer[] order = new Integer[numRegions];
+		final long[] costs = new long[numRegions];
+		for (int i = 0; i < numRegions; i++) {
+			order[i] = new Integer(i);
+			costs[i] = getFitCost(inputs.get(i));
 		}
+		Arrays.sort(order, new Comparator<Integer>() {
+			public int compare(Integer region1, Integer region2) {
+				long cost1 = costs[region1.intValue()];
+				long cost2 = costs[region2.intValue()];
+				if (cost1 != cost2) {
+					return (cost1 > cost2) ? -1 : 1;
+				}
+				return region1.compareTo(region2);
+			}
+		});
 		
-		// Order the results by chi squared, starting with the smallest.
-				
-		int maxOutCount = parms.getNout();
+		// results are kept in input order
+		Vector<Future<Vector<Fit>>> results =
+				new Vector<Future<Vector<Fit>>>();
+		results.setSize(numRegions);
 		
-		HashMap<Double, Fit> tempMap = new HashMap<Double, Fit>();
-		for (Iterator<Fit> it = answer.iterator(); it.hasNext(); ) {
-			Fit fitItem = it.next();
-			double chiSquared = fitItem.getChiSquared();
-			tempMap.put(new Double(chiSquared), fitItem);
-		}
-		answer.clear();
-		Set<Double> keys = tempMap.keySet();
-		TreeSet<Double> orderedKeys = new TreeSet<Double>();
-		orderedKeys.addAll(keys);
-		int count = 1;
-		for (Iterator<Double> it = orderedKeys.iterator(); it.hasNext();
-			 count++) {
-			Double key = it.next();
-			Fit fitItem = tempMap.get(key);
-			answer.add(fitItem);
-			if (maxOutCount <= count) {
-				break;
+		// the workers share one pool for their speculative cycles
+		int numWorkers = Math.min(numThreads, numRegions);
+		ExecutorService executor = Executors.newFixedThreadPool(numWorkers);
+		final ExecutorService speculator = getSpeculator(inputs, numWorkers);
+		try {
+			for (int i = 0; i < numRegions; i++) {
+				int region = order[i].intValue();
+				final FitInputs regionInputs = inputs.get(region);
+				Callable<Vector<Fit>> task = new Callable<Vector<Fit>>() {
+					public Vector<Fit> call() throws Exception {
+						return fitRegion(regionInputs, cache, detectorId,
+								speculator);
+					}
+				};
+				results.set(region, executor.submit(task));
+			}
+			
+			Exception failure = null;
+			for (int i = 0; i < numRegions; i++) {
+				Vector<Fit> fits = null;
+				try {
+					fits = results.get(i).get();
+				} catch (ExecutionException e) {
+					if ((null == failure) &&
+						(e.getCause() instanceof Exception)) {
+						failure = (Exception) e.getCause();
+					} else if (null == failure) {
+						failure = e;
+					}
+				}
+				answer.add(fits);
+			}
+			if (null != failure) {
+				throw failure;
+			}
+		} finally {
+			executor.shutdown();
+			if (null != speculator) {
+				speculator.shutdown();
 			}
 		}
 		
@@ -139,7 +217,7 @@ public class RegionFitting {
 	// private methods
 	
 	private static boolean addPeak(Spectrum spectrum, ChannelRange region,
-			FitInfo fitInfo, final Curve curve, double residualThreshold,
+			FitInfo fitInfo, final Fit fit, double residualThreshold,
 			int maxPeakCount, EnergyEquation ex) {
 				
 		// If there is no room for another peak,
@@ -150,15 +228,14 @@ public class RegionFitting {
 
 		// find channel with max residual
 		
+		int firstChannel = region.getFirstChannel();
 		double maxResidual = 0;
 		int channelOfMaxResidual = 0;
-		Vector<Point2D.Double> residuals = curve.getResiduals();
-		for (Iterator<Point2D.Double> it = residuals.iterator();
-			 it.hasNext(); ) {
-			Point2D.Double residual = it.next();
-			if (maxResidual < residual.getY()) {
-				maxResidual = residual.getY();
-				channelOfMaxResidual = (int) residual.getX();
+		double[] residuals = fit.getResiduals();
+		for (int i = 0; i < residuals.length; i++) {
+			if (maxResidual < residuals[i]) {
+				maxResidual = residuals[i];
+				channelOfMaxResidual = firstChannel + i;
 			}
 		}
 		
@@ -188,13 +265,13 @@ public class RegionFitting {
 				
 		// If neighboring residuals are not greater than zero,
 		// don't add a new peak.
-		if ((curve.getResidualAt(channelOfMaxResidual - 1).getY() <= 0) &&
-			(curve.getResidualAt(channelOfMaxResidual + 1).getY() <= 0)) {
+		int i = channelOfMaxResidual - firstChannel;
+		if ((residuals[i - 1] <= 0) && (residuals[i + 1] <= 0)) {
 			return false;
 		}
 				
 		// add a new peak
-		double fitAtMaxResidual = curve.getFit(channelOfMaxResidual).getY();
+		double fitAtMaxResidual = fit.getFitsAtChannels()[i];
 		double heightCounts = spectrum.getCountAt(channelOfMaxResidual) -
 				fitAtMaxResidual;
 		fitInfo.addPeak(channelOfMaxResidual,
@@ -207,7 +284,7 @@ public class RegionFitting {
 	// potentially adding or deleting a fit peak
 	private static CycleReturnCode checkFit(FitInfo fitInfo,
 			int[] previousPeakCounts, Spectrum spectrum, ChannelRange region,
-			final Curve curve, double residualThreshold, int maxPeakCount,
+			final Fit fit, double residualThreshold, int maxPeakCount,
 			EnergyEquation ex) {
 		
 		boolean lastPeakIsNew = false;
@@ -216,7 +293,7 @@ public class RegionFitting {
 		
 		if (null != peakToDelete) {
 			fitInfo.deletePeak(peakToDelete);
-		} else if (! addPeak(spectrum, region, fitInfo, curve,
+		} else if (! addPeak(spectrum, region, fitInfo, fit,
 				residualThreshold, maxPeakCount, ex)) {
 			return CycleReturnCode.DONE;
 		} else {
@@ -257,6 +334,9 @@ public class RegionFitting {
 		}
 		
 		Fit results = nllsqs(cycleNumber, inputs, cc, fitInfo, fitVary);
+		if (null != cc.getRefinement()) {
+			results = refine(inputs, results, cc.getRefinement());
+		}
 		
 		return results;
 	}
@@ -322,6 +402,333 @@ public class RegionFitting {
 		return peakToDelete;
 	}
 	
+	/*
+	 * fitCycles:
+	 *   routine that runs the fit cycles from "fitInfo", adding and
+	 *   deleting peaks between cycles, and returns the best parms.getNout()
+	 *   fits, smallest chi squared first. The work of every cycle run,
+	 *   failed, dropped or cancelled, is added to "total", and the
+	 *   returned fits get its sum as their region solver statistics.
+	 *
+	 * In speculative mode the next cycle is started on a thread of
+	 * "speculator" as soon as it is known. checkFit() deletes a peak
+	 * before it looks at the residuals, and which peak it deletes depends
+	 * only on fitInfo and the peak counts of the cycles so far, so a
+	 * delete can be predicted before the cycle ends, assuming the cycle
+	 * will output one peak per PeakInfo. When the cycle ends and the
+	 * assumption held, the started cycle is the one the serial loop
+	 * would run; otherwise it is cancelled. Adding a peak needs the
+	 * residuals of the finished cycle, so that branch cannot be started
+	 * early. A started cycle that has not got a thread yet when it is
+	 * needed is run by the region fit itself.
+	 */
+	private static Vector<Fit> fitCycles(final FitInputs inputs,
+			FitInfo fitInfo, final StatisticsTotal total,
+			ExecutorService speculator)
+	throws Exception {
+		
+		Vector<Fit> answer = new Vector<Fit>();
+		
+		FitParameters parms = inputs.getFitParameters();
+		int maxCycles = parms.getNcycle();
+		int[] previousPeakCounts = new int[maxCycles];
+		
+		Spectrum spectrum = inputs.getSpectrum();
+		ChannelRange region = inputs.getRegion();
+		EnergyEquation ex = inputs.getEnergyEquation();
+		
+		// with adaptive tolerances each cycle is solved loosely and then
+		// refined, so checkFit() sees the fit at the usual tolerances
+		ConvergenceCriteria cc = new ConvergenceCriteria(parms,
+				parms.isAdaptiveTolerances());
+		
+		ExecutorService executor = null;
+		if (speculates(inputs)) {
+			executor = speculator;
+		}
+		Speculation speculation = null;
+		Speculation started = null;
+		
+		try {
+			int cycleNumber = 1;
+			FitVary fitVary = new FitVary(parms.getPeakwidthMode(), fitInfo);
+			if (null != executor) {
+				speculation = speculateDelete(executor, cycleNumber + 1,
+						inputs, fitInfo, new int[0], cc, total);
+			}
+			Fit fit = cycle(cycleNumber, inputs, fitInfo, fitVary, cc);
+			total.add(fit.getSolverStatistics());
+			
+			if (null != fit.getCycleException()) {
+				throw  fit.getCycleException();
+			}
+					
+			if (fit.getCycleReturnCode() == CycleReturnCode.CONTINUE) {
+				answer.add(fit);
+				previousPeakCounts[0] = fit.getOutputPeakCount();
+			} else {
+				Exception reason = fit.getCycleException();
+				if (null == reason) {
+					reason = new Exception("Fit failed for unknown reason.");
+				}
+				throw reason;
+			}
+					
+			double residualThreshold = parms.getMaxResid();
+			int maxPeakCount = parms.getMaxNpeaks();
+	
+			for (cycleNumber = 2; cycleNumber <= maxCycles; cycleNumber++) {
+				int completedCycleCount = cycleNumber - 1;
+				int[] peakCountList = new int[completedCycleCount];
+				for (int i = 0; i < completedCycleCount; i++) {
+					peakCountList[i] = previousPeakCounts[i];
+				}
+				
+				started = null;
+				if ((null != speculation) &&
+					speculation.isFor(peakCountList)) {
+					started = speculation;
+				} else if (null != speculation) {
+					speculation.cancel();
+				}
+				speculation = null;
+										
+				if (CycleReturnCode.DONE == checkFit(fitInfo, peakCountList,
+						spectrum, region, fit, residualThreshold,
+						maxPeakCount, ex)) {
+					if (null != started) {
+						started.cancel();
+					}
+					break;
+				}
+				
+				fitVary = new FitVary(parms.getPeakwidthMode(), fitInfo);
+				if ((null != executor) && (cycleNumber < maxCycles)) {
+					speculation = speculateDelete(executor, cycleNumber + 1,
+							inputs, fitInfo, peakCountList, cc, total);
+				}
+				fit = null;
+				if (null != started) {
+					// its work was added to total by the task
+					fit = started.getFit();
+				}
+				if (null == fit) {
+					fit = cycle(cycleNumber, inputs, fitInfo, fitVary, cc);
+					total.add(fit.getSolverStatistics());
+				}
+				answer.add(fit);
+				previousPeakCounts[cycleNumber - 1] =
+						fit.getOutputPeakCount();
+				if (fit.getCycleReturnCode() != CycleReturnCode.CONTINUE) {
+					break;
+				}
+			}
+		} finally {
+			// the pool is shared, so instead of shutting it down, stop
+			// the cycles still running and wait for them to add their
+			// work to total
+			if (null != started) {
+				started.cancel();
+			}
+			if (null != speculation) {
+				speculation.cancel();
+			}
+		}
+		
+		// Order the results by chi squared, starting with the smallest.
+		// Only the fits that are returned get their uncertainties and
+		// summaries computed.
+				
+		int maxOutCount = parms.getNout();
+		answer = orderByChiSquared(answer, maxOutCount);
+		SolverStatistics regionStatistics = total.get();
+		for (Iterator<Fit> it = answer.iterator(); it.hasNext(); ) {
+			Fit fit = it.next();
+			fit.setRegionSolverStatistics(regionStatistics);
+			fit.finish();
+		}
+		
+		return answer;
+	}
+	
+	/*
+	 * fitRegion:
+	 *   routine that does fitRegion(inputs, cache, detectorId), starting
+	 *   speculative fit cycles on "speculator", which may be null
+	 */
+	private static Vector<Fit> fitRegion(final FitInputs inputs,
+			FitWarmStartCache cache, String detectorId,
+			ExecutorService speculator)
+	throws Exception {
+		
+		FitInfo coldStart = getColdStart(inputs);
+		StatisticsTotal total = new StatisticsTotal();
+		if (null == cache) {
+			return fitCycles(inputs, coldStart, total, speculator);
+		}
+		
+		ChannelRange region = inputs.getRegion();
+		int maxPeakCount = inputs.getFitParameters().getMaxNpeaks();
+		
+		Vector<Fit> answer = null;
+		Fit bestFit = null;
+		FitInfo warmStart = cache.getStart(detectorId, region, maxPeakCount);
+		if (null != warmStart) {
+			try {
+				answer = fitCycles(inputs, warmStart, total, speculator);
+				bestFit = getBestFit(answer);
+			} catch (Exception e) {
+				// fit it cold instead
+				bestFit = null;
+			}
+			if ((null != bestFit) && cache.isDegraded(detectorId, region,
+					bestFit.getChiSquared())) {
+				bestFit = null;
+			}
+		}
+		
+		boolean cold = (null == bestFit);
+		if (cold) {
+			answer = fitCycles(inputs, coldStart, total, speculator);
+			bestFit = getBestFit(answer);
+		}
+		
+		if (null != bestFit) {
+			cache.put(detectorId, region, bestFit, cold);
+		}
+		
+		return answer;
+	}
+	
+	/*
+	 * getBestFit:
+	 *   routine that returns the fit with the smallest chi squared among
+	 *   the cycles that did not fail, or null if they all failed
+	 */
+	private static Fit getBestFit(final Vector<Fit> fits) {
+		
+		for (Iterator<Fit> it = fits.iterator(); it.hasNext(); ) {
+			Fit fit = it.next();
+			if ((null == fit.getCycleException()) &&
+				(null != fit.getFitInfo())) {
+				return fit;
+			}
+		}
+		
+		return null;
+	}
+	
+	/*
+	 * getCommonsProblem:
+	 *   routine that wraps "problem" for the Commons Math optimizer: a
+	 *   target of zeros, so the model is the weighted residual, and no
+	 *   bounds. The optimizer does not look for interrupts, so an
+	 *   evaluation on an interrupted thread throws, as LmderSolver does,
+	 *   to end a cancelled speculative cycle.
+	 */
+	private static LeastSquaresProblem getCommonsProblem(
+			final LmderSolver.Problem problem) {
+		
+		final int numObservations = problem.getObservationSize();
+		final int numParameters = problem.getStart().length;
+		MultivariateJacobianFunction fcn = new MultivariateJacobianFunction() {
+			public Pair<RealVector, RealMatrix> value(RealVector point) {
+				if (Thread.currentThread().isInterrupted()) {
+					throw new IllegalStateException("fit cancelled");
+				}
+				double[] value = new double[numObservations];
+				double[][] jacobian =
+						new double[numObservations][numParameters];
+				problem.evaluate(point.toArray(), value, jacobian);
+				return new Pair<RealVector, RealMatrix>(
+						new ArrayRealVector(value, false),
+						new Array2DRowRealMatrix(jacobian, false));
+			}
+		};
+		
+		ConvergenceChecker<LeastSquaresProblem.Evaluation> checker = null;
+		
+		return LeastSquaresFactory.create(fcn,
+				new ArrayRealVector(numObservations),
+				new ArrayRealVector(problem.getStart()), checker,
+				problem.getMaxEvaluations(), problem.getMaxIterations());
+	}
+	
+	/*
+	 * getColdStart:
+	 *   routine that checks the inputs and makes the usual starting guess
+	 *   from the input peaks and the counts in the region
+	 */
+	private static FitInfo getColdStart(final FitInputs inputs)
+	throws Exception {
+		
+		TreeSet<Peak> inputPeaks = inputs.getInputPeaks();
+		FitParameters parms = inputs.getFitParameters();
+		if (inputPeaks.size() > parms.getMaxNpeaks()) {
+			throw new Exception("Too many input peaks.");
+		}
+		
+		Spectrum spectrum = inputs.getSpectrum();
+		long[] background = inputs.getBackground();
+		if ((null != background) &&
+			(background.length != spectrum.getCounts().length)) {
+			throw new Exception("Bad background length.");
+		}
+		
+		return new FitInfo(spectrum, inputs.getRegion(),
+				inputs.getEnergyEquation(), inputs.getWidthEquation(),
+				inputPeaks, background);
+	}
+	
+	/*
+	 * getFitCost:
+	 *   routine that estimates the relative cost of fitting a region: the
+	 *   size of the Jacobian, channels times parameters, for its input
+	 *   peaks (at least one, as FitInfo adds one when there are none).
+	 */
+	private static long getFitCost(final FitInputs inputs) {
+		
+		long numChannels = inputs.getRegion().widthChannels();
+		long numPeaks = Math.max(1, inputs.getInputPeaks().size());
+		
+		return numChannels * (3 + (3 * numPeaks));
+	}
+	
+	/*
+	 * getSpeculator:
+	 *   routine that returns a pool of "numThreads" threads for the
+	 *   speculative fit cycles of "inputs", or null if none of them
+	 *   speculates. A region fit has at most two speculative cycles at a
+	 *   time and runs a cycle itself rather than wait for it to start,
+	 *   so one thread per region fit running at once is enough.
+	 */
+	private static ExecutorService getSpeculator(
+			final Vector<FitInputs> inputs, int numThreads) {
+		
+		for (Iterator<FitInputs> it = inputs.iterator(); it.hasNext(); ) {
+			if (speculates(it.next())) {
+				return Executors.newFixedThreadPool(numThreads);
+			}
+		}
+		
+		return null;
+	}
+	
+	/*
+	 * getThreadCpuNanos:
+	 *   routine that returns the CPU time of the current thread, or 0 if
+	 *   the JVM does not measure it
+	 */
+	private static long getThreadCpuNanos() {
+		
+		ThreadMXBean threadBean = ManagementFactory.getThreadMXBean();
+		if (!threadBean.isCurrentThreadCpuTimeSupported()) {
+			return 0;
+		}
+		
+		return Math.max(0, threadBean.getCurrentThreadCpuTime());
+	}
+	
 	private static Fit nllsqs(int cycleNumber, final FitInputs inputs,
 			ConvergenceCriteria cc, final FitInfo fitInfo, FitVary fitVary) {
 		
@@ -340,38 +747,211 @@ public class RegionFitting {
 		// it either works or makes no difference... not sure.
 		//double qrRankingThreshold = 0;
 				
-		LevenbergMarquardtOptimizer opt = new LevenbergMarquardtOptimizer(
-				initialStepBoundFactor, costRelativeTolerance,
-				parRelativeTolerance, orthoTolerance, qrRankingThreshold);
+		LmderSolver opt = new LmderSolver(initialStepBoundFactor,
+				costRelativeTolerance, parRelativeTolerance, orthoTolerance,
+				qrRankingThreshold);
 		
+		// the Commons optimizer has no bounds or variable projection, so
+		// those modes always use LmderSolver
+		FitParameters parms = inputs.getFitParameters();
+		boolean lmder = parms.isLmderSolver() || parms.isBounded() ||
+				parms.isVariableProjection();
 		LmderFcn fcn = new LmderFcn(inputs.getSpectrum(), inputs.getRegion(),
-				fitInfo, fitVary);
-		LeastSquaresProblem problem = fcn.getProblem();
+				fitInfo, fitVary, parms.isBounded());
+		LmderSolver.Problem problem = fcn.getProblem();
+		LmderSolver varProOpt = null;
+		if (parms.isVariableProjection()) {
+			varProOpt = new LmderSolver(initialStepBoundFactor,
+					costRelativeTolerance, parRelativeTolerance,
+					orthoTolerance, qrRankingThreshold);
+		}
 		
-		Optimum answer = null;
+		long startWallNanos = System.nanoTime();
+		long startCpuNanos = getThreadCpuNanos();
+		double[] answer = null;
+		Optimum commonsOptimum = null;
+		Exception optimizerException = null;
 		try {
-			answer = opt.optimize(problem);
+			if (!lmder) {
+				// evaluate the problem once at the answer for the
+				// covariances, as for variable projection
+				commonsOptimum = new LevenbergMarquardtOptimizer(
+						initialStepBoundFactor, costRelativeTolerance,
+						parRelativeTolerance, orthoTolerance,
+						qrRankingThreshold).optimize(
+								getCommonsProblem(problem));
+				answer = commonsOptimum.getPoint().toArray();
+				opt.evaluateAt(problem, answer);
+			} else if (null == varProOpt) {
+				answer = opt.optimize(problem);
+			} else {
+				// solve the nonlinear parameters, then evaluate the full
+				// problem once at the answer for the covariances
+				LmderSolver.Problem varPro = fcn.getVarProProblem();
+				double[] nonlinearX = varPro.getStart();
+				if (0 < nonlinearX.length) {
+					nonlinearX = varProOpt.optimize(varPro);
+				}
+				answer = fcn.getVarProSolution(nonlinearX);
+				opt.evaluateAt(problem, answer);
+			}
 		} catch (Exception e) {
+			optimizerException = e;
+		}
+		int iterations = opt.getIterations();
+		int evaluations = opt.getEvaluations();
+		if (null != varProOpt) {
+			iterations += varProOpt.getIterations();
+			evaluations += varProOpt.getEvaluations();
+		}
+		if (null != commonsOptimum) {
+			iterations += commonsOptimum.getIterations();
+			evaluations += commonsOptimum.getEvaluations();
+		}
+		SolverStatistics solverStatistics = new SolverStatistics(
+				iterations, evaluations, System.nanoTime() - startWallNanos,
+				getThreadCpuNanos() - startCpuNanos);
+		
+		if (null != optimizerException) {
 			Exception reason = new Exception(
-					"Exception in Apache least squares optimizer: " +
-					e.getMessage());
-			return new Fit(cycleNumber, CycleReturnCode.DONE, reason);
+					"Exception in least squares optimizer: " +
+					optimizerException.getMessage());
+			Fit fit = new Fit(cycleNumber, CycleReturnCode.DONE, reason);
+			fit.setSolverStatistics(solverStatistics);
+			return fit;
 		}
 
-		FitInfo finalFitInfo = fcn.getFinalFitInfo();
+		FitInfo finalFitInfo = fcn.getFinalFitInfo(answer);
 
-		// NOTE: the covariances are calculated by Apache code...		
-		// I believe the covariance matrix is pretty standard.
-		// old code used covariance tolerance = 0
-		FitInfoUncertainty fitInfoUncertainty = new FitInfoUncertainty(
-				finalFitInfo, fitVary, answer.getCovariances(0),
-				inputs.getEnergyEquation());
-		Fit fit = new Fit(inputs, cycleNumber, finalFitInfo, fitVary,
-				fitInfoUncertainty, CycleReturnCode.CONTINUE);
+		// the uncertainties are computed from "opt" by Fit.finish(), for
+		// the fits that fitCycles() returns
+		Fit fit = new Fit(inputs, cycleNumber, finalFitInfo, fitVary, opt,
+				CycleReturnCode.CONTINUE);
+		fit.setSolverStatistics(solverStatistics);
 
 		return fit;
 	}
 	
+	/*
+	 * orderByChiSquared:
+	 *   routine that returns the first "maxCount" of "fits", smallest
+	 *   chi squared first; of fits with the same chi squared, the last
+	 *   is kept
+	 */
+	private static Vector<Fit> orderByChiSquared(final Vector<Fit> fits,
+			int maxCount) {
+		
+		HashMap<Double, Fit> tempMap = new HashMap<Double, Fit>();
+		for (Iterator<Fit> it = fits.iterator(); it.hasNext(); ) {
+			Fit fitItem = it.next();
+			double chiSquared = fitItem.getChiSquared();
+			tempMap.put(new Double(chiSquared), fitItem);
+		}
+		Vector<Fit> answer = new Vector<Fit>();
+		Set<Double> keys = tempMap.keySet();
+		TreeSet<Double> orderedKeys = new TreeSet<Double>();
+		orderedKeys.addAll(keys);
+		int count = 1;
+		for (Iterator<Double> it = orderedKeys.iterator(); it.hasNext();
+			 count++) {
+			Double key = it.next();
+			answer.add(tempMap.get(key));
+			if (maxCount <= count) {
+				break;
+			}
+		}
+		
+		return answer;
+	}
+	
+	/*
+	 * refine:
+	 *   routine that solves the cycle of "fit", which was run with loose
+	 *   tolerances, again from its answer with the tolerances of "cc".
+	 *   The refined fit's statistics include the work of both. A failed
+	 *   cycle is returned as it is, and so is "fit" if the refinement
+	 *   fails.
+	 */
+	private static Fit refine(final FitInputs inputs, final Fit fit,
+			ConvergenceCriteria cc) {
+		
+		if ((null != fit.getCycleException()) ||
+			(null == fit.getFitInfo())) {
+			return fit;
+		}
+		
+		Fit refined = nllsqs(fit.getCycleNumber(), inputs, cc,
+				fit.getFitInfo(), fit.getFitVary());
+		SolverStatistics statistics =
+				fit.getSolverStatistics().add(refined.getSolverStatistics());
+		if (null != refined.getCycleException()) {
+			fit.setSolverStatistics(statistics);
+			return fit;
+		}
+		refined.setSolverStatistics(statistics);
+		
+		return refined;
+	}
+	
+	/*
+	 * speculateDelete:
+	 *   routine that starts cycle "cycleNumber" on "executor" if
+	 *   checkFit() will delete a peak before it. "fitInfo" is the start of
+	 *   the cycle now running and "peakCounts" the output peak counts of
+	 *   the cycles before it; the running cycle is assumed to output
+	 *   fitInfo.getPeakCount() peaks. Returns null if no peak would be
+	 *   deleted. The started cycle adds its work to "total" whether it is
+	 *   used or cancelled.
+	 */
+	private static Speculation speculateDelete(ExecutorService executor,
+			final int cycleNumber, final FitInputs inputs,
+			final FitInfo fitInfo, final int[] peakCounts,
+			final ConvergenceCriteria cc, final StatisticsTotal total) {
+		
+		int[] expectedCounts = new int[peakCounts.length + 1];
+		System.arraycopy(peakCounts, 0, expectedCounts, 0, peakCounts.length);
+		expectedCounts[peakCounts.length] = fitInfo.getPeakCount();
+		
+		final FitInfo nextFitInfo = fitInfo.clone();
+		if (null == deletePeak(nextFitInfo, expectedCounts)) {
+			return null;
+		}
+		
+		// the delete branch of checkFit() does not look at the fit
+		FitParameters parms = inputs.getFitParameters();
+		checkFit(nextFitInfo, expectedCounts, inputs.getSpectrum(),
+				inputs.getRegion(), null, parms.getMaxResid(),
+				parms.getMaxNpeaks(), inputs.getEnergyEquation());
+		
+		final FitVary nextFitVary = new FitVary(parms.getPeakwidthMode(),
+				nextFitInfo);
+		Callable<Fit> task = new Callable<Fit>() {
+			public Fit call() throws Exception {
+				Fit fit = cycle(cycleNumber, inputs, nextFitInfo,
+						nextFitVary, cc);
+				total.add(fit.getSolverStatistics());
+				return fit;
+			}
+		};
+		
+		Speculation speculation = new Speculation(expectedCounts, task);
+		speculation.start(executor);
+		
+		return speculation;
+	}
+	
+	/*
+	 * speculates:
+	 *   routine that tells whether a region fit with "inputs" runs
+	 *   speculative cycles; a single cycle has nothing to speculate on.
+	 */
+	private static boolean speculates(final FitInputs inputs) {
+		
+		FitParameters parms = inputs.getFitParameters();
+		
+		return parms.isSpeculative() && (1 < parms.getNcycle());
+	}
+	
 	// inner classes
 	
 	// TODO add other lmder settings to this? gtol? qrRankingThreshold?
@@ -386,13 +966,24 @@ public class RegionFitting {
 		// preliminary tests show these work.
 		private static double[] m_ftolm = {1.0e-6, 1.0e-5, 1.0e-5, 1.0e-4};
 		private static double[] m_xtolm = {1.0e-6, 1.0e-5, 3.0e-5, 1.0e-4};
-		private double          m_ftol;
-		private double          m_xtol;
 		
-		ConvergenceCriteria(FitParameters parms) {
+		// loose tolerances for the add and delete cycles, see
+		// FitParameters.isAdaptiveTolerances(); they are the C settings
+		private final static double LOOSE_FACTOR = 100;
+		
+		private double               m_ftol;
+		private double               m_xtol;
+		private ConvergenceCriteria  m_refinement;
+		
+		/*
+		 * loose - multiply the tolerances by LOOSE_FACTOR, and refine
+		 *         with the usual tolerances
+		 */
+		ConvergenceCriteria(FitParameters parms, boolean loose) {
 			
 			m_ftol = 0;
 			m_xtol = 0;
+			m_refinement = null;
 			int index = 0;
 			
 			PeakWidthMode peakWidthMode = parms.getPeakwidthMode();
@@ -420,6 +1011,11 @@ public class RegionFitting {
 			
 			m_ftol = m_ftolm[index];
 			m_xtol = m_xtolm[index];
+			if (loose) {
+				m_ftol *= LOOSE_FACTOR;
+				m_xtol *= LOOSE_FACTOR;
+				m_refinement = new ConvergenceCriteria(parms, false);
+			}
 		}
 		double getFtol() {
 			return m_ftol;
@@ -427,5 +1023,146 @@ public class RegionFitting {
 		double getXtol() {
 			return m_xtol;
 		}
+		// the criteria a loose fit is refined with; null if not loose
+		ConvergenceCriteria getRefinement() {
+			return m_refinement;
+		}
+	}
+	
+	/**
+	 * a fit cycle started before the cycle ahead of it ended, and the
+	 * peak counts that checkFit() must see for it to be the right one.
+	 * The cycle runs on a pool that other region fits share, so cancel()
+	 * waits for it to stop instead of shutting the pool down.
+	 */
+	private static class Speculation implements Callable<Fit> {
+		
+		// member data
+		
+		private final int[]          m_peakCounts;
+		private final Callable<Fit>  m_cycle;
+		private final AtomicBoolean  m_claimed;  // by call() or cancel()
+		private final CountDownLatch m_done;     // once it cannot run
+		private Future<Fit>          m_future;
+		
+		// constructor
+		
+		Speculation(final int[] peakCounts, Callable<Fit> cycle) {
+			
+			m_peakCounts = peakCounts;
+			m_cycle = cycle;
+			m_claimed = new AtomicBoolean(false);
+			m_done = new CountDownLatch(1);
+			m_future = null;
+		}
+		
+		// public methods
+		
+		/*
+		 * call - runs the cycle, unless cancel() got to it first
+		 */
+		public Fit call() throws Exception {
+			
+			if (!m_claimed.compareAndSet(false, true)) {
+				return null;
+			}
+			
+			try {
+				return m_cycle.call();
+			} finally {
+				m_done.countDown();
+			}
+		}
+		
+		// package methods
+		
+		/*
+		 * cancel - interrupts the cycle if it is running and waits for it
+		 *          to end, so its work is in the total; a cycle that has
+		 *          not started never runs
+		 */
+		void cancel() {
+			
+			m_future.cancel(true);
+			if (m_claimed.compareAndSet(false, true)) {
+				m_done.countDown();
+				return;
+			}
+			
+			boolean interrupted = false;
+			while (true) {
+				try {
+					m_done.await();
+					break;
+				} catch (InterruptedException e) {
+					interrupted = true;
+				}
+			}
+			if (interrupted) {
+				Thread.currentThread().interrupt();
+			}
+		}
+		
+		/*
+		 * getFit - waits for the cycle; null if it did not return or had
+		 *          not started, in which case the caller runs the cycle
+		 *          itself instead of waiting for a free thread
+		 */
+		Fit getFit() {
+			
+			if (m_claimed.compareAndSet(false, true)) {
+				m_future.cancel(false);
+				m_done.countDown();
+				return null;
+			}
+			try {
+				return m_future.get();
+			} catch (ExecutionException e) {
+				return null;
+			} catch (InterruptedException e) {
+				Thread.currentThread().interrupt();
+				return null;
+			}
+		}
+		
+		boolean isFor(final int[] peakCounts) {
+			
+			return Arrays.equals(m_peakCounts, peakCounts);
+		}
+		
+		void start(ExecutorService executor) {
+			
+			m_future = executor.submit(this);
+		}
+	}
+	
+	/**
+	 * the solver work of all the fit cycles of one region fit. Speculative
+	 * cycles add to it from other threads.
+	 */
+	private static class StatisticsTotal {
+		
+		// member data
+		
+		private SolverStatistics  m_total;
+		
+		// constructor
+		
+		StatisticsTotal() {
+			
+			m_total = new SolverStatistics();
+		}
+		
+		// package methods
+		
+		synchronized void add(final SolverStatistics statistics) {
+			
+			m_total = m_total.add(statistics);
+		}
+		
+		synchronized SolverStatistics get() {
+			
+			return m_total;
+		}
 	}
 }
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2017 Battelle Energy Alliance
+ */
+/*
+ *  Gauss Algorithms
+ *
+ *  File Name: RegionSearchState.java
+ *
+ *  Description: keeps the background of a region search for reuse
+ */
+package gov.inl.gaussAlgorithms;
+
+import java.util.Arrays;
+
+/**
+ * background and background flags from a region search, kept so that
+ * searching the same spectrum again with a different peak list can skip
+ * the iterative background smoothing
+ *
+ */
+public class RegionSearchState {
+
+	// member data
+
+	private int                         m_firstChannel;
+	private long[]                      m_counts;
+	private double[]                    m_sigCounts;
+	private ChannelRange                m_searchRange;
+	private WidthEquation               m_wx;
+	private long[]                      m_background;
+	private boolean[]                   m_regionFlag;
+
+	// constructor
+
+	public RegionSearchState() {
+
+		clear();
+	}
+
+	// public methods
+
+	/*
+	 * clear - forget the saved background, so the next search
+	 *         recomputes it
+	 */
+	public void clear() {
+
+		m_firstChannel = 0;
+		m_counts = null;
+		m_sigCounts = null;
+		m_searchRange = null;
+		m_wx = null;
+		m_background = null;
+		m_regionFlag = null;
+	}
+
+	public boolean isSet() {
+
+		return (null != m_background);
+	}
+
+	/*
+	 * matches - true if a background was saved for this spectrum,
+	 *           search range and width equation
+	 */
+	public boolean matches(Spectrum spectrum, ChannelRange searchRange,
+			WidthEquation wx) {
+
+		if (!isSet()) {
+			return false;
+		}
+
+		return ((spectrum.getFirstChannel() == m_firstChannel) &&
+				searchRange.equals(m_searchRange) && wx.equals(m_wx) &&
+				Arrays.equals(spectrum.getCounts(), m_counts) &&
+				Arrays.equals(spectrum.getSigCounts(), m_sigCounts));
+	}
+
+	// package methods, used by RegionSearching
+
+	long[] getBackground() {
+
+		return m_background;
+	}
+
+	/*
+	 * getRegionFlag - copy of the flags set from the background alone
+	 */
+	boolean[] getRegionFlag() {
+
+		return m_regionFlag.clone();
+	}
+
+	void set(Spectrum spectrum, ChannelRange searchRange, WidthEquation wx,
+			final long[] background, final boolean[] regionFlag) {
+
+		m_firstChannel = spectrum.getFirstChannel();
+		m_counts = spectrum.getCounts().clone();
+		m_sigCounts = spectrum.getSigCounts().clone();
+		m_searchRange = searchRange;
+		m_wx = wx;
+		m_background = background.clone();
+		m_regionFlag = regionFlag.clone();
+	}
+}
@@ -10,8 +10,15 @@
  */
 package gov.inl.gaussAlgorithms;
 
+import java.util.Arrays;
 import java.util.Iterator;
+import java.util.List;
 import java.util.TreeSet;
+import java.util.Vector;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
 
 /**
  * contains the region search algorithm
@@ -54,6 +61,110 @@ public class RegionSearching {
 			final TreeSet<Peak> peaks, final RegionSearchParameters parms)
 	throws Exception {
 	
+		return search(spectrum, searchRange, wx, peaks, parms, null, null, 1);
+	}
+
+	/*
+	 * search	public routine that does the same search as search(), but
+	 *          keeps the background in "state". While the spectrum,
+	 *          search range and width equation stay the same, later
+	 *          calls reuse it and only redo the steps after the
+	 *          background, which are the ones that depend on the peaks.
+	 */
+	public static TreeSet<ChannelRange> search(Spectrum spectrum,
+			ChannelRange searchRange, WidthEquation wx,
+			final TreeSet<Peak> peaks, final RegionSearchParameters parms,
+			RegionSearchState state)
+	throws Exception {
+	
+		if (null == state) {
+			throw new Exception("Missing region search state.");
+		}
+		
+		return search(spectrum, searchRange, wx, peaks, parms, state, null,
+				1);
+	}
+
+	/*
+	 * searchParallel	public routine that does the same search as
+	 *                  search(), but runs the background passes and the
+	 *                  region pruning on numThreads threads.
+	 *
+	 * The search range is split into segments where enough channels on
+	 * either side are not flagged that no pass can see across the split.
+	 * The segments are re-chosen before each pass, so the regions are
+	 * identical to those from search().
+	 */
+	public static TreeSet<ChannelRange> searchParallel(Spectrum spectrum,
+			ChannelRange searchRange, WidthEquation wx,
+			final TreeSet<Peak> peaks, final RegionSearchParameters parms,
+			int numThreads)
+	throws Exception {
+		
+		if (numThreads < 1) {
+			throw new Exception("Bad number of threads.");
+		}
+		
+		if (numThreads == 1) {
+			return search(spectrum, searchRange, wx, peaks, parms, null,
+					null, 1);
+		}
+		
+		ExecutorService executor = Executors.newFixedThreadPool(numThreads);
+		try {
+			return search(spectrum, searchRange, wx, peaks, parms, null,
+					executor, numThreads);
+		} finally {
+			executor.shutdown();
+		}
+	}
+
+	/*
+	 * searchWithBackground	public routine that does the same search as
+	 *                      search(), and copies the smoothed background
+	 *                      into "background", one value per spectrum
+	 *                      channel. The background is only computed in
+	 *                      SEARCHMODE.ALL; in the other modes it is zero.
+	 */
+	public static TreeSet<ChannelRange> searchWithBackground(
+			Spectrum spectrum, ChannelRange searchRange, WidthEquation wx,
+			final TreeSet<Peak> peaks, final RegionSearchParameters parms,
+			long[] background)
+	throws Exception {
+	
+		if (background.length != spectrum.getCounts().length) {
+			throw new Exception("Bad background length.");
+		}
+		
+		RegionSearchState state = new RegionSearchState();
+		TreeSet<ChannelRange> regions = search(spectrum, searchRange, wx,
+				peaks, parms, state, null, 1);
+		
+		if (state.isSet()) {
+			long[] stateBackground = state.getBackground();
+			System.arraycopy(stateBackground, 0, background, 0,
+					background.length);
+		} else {
+			Arrays.fill(background, 0);
+		}
+		
+		return regions;
+	}
+
+	/*
+	 * search:
+	 *   routine that does the region search, splitting the passes over
+	 *   the flags into numSegments pieces that run on the executor
+	 *   (in this thread if executor is null). If state is not null, the
+	 *   background is taken from it when it matches and saved otherwise.
+	 */
+	private static TreeSet<ChannelRange> search(Spectrum spectrum,
+			ChannelRange searchRange, WidthEquation wx,
+			final TreeSet<Peak> peaks, final RegionSearchParameters parms,
+			RegionSearchState state, ExecutorService executor,
+			int numSegments)
+	throws Exception {
+	
 		if (searchRange.getLastChannel() > spectrum.getLastChannel()) {
 			throw new Exception("Bad search range");
 		}
@@ -76,38 +187,59 @@ public class RegionSearching {
 		double threshold = parms.getThreshold();
 		RegionSearchParameters.SEARCHMODE searchMode = parms.getSearchMode();
 		
-		boolean[] regionFlag = new boolean[numChannels];
-		int[] background = new int[numChannels];
-		for (int i = 0; i < numChannels; i++) {
-			regionFlag[i] = false;
-			background[i] = 0;
-		}
-
-		// set up background
+		boolean[] regionFlag;
+		long[] background;
+		boolean useState =
+				RegionSearchParameters.SEARCHMODE.ALL.equals(searchMode) &&
+				(null != state) && state.matches(spectrum, searchRange, wx);
 		
-		if (RegionSearchParameters.SEARCHMODE.ALL.equals(searchMode)) {
-			   initRegionBackground(wx, searchRange, spectrum, background,
-					   regionFlag);
+		if (useState) {
+			// background and its flags do not depend on the peaks
+			background = state.getBackground();
+			regionFlag = state.getRegionFlag();
+		} else {
+			regionFlag = new boolean[numChannels];
+			background = new long[numChannels];
+			for (int i = 0; i < numChannels; i++) {
+				regionFlag[i] = false;
+				background[i] = 0;
+			}
+
+			// set up background
+			
+			if (RegionSearchParameters.SEARCHMODE.ALL.equals(searchMode)) {
+				initRegionBackground(wx, searchRange, spectrum, background,
+						regionFlag, executor, numSegments);
+				if (null != state) {
+					state.set(spectrum, searchRange, wx, background,
+							regionFlag);
+				}
+			}
 		}
 		
 		// force regions for existing peaks
 		
 		regionsForPeaks(wx, peaks, specFirstChan, numChannels, regionFlag);
 
+		// The rest of the flag work joins and grows whole runs of
+		// flagged channels, so switch to runs.
+		
+		FlagRuns runs = new FlagRuns(regionFlag);
+
 		if (RegionSearchParameters.SEARCHMODE.ALL.equals(searchMode)) {
 			   deleteSmallRegion(searchRange, threshold, spectrum,
-					   background, maxRegionWidthChannels, regionFlag);
+					   background, maxRegionWidthChannels, runs);
 		}
 		
 		deleteSmallBackground(searchRange, specFirstChan, numChannels,
-				maxRegionWidthChannels, regionFlag);
+				maxRegionWidthChannels, runs);
 
 		TreeSet<ChannelRange> regions = storeRegions(searchRange,
-				specFirstChan, numChannels, regionFlag);
+				specFirstChan, numChannels, runs);
 
 		if (RegionSearchParameters.SEARCHMODE.ALL.equals(searchMode)) {
 			regions = pruneRegions(wx, spectrum, peaks, background, threshold,
-					maxRegionWidthChannels, regions);
+					maxRegionWidthChannels, regions, executor, numSegments);
 		}
 
 		regions = padRegions(wx, searchRange, parms.getMaxExpansionChannels(),
@@ -123,7 +255,7 @@ public class RegionSearching {
 	 */
 	private static void deleteSmallBackground(ChannelRange searchRange,
 			int specFirstChan, int numChannels, int maxRegionWidthChannels,
-			boolean[] regionFlag) {
+			FlagRuns runs) {
 
 		// If regions separated by one channel, join them.
 
@@ -132,32 +264,31 @@ public class RegionSearching {
 		int topChannel = searchRange.getLastChannel() - 6 - specFirstChan;
 		topChannel = Math.min((numChannels - 2), topChannel);
 
-		int firstRegionCount = 0;
-		for (int i = bottomChannel; i <= topChannel; i++) {
-			if ((regionFlag[i] == false) &&
-				(regionFlag[i-1] == true) && (regionFlag[i+1] == true)) {
-				
-				// Count second region and decide if we can join.
+		// A one channel gap sits between two flagged runs. The first
+		// region is only counted from bottomChannel, and the second
+		// region only up to the channel before topChannel.
 
-				int secondRegionCount = 0;
-				for (int j = i + 1; j < topChannel; j++) {
-					if (regionFlag[j] == true) {
-						secondRegionCount++;
-					} else {
-						break;
-					}
-				}
-				
-				if (firstRegionCount + secondRegionCount <=
-						maxRegionWidthChannels) {
-					regionFlag[i] = true;
-				}
+		for (int r = runs.getHead(); r != -1; r = runs.getNext(r)) {
+			int i = runs.getStart(r);
+			if (i > topChannel) {
+				break;
+			}
+			if (runs.isFlagged(r) || (runs.getEnd(r) != i) ||
+				(i < bottomChannel) || (runs.getPrev(r) == -1) ||
+				(runs.getNext(r) == -1)) {
+				continue;
 			}
 
-			if (regionFlag[i] == true) {
-				firstRegionCount++;
-			} else {
-				firstRegionCount = 0;
+			int firstRegionCount = i - Math.max(
+					runs.getStart(runs.getPrev(r)), bottomChannel);
+			firstRegionCount = Math.max(0, firstRegionCount);
+			int secondRegionCount = Math.min(
+					runs.getEnd(runs.getNext(r)), topChannel - 1) - i;
+			secondRegionCount = Math.max(0, secondRegionCount);
+			
+			if (firstRegionCount + secondRegionCount <=
+					maxRegionWidthChannels) {
+				r = runs.setFlag(r, true);
 			}
 		}
 	}
@@ -167,12 +298,12 @@ public class RegionSearching {
 	 *   routine that deletes or enlarges small regions.
 	 */
 	private static void deleteSmallRegion(ChannelRange searchRange,
-			double threshold, Spectrum spectrum, int[] background,
-			int maxRegionWidthChannels, boolean[] regionFlag)
+			double threshold, Spectrum spectrum, long[] background,
+			int maxRegionWidthChannels, FlagRuns runs)
 	{
 		
 		int specFirstChan = spectrum.getFirstChannel();
-		int[] counts = spectrum.getCounts();
+		long[] counts = spectrum.getCounts();
 		int numChannels = counts.length;
 		double[] sigCounts = spectrum.getSigCounts();
 
@@ -183,114 +314,249 @@ public class RegionSearching {
 		
 		// Discard single channel regions unless both adjacent counts are
 		// greater than background; and at center, y greater than
-		// background + threshold.
-
-		for (int i = bottomChannel; i <= topChannel; i++) {
-			if ((regionFlag[i] == true) &&
-				(regionFlag[i-1] == false) && (regionFlag[i+1] == false)) {
-				if ((counts[i] >=
-					 (background[i] + (int) (threshold * sigCounts[i]))) &&
-					(counts[i-1] >= background[i-1]) &&
-					(counts[i+1] >= background[i+1])) {
-					
-					// Don't create new region that is bigger than max allowed.
-					int firstRegionCount = 3;
-					for (int j = i - 2; j >= bottomChannel; j--) {
-						if (regionFlag[j] == true) {
-							firstRegionCount++;
-						} else {
-							break;
-						}
-					}
-					
-					int secondRegionCount = 0;
-					for (int j = i + 2; j <= topChannel; j++) {
-						if (regionFlag[j] == true) {
-							secondRegionCount++;
-						} else {
-							break;
-						}
-					}
-					
-					if (firstRegionCount + secondRegionCount <=
-							maxRegionWidthChannels) {
-						regionFlag[i-1] = true;
-						regionFlag[i+1] = true;
-					} else {
-						regionFlag[i] = false;
-					}
+		// background + threshold. A single channel region is a flagged
+		// run of length one, and its neighbours are unflagged runs.
+
+		for (int r = runs.getHead(); r != -1; r = runs.getNext(r)) {
+			int i = runs.getStart(r);
+			if (i > topChannel) {
+				break;
+			}
+			if (!runs.isFlagged(r) || (runs.getEnd(r) != i) ||
+				(i < bottomChannel)) {
+				continue;
+			}
+
+			if ((counts[i] >=
+				 (background[i] + (long) (threshold * sigCounts[i]))) &&
+				(counts[i-1] >= background[i-1]) &&
+				(counts[i+1] >= background[i+1])) {
+				
+				// Don't create new region that is bigger than max allowed.
+				// The regions that would be joined are the flagged runs
+				// past one channel gaps, counted only within the bounds.
+				
+				int firstRegionCount = 3;
+				int before = runs.getPrev(r);
+				if ((runs.getStart(before) == i - 1) &&
+					(runs.getPrev(before) != -1) &&
+					(i - 2 >= bottomChannel)) {
+					firstRegionCount += i - 1 - Math.max(
+							runs.getStart(runs.getPrev(before)),
+							bottomChannel);
+				}
+				
+				int secondRegionCount = 0;
+				int after = runs.getNext(r);
+				if ((runs.getEnd(after) == i + 1) &&
+					(runs.getNext(after) != -1) &&
+					(i + 2 <= topChannel)) {
+					secondRegionCount += Math.min(
+							runs.getEnd(runs.getNext(after)),
+							topChannel) - i - 1;
+				}
+				
+				if (firstRegionCount + secondRegionCount <=
+						maxRegionWidthChannels) {
+					r = runs.grow(r);
 				} else {
-					regionFlag[i] = false;
+					r = runs.setFlag(r, false);
 				}
+			} else {
+				r = runs.setFlag(r, false);
 			}
 		}
 
 		// Check very first and very last channels for small regions.
 
-		if ((regionFlag[0] == true) && (regionFlag[1] == false)) {
-			regionFlag[0] = false;
+		int first = runs.getHead();
+		if ((first != -1) && runs.isFlagged(first) &&
+			(runs.getEnd(first) == 0)) {
+			runs.setFlag(first, false);
+		}
+
+		int r = runs.getHead();
+		while ((r != -1) && (runs.getEnd(r) <= topChannel)) {
+			r = runs.getNext(r);
+		}
+		if ((r != -1) && runs.isFlagged(r) &&
+			(runs.getStart(r) == topChannel + 1) &&
+			(runs.getPrev(r) != -1)) {
+			runs.unflagFirstChannel(r);
 		}
+	}
 
-		if ((regionFlag[topChannel+1] == true) &&
-			(regionFlag[topChannel] == false)) {
-			regionFlag[topChannel+1] = false;
+	/*
+	 * flagAboveBackground:
+	 *   routine that flags channels first to last whose counts are well
+	 *   above the background, and returns true if any were flagged.
+	 *   After the first pass, only a channel whose background moved can
+	 *   newly pass the test. A newly flagged channel is marked in
+	 *   windowChanged[], as it now adds its background to the window
+	 *   sums instead of its counts.
+	 */
+	private static boolean flagAboveBackground(int first, int last,
+			boolean firstPass, long[] counts, double[] sigCounts,
+			long[] background, boolean[] backgroundChanged,
+			boolean[] regionFlag, boolean[] windowChanged) {
+		
+		boolean change = false;
+		for (int j = first; j <= last; j++) {
+			if ((firstPass || backgroundChanged[j]) &&
+				(regionFlag[j] == false) &&
+                ((background[j] + (long) (2 * sigCounts[j])) <=
+                	counts[j]) &&
+                (counts[j] > 1)) {
+				regionFlag[j] = true;
+				windowChanged[j] = true;
+				change = true;
+			}
+		}
+		
+		return change;
+	}
+
+	/*
+	 * getSegmentBounds:
+	 *   routine that splits channels bottomChannel to topChannel into at
+	 *   most numSegments segments. Each split is at or after the even
+	 *   split point, where quietChannels channels on either side are not
+	 *   flagged. Returns the first channel of each segment followed by
+	 *   topChannel + 1.
+	 */
+	private static int[] getSegmentBounds(boolean[] regionFlag,
+			int bottomChannel, int topChannel, int numSegments,
+			int quietChannels) {
+		
+		Vector<Integer> bounds = new Vector<Integer>();
+		bounds.add(new Integer(bottomChannel));
+		
+		if ((numSegments > 1) && (topChannel > bottomChannel)) {
+			// flagsBelow[i] is the number of flagged channels below i
+			int numChannels = regionFlag.length;
+			int[] flagsBelow = new int[numChannels + 1];
+			for (int i = 0; i < numChannels; i++) {
+				flagsBelow[i+1] = flagsBelow[i];
+				if (regionFlag[i] == true) {
+					flagsBelow[i+1]++;
+				}
+			}
+			
+			int segmentWidth = (topChannel - bottomChannel + 1) /
+					numSegments;
+			int split = bottomChannel;
+			for (int s = 1; s < numSegments; s++) {
+				split = Math.max(split + 1,
+						bottomChannel + (s * segmentWidth));
+				for (; split <= topChannel; split++) {
+					int low = Math.max(0, split - quietChannels);
+					int high = Math.min(numChannels, split + quietChannels);
+					if (flagsBelow[high] == flagsBelow[low]) {
+						break;
+					}
+				}
+				
+				if (split > topChannel) {
+					break;
+				}
+				bounds.add(new Integer(split));
+			}
 		}
+		
+		bounds.add(new Integer(topChannel + 1));
+		
+		int[] segmentBounds = new int[bounds.size()];
+		for (int i = 0; i < segmentBounds.length; i++) {
+			segmentBounds[i] = bounds.get(i).intValue();
+		}
+		
+		return segmentBounds;
 	}
 
 	/*
 	 * initRegionBackground:
 	 *   routine that does initial search using background.
+	 *
+	 *   The background is a running average over +/- 1.5 peakwidths of
+	 *   the background in flagged channels and the counts elsewhere.
+	 *   The window sum slides along the spectrum, and background[] is
+	 *   updated in place, so later channels see the new values just as
+	 *   a full re-summation would. After the first pass, only the
+	 *   windows that hold a channel whose value in the sum changed are
+	 *   recomputed; the others would give the same background.
 	 */
 	private static void initRegionBackground(WidthEquation wx,
-			ChannelRange searchRange, Spectrum spectrum, int[] background,
-			boolean[] regionFlag) {
+			ChannelRange searchRange, Spectrum spectrum,
+			final long[] background, final boolean[] regionFlag,
+			ExecutorService executor, int numSegments) throws Exception {
 
-		int[] counts = spectrum.getCounts();
+		final long[] counts = spectrum.getCounts();
 		int numChannels = counts.length;
-		double[] sigCounts = spectrum.getSigCounts();
+		final double[] sigCounts = spectrum.getSigCounts();
 		int specFirstChan = spectrum.getFirstChannel();
 		int bottomChannel = searchRange.getFirstChannel() + 5 - specFirstChan;
-		bottomChannel = Math.max(0, bottomChannel);
+		final int firstChannel = Math.max(0, bottomChannel);
 		int topChannel = searchRange.getLastChannel() - 5 - specFirstChan;
 		topChannel = Math.min((numChannels - 1), topChannel);
+		if (topChannel < firstChannel) {
+			return;
+		}
+		
+		// window half widths do not change between iterations
+		final int[] peakWidthInt = new int[topChannel - firstChannel + 1];
+		int maxPeakWidthInt = 0;
+		for (int j = firstChannel; j <= topChannel; j++) {
+			double peakWidthDbl = getValidPeakwidth(wx, j);
+			peakWidthInt[j - firstChannel] =
+					(int) ((peakWidthDbl + .1) * 1.5);
+			maxPeakWidthInt = Math.max(maxPeakWidthInt,
+					peakWidthInt[j - firstChannel]);
+		}
+		final int maxHalfWidth = maxPeakWidthInt;
+		final boolean[] backgroundChanged = new boolean[numChannels];
+		final boolean[] windowChanged = new boolean[numChannels];
 		
 		for (int i = 0; i < 30; i++) {
 			
+			// No window reaches across a split into a flagged channel,
+			// so each segment sums only values that it owns or that
+			// are counts.
+			final boolean firstPass = (i == 0);
+			int[] bounds = getSegmentBounds(regionFlag, firstChannel,
+					topChannel, numSegments, maxPeakWidthInt);
+			
 			// Set values in background[].
-			for (int j = bottomChannel; j <= topChannel; j++) {
-				double peakWidthDbl = getValidPeakwidth(wx, j);
-				int peakWidthInt = (int) ((peakWidthDbl + .1) * 1.5);
-
-				int k = j - peakWidthInt;
-				k = Math.max(0, k);
-				int sumTopChannel = j + peakWidthInt;
-				sumTopChannel = Math.min((numChannels - 1), sumTopChannel);
-				
-				int sum;
-				for (sum = 0; k <= sumTopChannel; k++) {
-					if (regionFlag[k] == true) {
-						sum += background[k];
-					} else {
-						sum += counts[k];
+			Vector<Callable<Boolean>> tasks = new Vector<Callable<Boolean>>();
+			for (int s = 0; s + 1 < bounds.length; s++) {
+				final int first = bounds[s];
+				final int last = bounds[s+1] - 1;
+				tasks.add(new Callable<Boolean>() {
+					public Boolean call() {
+						smoothBackground(first, last, firstPass,
+								firstChannel, peakWidthInt, maxHalfWidth,
+								counts, background, regionFlag,
+								backgroundChanged, windowChanged);
+						return Boolean.FALSE;
 					}
-	            }
-
-	            background[j] = (sum + peakWidthInt) /
-	            		        ((2 * peakWidthInt) + 1);
+				});
 			}
+			runSegments(executor, tasks);
 
 			// Set values in regionFlag[].
-
-			boolean change = false;
-			for (int j = bottomChannel; j <= topChannel; j++) {
-				if ((regionFlag[j] == false) &&
-	                ((background[j] + (int) (2 * sigCounts[j])) <=
-	                	counts[j]) &&
-	                (counts[j] > 1)) {
-					regionFlag[j] = true;
-					change = true;
-				}
+			tasks = new Vector<Callable<Boolean>>();
+			for (int s = 0; s + 1 < bounds.length; s++) {
+				final int first = bounds[s];
+				final int last = bounds[s+1] - 1;
+				tasks.add(new Callable<Boolean>() {
+					public Boolean call() {
+						return Boolean.valueOf(flagAboveBackground(first,
+								last, firstPass, counts, sigCounts,
+								background, backgroundChanged, regionFlag,
+								windowChanged));
+					}
+				});
 			}
+			boolean change = runSegments(executor, tasks);
 
 			if (change == false) {
 				break;
@@ -316,15 +582,74 @@ public class RegionSearching {
 		return peakwidth;
 	}
 
+	/*
+	 * getWindowValue:
+	 *   routine that returns what channel i adds to the background sum.
+	 */
+	private static long getWindowValue(long[] counts, long[] background,
+			boolean[] regionFlag, int i) {
+		
+		if (regionFlag[i] == true) {
+			return background[i];
+		}
+		
+		return counts[i];
+	}
+
+	/*
+	 * keepRegion:
+	 *   routine that decides whether pruneRegions() keeps a region. A
+	 *   region is kept if it contains a peak from the peak list or has
+	 *   enough points above background near its highest point.
+	 */
+	private static boolean keepRegion(WidthEquation wx, int specFirstChan,
+			long[] counts, double[] sigCounts, final PeakIndex peakIndex,
+			long[] background, double threshold, ChannelRange region) {
+
+		if (peakIndex.hasPeakIn(region)) {
+			return true;
+		}
+
+		long maxDiff = 0;
+		int bottomChannel = region.getFirstChannel() - specFirstChan;
+		int topChannel = region.getLastChannel() - specFirstChan;
+		int tempPeak = bottomChannel;
+		for (int j = bottomChannel; j <= topChannel; j++) {
+			long diff = counts[j] - background[j];
+			if (diff > maxDiff) {
+				maxDiff = diff;
+				tempPeak = j;
+			}
+		}
+  
+		double peakWidthDbl = getValidPeakwidth(wx, tempPeak);
+		int peakWidthInt = (int) (((peakWidthDbl + .5) / 2.0) - 1.0);
+		peakWidthInt = Math.max(peakWidthInt, RS_MIN_PKWID);
+
+		int belowBackgroundCount = 0;
+		bottomChannel = tempPeak - peakWidthInt - specFirstChan;
+		topChannel = tempPeak + peakWidthInt + 1 - specFirstChan;
+		for (int j = bottomChannel; j <= topChannel; j++) {
+			if (counts[j] <= background[j]) {
+				belowBackgroundCount++;
+			}
+		}
+		
+		return ((belowBackgroundCount <= 1) &&
+				(counts[tempPeak] > background[tempPeak] + (long)
+				                    (threshold * sigCounts[tempPeak])));
+	}
+
 	/*
 	 * pruneRegions:
 	 *   routine that deletes regions that are not needed for an
 	 *   existing peak and are not wide enough above background.
 	 */
-	private static TreeSet<ChannelRange> pruneRegions(WidthEquation wx,
-			Spectrum spectrum, final TreeSet<Peak> peaks, int[] background,
-			double threshold, int maxRegionWidthChannels,
-			final TreeSet<ChannelRange> regions) {
+	private static TreeSet<ChannelRange> pruneRegions(final WidthEquation wx,
+			Spectrum spectrum, final TreeSet<Peak> peaks,
+			final long[] background, final double threshold,
+			int maxRegionWidthChannels, final TreeSet<ChannelRange> regions,
+			ExecutorService executor, int numSegments) throws Exception {
 
 		TreeSet<ChannelRange> newRegionList1 = new TreeSet<ChannelRange>();		
 		int numRegions = regions.size();
@@ -335,60 +660,40 @@ public class RegionSearching {
 		// If region contains peak from peaklist (search peaks), keep it.
 		// Else if region has < peakwidth points above background near
 		// the highest point in the region, then discard the region.
+		// Each region is decided on its own, so split the list.
 
-		int specFirstChan = spectrum.getFirstChannel();
-		int[] counts = spectrum.getCounts();
-		double[] sigCounts = spectrum.getSigCounts();
+		final int specFirstChan = spectrum.getFirstChannel();
+		final long[] counts = spectrum.getCounts();
+		final double[] sigCounts = spectrum.getSigCounts();
+		final PeakIndex peakIndex = new PeakIndex(peaks);
+		final ChannelRange[] regionArray =
+				regions.toArray(new ChannelRange[numRegions]);
+		final boolean[] keep = new boolean[numRegions];
 		
-		for (Iterator<ChannelRange> it = regions.iterator(); it.hasNext(); ) {
-			
-			boolean regionWithPeak = false;
-			ChannelRange region = it.next();
-			
-			for (Iterator<Peak> itp1 = peaks.iterator(); itp1.hasNext(); ) {
-				Peak peak = itp1.next();
-				
-				if (peak.inChannelRange(region)) {
-					regionWithPeak = true;
-					break;
-				}				
-			}
-
-			if (regionWithPeak) {
-				newRegionList1.add(region);
-			} else {
-				int maxDiff = 0;
-				int bottomChannel = region.getFirstChannel() - specFirstChan;
-				int topChannel = region.getLastChannel() - specFirstChan;
-				int tempPeak = bottomChannel;
-				for (int j = bottomChannel; j <= topChannel; j++) {
-					int diff = counts[j] - background[j];
-					if (diff > maxDiff) {
-						maxDiff = diff;
-						tempPeak = j;
+		int regionsPerSegment = (numRegions + numSegments - 1) / numSegments;
+		Vector<Callable<Boolean>> tasks = new Vector<Callable<Boolean>>();
+		for (int first = 0; first < numRegions; first += regionsPerSegment) {
+			final int firstRegion = first;
+			final int lastRegion = Math.min(numRegions,
+					first + regionsPerSegment) - 1;
+			tasks.add(new Callable<Boolean>() {
+				public Boolean call() {
+					for (int k = firstRegion; k <= lastRegion; k++) {
+						keep[k] = keepRegion(wx, specFirstChan, counts,
+								sigCounts, peakIndex, background, threshold,
+								regionArray[k]);
 					}
+					return Boolean.FALSE;
 				}
-	      
-				double peakWidthDbl = getValidPeakwidth(wx, tempPeak);
-				int peakWidthInt = (int) (((peakWidthDbl + .5) / 2.0) - 1.0);
-				peakWidthInt = Math.max(peakWidthInt, RS_MIN_PKWID);
-
-				int belowBackgroundCount = 0;
-				bottomChannel = tempPeak - peakWidthInt - specFirstChan;
-				topChannel = tempPeak + peakWidthInt + 1 - specFirstChan;
-				for (int j = bottomChannel; j <= topChannel; j++) {
-					if (counts[j] <= background[j]) {
-						belowBackgroundCount++;
-					}
-				}
-				
-				if ((belowBackgroundCount <= 1) &&
-					(counts[tempPeak] > background[tempPeak] + (int)
-					                    (threshold * sigCounts[tempPeak]))) {
-					newRegionList1.add(region);
-				}
-			} // no peaks in region
-		} // loop over regions
+			});
+		}
+		runSegments(executor, tasks);
+		
+		for (int k = 0; k < numRegions; k++) {
+			if (keep[k]) {
+				newRegionList1.add(regionArray[k]);
+			}
+		}
 		
 		// If regions close, data between them is above background,
 		// and combined regions have <= 4 peaks, then join regions.
@@ -438,20 +743,9 @@ public class RegionSearching {
 				
 				if (!belowBackground) {
 					// count the peaks that lie in the proposed joined region
-					int peakRegionCount = 0;
-					for (Iterator<Peak> itp2 = peaks.iterator(); itp2.hasNext(); ) {
-						Peak peak = itp2.next();
-						
-						if (peak.isChannelValid() == true) {
-							double peakChannel = peak.getChannel();
-							if ((peakChannel >=
-									firstRegion.getFirstChannel()) &&
-								(peakChannel <=
-									secondRegion.getLastChannel())) {
-								peakRegionCount++;
-							}
-						}
-					}
+					int peakRegionCount = peakIndex.countInRange(
+							firstRegion.getFirstChannel(),
+							secondRegion.getLastChannel());
 
 					if ((peakRegionCount <= 4) &&
 						(secondRegion.getLastChannel() -
@@ -645,12 +939,132 @@ public class RegionSearching {
 		}
 	}
 
+	/*
+	 * runSegments:
+	 *   routine that runs the tasks on the executor, or in this thread
+	 *   if there is no executor, and returns true if any task did.
+	 */
+	private static boolean runSegments(ExecutorService executor,
+			Vector<Callable<Boolean>> tasks) throws Exception {
+		
+		boolean anyTrue = false;
+		
+		if ((null == executor) || (tasks.size() <= 1)) {
+			for (int i = 0; i < tasks.size(); i++) {
+				if (tasks.get(i).call().booleanValue()) {
+					anyTrue = true;
+				}
+			}
+			return anyTrue;
+		}
+		
+		List<Future<Boolean>> results = executor.invokeAll(tasks);
+		for (Iterator<Future<Boolean>> it = results.iterator();
+			 it.hasNext(); ) {
+			if (it.next().get().booleanValue()) {
+				anyTrue = true;
+			}
+		}
+		
+		return anyTrue;
+	}
+
+	/*
+	 * smoothBackground:
+	 *   routine that sets background[] in channels first to last from
+	 *   the sliding window sum. peakWidthInt[] holds the window half
+	 *   widths starting at bottomChannel, none more than maxHalfWidth.
+	 *
+	 *   windowChanged[] marks the channels whose value in the sum moved
+	 *   since the last pass: flagged channels whose background changed
+	 *   and newly flagged ones. After the first pass, a channel is only
+	 *   recomputed if a marked channel, or one changed earlier in this
+	 *   pass, is within maxHalfWidth of it. The marks are cleared as
+	 *   they are read and set again for the next pass. Segments do not
+	 *   share flagged channels, so they do not share marks.
+	 */
+	private static void smoothBackground(int first, int last,
+			boolean firstPass, int bottomChannel, int[] peakWidthInt,
+			int maxHalfWidth, long[] counts, long[] background,
+			boolean[] regionFlag, boolean[] backgroundChanged,
+			boolean[] windowChanged) {
+		
+		int numChannels = counts.length;
+		long sum = 0;
+		int sumBottomChannel = first;
+		int sumTopChannel = first - 1;
+		boolean sumValid = true;
+		
+		// channels up to reach are recomputed
+		int reach = firstPass ? last : (first - 1);
+		int scanChannel = Math.max(0, first - maxHalfWidth);
+		int scanLast = Math.min((numChannels - 1), last + maxHalfWidth);
+		for (int j = first; j <= last; j++) {
+			for (; (scanChannel <= scanLast) &&
+				   (scanChannel <= j + maxHalfWidth); scanChannel++) {
+				if (windowChanged[scanChannel] == true) {
+					windowChanged[scanChannel] = false;
+					reach = Math.max(reach, scanChannel + maxHalfWidth);
+				}
+			}
+			if (j > reach) {
+				backgroundChanged[j] = false;
+				sumValid = false;
+				continue;
+			}
+			if (sumValid == false) {
+				// restart the sum after channels that were skipped
+				sum = 0;
+				sumBottomChannel = j;
+				sumTopChannel = j - 1;
+				sumValid = true;
+			}
+			
+			int halfWidth = peakWidthInt[j - bottomChannel];
+			int windowBottom = Math.max(0, j - halfWidth);
+			int windowTop = Math.min((numChannels - 1), j + halfWidth);
+			
+			// slide the window sum to [windowBottom, windowTop]
+			while (sumTopChannel < windowTop) {
+				sumTopChannel++;
+				sum += getWindowValue(counts, background, regionFlag,
+						sumTopChannel);
+			}
+			while (sumTopChannel > windowTop) {
+				sum -= getWindowValue(counts, background, regionFlag,
+						sumTopChannel);
+				sumTopChannel--;
+			}
+			while (sumBottomChannel > windowBottom) {
+				sumBottomChannel--;
+				sum += getWindowValue(counts, background, regionFlag,
+						sumBottomChannel);
+			}
+			while (sumBottomChannel < windowBottom) {
+				sum -= getWindowValue(counts, background, regionFlag,
+						sumBottomChannel);
+				sumBottomChannel++;
+			}
+
+			long newBackground = (sum + halfWidth) / ((2 * halfWidth) + 1);
+			backgroundChanged[j] = (newBackground != background[j]);
+			if ((regionFlag[j] == true) && backgroundChanged[j]) {
+				// channel j is inside the window; keep the sum current
+				sum += newBackground - background[j];
+				windowChanged[j] = true;
+				reach = Math.max(reach, j + maxHalfWidth);
+			}
+			background[j] = newBackground;
+		}
+	}
+
 	/*
 	 * storeRegions:
-	 *   routine that translates an array of flags into a list of regions.
+	 *   routine that translates the flagged runs into a list of regions.
 	 */
-	private static TreeSet<ChannelRange> storeRegions(ChannelRange searchRange,
-			int specFirstChan, int numChannels, boolean[] regionFlag) {
+	private static TreeSet<ChannelRange> storeRegions(
+			ChannelRange searchRange, int specFirstChan, int numChannels,
+			FlagRuns runs) {
 
 	/*
 	 * Comments and change by Egger on 9/10/99.
@@ -676,33 +1090,188 @@ public class RegionSearching {
 		int topChannel = searchRange.getLastChannel() - specFirstChan;
 		topChannel = Math.min((numChannels - 1), topChannel);
 
-		boolean withinRegion = false;
-		int newRegionStart = 0;
-		
-		for (int i = bottomChannel; i <= topChannel; i++) {
-			if ((withinRegion == false) && (regionFlag[i] == true)) {
-				withinRegion = true;
-				newRegionStart = i + specFirstChan;
-			} else if ((withinRegion == true) && (regionFlag[i] == false)) {
-				int newRegionEnd = i - 1 + specFirstChan;
-				ChannelRange newRegion =
-						new ChannelRange(newRegionStart, newRegionEnd);
-				regions.add(newRegion);
-				withinRegion = false;
-				newRegionStart = 0;
+		for (int r = runs.getHead(); r != -1; r = runs.getNext(r)) {
+			if (runs.getStart(r) > topChannel) {
+				break;
 			}
-		}
-
-		// If the last region did not end before the search range,
-		// then add one last region that ends with the search range.
-
-		if (withinRegion == true) {
+			if (!runs.isFlagged(r) || (runs.getEnd(r) < bottomChannel)) {
+				continue;
+			}
+			
+			int newRegionStart = Math.max(runs.getStart(r), bottomChannel) +
+					specFirstChan;
+			
+			// If the last region did not end before the search range,
+			// then it ends with the search range.
+			
 			int newRegionEnd = searchRange.getLastChannel();
-			ChannelRange newRegion =
-					new ChannelRange(newRegionStart, newRegionEnd);
-			regions.add(newRegion);
+			if (runs.getEnd(r) < topChannel) {
+				newRegionEnd = runs.getEnd(r) + specFirstChan;
+			}
+			regions.add(new ChannelRange(newRegionStart, newRegionEnd));
 		}
 		
 		return regions;
 	}
+
+	// inner class
+	
+	/**
+	 * the region flags as runs of flagged and unflagged channels, in a
+	 * linked list so that joining a gap or growing a region only touches
+	 * the neighbouring runs
+	 *
+	 */
+	private static class FlagRuns {
+		
+		// member data
+		
+		private final int[]      m_start;
+		private final int[]      m_end;
+		private final boolean[]  m_flagged;
+		private final int[]      m_prev;
+		private final int[]      m_next;
+		private int              m_head;
+		
+		// constructor
+		
+		private FlagRuns(final boolean[] regionFlag) {
+			
+			int numRuns = 0;
+			for (int i = 0; i < regionFlag.length; i++) {
+				if ((0 == i) || (regionFlag[i] != regionFlag[i-1])) {
+					numRuns++;
+				}
+			}
+			
+			m_start = new int[numRuns];
+			m_end = new int[numRuns];
+			m_flagged = new boolean[numRuns];
+			m_prev = new int[numRuns];
+			m_next = new int[numRuns];
+			m_head = (0 < numRuns) ? 0 : -1;
+			
+			int r = -1;
+			for (int i = 0; i < regionFlag.length; i++) {
+				if ((0 == i) || (regionFlag[i] != regionFlag[i-1])) {
+					r++;
+					m_start[r] = i;
+					m_flagged[r] = regionFlag[i];
+					m_prev[r] = r - 1;
+					m_next[r] = (r + 1 < numRuns) ? r + 1 : -1;
+				}
+				m_end[r] = i;
+			}
+		}
+		
+		// package methods
+		
+		int getEnd(int run) {
+			return m_end[run];
+		}
+		int getHead() {
+			return m_head;
+		}
+		int getNext(int run) {
+			return m_next[run];
+		}
+		int getPrev(int run) {
+			return m_prev[run];
+		}
+		int getStart(int run) {
+			return m_start[run];
+		}
+		boolean isFlagged(int run) {
+			return m_flagged[run];
+		}
+		
+		/*
+		 * grow - flags the channel on either side of a run that has
+		 *        neighbours on both sides, joining any run that meets it.
+		 *        Returns the run that now holds the channels.
+		 */
+		int grow(int run) {
+			
+			int before = m_prev[run];
+			m_end[before]--;
+			m_start[run]--;
+			if (m_end[before] < m_start[before]) {
+				remove(before);
+				if (m_prev[run] != -1) {
+					run = m_prev[run];
+					joinNext(run);
+				}
+			}
+			
+			int after = m_next[run];
+			m_start[after]++;
+			m_end[run]++;
+			if (m_end[after] < m_start[after]) {
+				remove(after);
+				if (m_next[run] != -1) {
+					joinNext(run);
+				}
+			}
+			
+			return run;
+		}
+		
+		/*
+		 * setFlag - changes a run's flag and joins it to its neighbours.
+		 *           Returns the run that now holds the channels.
+		 */
+		int setFlag(int run, boolean flagged) {
+			
+			m_flagged[run] = flagged;
+			
+			int before = m_prev[run];
+			if ((before != -1) && (m_flagged[before] == flagged)) {
+				joinNext(before);
+				run = before;
+			}
+			
+			int after = m_next[run];
+			if ((after != -1) && (m_flagged[after] == flagged)) {
+				joinNext(run);
+			}
+			
+			return run;
+		}
+		
+		/*
+		 * unflagFirstChannel - moves the first channel of a run into the
+		 *                      run before it
+		 */
+		void unflagFirstChannel(int run) {
+			
+			if (m_start[run] == m_end[run]) {
+				setFlag(run, !m_flagged[run]);
+			} else {
+				m_start[run]++;
+				m_end[m_prev[run]]++;
+			}
+		}
+		
+		// private methods
+		
+		private void joinNext(int run) {
+			
+			int after = m_next[run];
+			m_end[run] = m_end[after];
+			remove(after);
+		}
+		private void remove(int run) {
+			
+			int before = m_prev[run];
+			int after = m_next[run];
+			if (before != -1) {
+				m_next[before] = after;
+			} else {
+				m_head = after;
+			}
+			if (after != -1) {
+				m_prev[after] = before;
+			}
+		}
+	} // FlagRuns
 }
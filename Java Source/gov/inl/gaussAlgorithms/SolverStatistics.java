@@ -0,0 +1,103 @@
+/*
+ * Copyright 2017 Battelle Energy Alliance
+ */
+/*
+ *  Gauss Algorithms
+ *
+ *  File Name: SolverStatistics.java
+ *
+ *  Description: contains the work done by the least squares solver in
+ *               a fit cycle
+ */
+package gov.inl.gaussAlgorithms;
+
+/**
+ * Iterations, evaluations and time used by the least squares solver in
+ * one fit cycle, or summed over several cycles with add().
+ *
+ */
+public class SolverStatistics {
+
+	// member data
+
+	private final int          m_iterations;
+	private final int          m_evaluations;
+	private final long         m_wallNanos;
+	private final long         m_cpuNanos;
+
+	// constructors
+
+	/**
+	 * Returns statistics for no work, e.g. for a cycle that failed
+	 * before the solver ran.
+	 */
+	public SolverStatistics() {
+
+		this(0, 0, 0, 0);
+	}
+
+	/**
+	 * @param iterations   Levenberg-Marquardt iterations
+	 * @param evaluations  residual and Jacobian evaluations
+	 * @param wallNanos    elapsed time, in nanoseconds
+	 * @param cpuNanos     CPU time of the fitting thread, in nanoseconds;
+	 *                     0 if the JVM does not measure thread CPU time
+	 */
+	public SolverStatistics(int iterations, int evaluations,
+			long wallNanos, long cpuNanos) {
+
+		m_iterations = iterations;
+		m_evaluations = evaluations;
+		m_wallNanos = wallNanos;
+		m_cpuNanos = cpuNanos;
+	}
+
+	// public methods
+
+	/**
+	 * Returns the sum of these statistics and "other".
+	 * @param other  statistics of another cycle
+	 * @return       the totals
+	 */
+	public SolverStatistics add(final SolverStatistics other) {
+
+		return new SolverStatistics(m_iterations + other.m_iterations,
+				m_evaluations + other.m_evaluations,
+				m_wallNanos + other.m_wallNanos,
+				m_cpuNanos + other.m_cpuNanos);
+	}
+
+	/**
+	 * Returns the CPU time of the thread that ran the solver.
+	 * @return seconds, 0 if not measured
+	 */
+	public double getCpuSeconds() {
+		return m_cpuNanos / 1.0e9;
+	}
+
+	/**
+	 * Returns the number of evaluations of the fit function. The
+	 * residuals and the Jacobian are computed together, so this is also
+	 * the number of Jacobian evaluations.
+	 * @return evaluations
+	 */
+	public int getEvaluations() {
+		return m_evaluations;
+	}
+
+	/**
+	 * Returns the number of Levenberg-Marquardt iterations.
+	 * @return iterations
+	 */
+	public int getIterations() {
+		return m_iterations;
+	}
+
+	/**
+	 * Returns the elapsed time of the solver, including the evaluations.
+	 * @return seconds
+	 */
+	public double getWallSeconds() {
+		return m_wallNanos / 1.0e9;
+	}
+}
@@ -19,27 +19,42 @@ public class Spectrum {
 	private final int                   m_firstChannel;
 	private final int                   m_lastChannel;
 	// expect to have same size array for count as for sigCount
-	private final int[]                 m_count;
+	private final long[]                m_count;
 	private final double[]              m_sigCount;
 
 	public Spectrum (int firstChannel, final int[] count) throws Exception {
 		
+		this(firstChannel, toLongCounts(count));
+	}
+	
+	public Spectrum (int firstChannel, final int[] count,
+			final double[] sigCount) throws Exception {
+		
+		this(firstChannel, toLongCounts(count), sigCount);
+	}
+
+	/*
+	 * Counts are held as 64-bit values so that long acquisitions and
+	 * sums over many channels cannot overflow.
+	 */
+	public Spectrum (int firstChannel, final long[] count) throws Exception {
+		
 		m_firstChannel = firstChannel;
 		if (null == count) {
-			m_count = new int[0];
+			m_count = new long[0];
 		} else {
 			m_count = count.clone();
 		}
 		m_lastChannel = m_firstChannel + m_count.length - 1;
-		m_sigCount = constructSigCounts(count);
+		m_sigCount = constructSigCounts(m_count);
 	}
 	
-	public Spectrum (int firstChannel, final int[] count,
+	public Spectrum (int firstChannel, final long[] count,
 			final double[] sigCount) throws Exception {
 		
 		m_firstChannel = firstChannel;
 		if (null == count) {
-			m_count = new int[0];
+			m_count = new long[0];
 			m_sigCount = new double[0];
 		} else {
 			m_count = count.clone();
@@ -48,11 +63,11 @@ public class Spectrum {
 		m_lastChannel = m_firstChannel + m_count.length - 1;
 	}
 
-	public int getCountAt(int channel) {
+	public long getCountAt(int channel) {
 		return m_count[channel - m_firstChannel];
 	}
 
-	public int[] getCounts() {
+	public long[] getCounts() {
 		return m_count;
 	}
 
@@ -64,14 +79,14 @@ public class Spectrum {
 		return m_lastChannel;
 	}
 	
-	public int[] getRegionCounts(ChannelRange region) {
+	public long[] getRegionCounts(ChannelRange region) {
 		
 		// TODO added on 7/3/2014. Check it.
 		if (region.getFirstChannel() > m_lastChannel) {
-			return new int[0];
+			return new long[0];
 		}
 		if (region.getLastChannel() < m_firstChannel) {
-			return new int[0];
+			return new long[0];
 		}
 
 		int bottom = Math.max(region.getFirstChannel(), m_firstChannel);
@@ -79,7 +94,7 @@ public class Spectrum {
 		top = Math.max(bottom, top);
 
 		int regionWidth = top - bottom + 1;
-		int[] regionCounts = new int[regionWidth];
+		long[] regionCounts = new long[regionWidth];
 		int pointer = bottom - m_firstChannel;
 		
 		for (int i = 0; i < regionWidth; i++, pointer++) {
@@ -97,7 +112,7 @@ public class Spectrum {
 		return m_sigCount;
 	}
 
-	private static double[] constructSigCounts(final int[] counts)
+	private static double[] constructSigCounts(final long[] counts)
 			throws Exception {
 
 		int numChannels = counts.length;
@@ -153,4 +168,21 @@ public class Spectrum {
 		
 		return sigCount;
 	}
+
+	/*
+	 * toLongCounts - widens 32-bit counts for storage; null stays null
+	 */
+	private static long[] toLongCounts(final int[] count) {
+		
+		if (null == count) {
+			return null;
+		}
+
+		long[] longCount = new long[count.length];
+		for (int i = 0; i < count.length; i++) {
+			longCount[i] = count[i];
+		}
+		
+		return longCount;
+	}
 }